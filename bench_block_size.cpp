@@ -0,0 +1,96 @@
+#include "src/myfs.h"
+#include <chrono>
+#include <filesystem>
+#include <iomanip>
+#include <random>
+
+// 用法: bench_block_size [镜像大小(MB)] [文件大小(MB)]
+// 对每种块大小分别格式化一个镜像，比较顺序写、顺序读、随机读和小文件创建的性能
+
+// 计时，返回毫秒数
+template <typename F>
+double measure(F&& f) {
+    auto begin = std::chrono::steady_clock::now();
+    f();
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+}
+
+int main(int argc, char* argv[]){
+    uint64_t disk_mb = argc > 1 ? std::stoul(argv[1]) : 256;
+    uint64_t file_mb = argc > 2 ? std::stoul(argv[2]) : 16;
+    const std::string image = "bench.img";
+    const unsigned int CHUNK = 1024 * 1024;
+    const unsigned int RANDOM_READS = 4096;
+    const unsigned int RANDOM_READ_SIZE = 512;
+    const unsigned int SMALL_FILES = 20;
+    const unsigned int SMALL_FILE_SIZE = 2000;
+
+    // 文件系统的提示信息会刷屏，基准测试期间丢弃
+    std::ostream report(std::cout.rdbuf());
+    std::ofstream null_stream;
+    std::cout.rdbuf(null_stream.rdbuf());
+    std::cerr.rdbuf(null_stream.rdbuf());
+
+    std::vector<char> data(CHUNK);
+    std::mt19937 rng(42);
+    for (auto& c : data) c = static_cast<char>(rng());
+    std::vector<char> read_buffer(CHUNK);
+
+    report << "Disk " << disk_mb << " MB, file " << file_mb << " MB" << std::endl;
+    report << std::setw(8) << "block" << std::setw(14) << "write MB/s" << std::setw(14) << "read MB/s"
+           << std::setw(16) << "rand read/s" << std::setw(16) << "small files/s" << std::endl;
+    for (unsigned int block_size = MIN_BLOCK_SIZE; block_size <= MAX_BLOCK_SIZE; block_size *= 2) {
+        MyFileSystem fs(image);
+        if (!fs.format(disk_mb * 1024 * 1024, 10, block_size) || !fs.mount()) {
+            report << std::setw(8) << block_size << "  format failed" << std::endl;
+            continue;
+        }
+        fs.create("/big");
+        int fd = fs.open("/big");
+        uint64_t file_size = file_mb * CHUNK;
+        // 块越小，间接块能索引的文件越小
+        uint64_t pointers = block_size / sizeof(uint64_t);
+        if (file_size > (DIRECT_BLOCK_COUNT + pointers + pointers * pointers) * block_size) {
+            report << std::setw(8) << block_size << "  file too large for this block size" << std::endl;
+            continue;
+        }
+        bool ok = true;
+
+        double write_ms = measure([&] {
+            for (uint64_t offset = 0; offset < file_size && ok; offset += CHUNK) {
+                ok = fs.write(fd, offset, CHUNK, data.data());
+            }
+        });
+        double read_ms = measure([&] {
+            for (uint64_t offset = 0; offset < file_size && ok; offset += CHUNK) {
+                ok = fs.read(fd, offset, CHUNK, read_buffer.data()) && read_buffer == data;
+            }
+        });
+        double random_ms = measure([&] {
+            for (unsigned int i = 0; i < RANDOM_READS && ok; i++) {
+                uint64_t offset = rng() % (file_size - RANDOM_READ_SIZE);
+                ok = fs.read(fd, offset, RANDOM_READ_SIZE, read_buffer.data());
+            }
+        });
+        double small_ms = measure([&] {
+            for (unsigned int i = 0; i < SMALL_FILES && ok; i++) {
+                std::string path = "/small" + std::to_string(i);
+                ok = fs.create(path) && fs.write(fs.open(path), 0, SMALL_FILE_SIZE, data.data());
+            }
+        });
+        fs.unmount();
+
+        if (!ok) {
+            report << std::setw(8) << block_size << "  I/O failed" << std::endl;
+            continue;
+        }
+        report << std::fixed << std::setprecision(1)
+               << std::setw(8) << block_size
+               << std::setw(14) << file_mb * 1000.0 / write_ms
+               << std::setw(14) << file_mb * 1000.0 / read_ms
+               << std::setw(16) << RANDOM_READS * 1000.0 / random_ms
+               << std::setw(16) << SMALL_FILES * 1000.0 / small_ms << std::endl;
+    }
+    std::filesystem::remove(image);
+    return 0;
+}
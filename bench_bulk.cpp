@@ -0,0 +1,93 @@
+#include "src/myfs.h"
+#include <chrono>
+#include <filesystem>
+#include <iomanip>
+
+// 用法: bench_bulk [文件数] [批大小...]
+// 在同一个目录下创建大量文件 (默认 10000 个，超过直接块能放下的目录项数，目录要用到间接块)，
+// 比较逐个 create 与按批 create_many 写盘的次数和耗时；批大小为 1 时逐个调用 create
+// sync 挂载时每次调用都要落盘，写入次数的差别最明显；async 挂载时写回队列会吸收一部分重复写入
+
+// 计时，返回毫秒数
+template <typename F>
+double measure(F&& f) {
+    auto begin = std::chrono::steady_clock::now();
+    f();
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+}
+
+int main(int argc, char* argv[]){
+    uint64_t file_count = argc > 1 ? std::stoul(argv[1]) : 10000;
+    std::vector<uint64_t> batch_sizes;
+    for (int i = 2; i < argc; i++) {
+        batch_sizes.push_back(std::max(1ul, std::stoul(argv[i])));
+    }
+    if (batch_sizes.empty()) {
+        batch_sizes = {1, 100, 1000};
+    }
+    const std::string image = "bench_bulk.img";
+
+    // 文件系统的提示信息会刷屏，基准测试期间丢弃
+    std::ostream report(std::cout.rdbuf());
+    std::ofstream null_stream;
+    std::cout.rdbuf(null_stream.rdbuf());
+    std::cerr.rdbuf(null_stream.rdbuf());
+
+    std::vector<std::string> names(file_count);
+    for (uint64_t i = 0; i < file_count; i++) {
+        names[i] = "file" + std::to_string(i);
+    }
+
+    report << file_count << " files in one directory" << std::endl;
+    report << std::setw(6) << "mount" << std::setw(8) << "batch" << std::setw(11) << "ms"
+           << std::setw(12) << "blocks" << std::setw(12) << "inodes" << std::setw(12) << "superblock"
+           << std::setw(10) << "syncs" << std::setw(14) << "writes/file" << std::endl;
+    for (const char* mode : {"sync", "async"}) {
+        for (uint64_t batch : batch_sizes) {
+            MountOptions options;
+            parse_mount_options(mode, options);
+            MyFileSystem fs(image);
+            if (!fs.format(256 * 1024 * 1024, 10, DEFAULT_BLOCK_SIZE) || !fs.mount(options) || !fs.mkdir("/dir")) {
+                report << std::setw(6) << mode << std::setw(8) << batch << "  format failed" << std::endl;
+                continue;
+            }
+            fs.sync();
+            WritebackStats before = fs.get_writeback_stats();
+            bool ok = true;
+            double ms = measure([&] {
+                for (uint64_t first = 0; first < file_count && ok; first += batch) {
+                    uint64_t end = std::min(file_count, first + batch);
+                    if (batch == 1) {
+                        ok = fs.create("/dir/" + names[first]);
+                    } else {
+                        ok = fs.create_many("/dir", std::vector<std::string>(names.begin() + first, names.begin() + end));
+                    }
+                }
+                ok = fs.sync() && ok;
+            });
+            const WritebackStats& after = fs.get_writeback_stats();
+            // 写入次数按合并后的写盘次数计
+            uint64_t block_writes = after.block_writes - before.block_writes;
+            uint64_t inode_writes = after.inode_writes - before.inode_writes;
+            uint64_t superblocks = after.superblocks - before.superblocks;
+            uint64_t syncs = after.syncs - before.syncs;
+            // 计时之外核对目录内容
+            std::vector<DirEntryPlus> entries;
+            uint64_t cursor = 0;
+            ok = ok && fs.readdir_plus("/dir", entries, cursor) && entries.size() == file_count && fs.fsck(false) == 0;
+            fs.unmount();
+            std::filesystem::remove(image);
+
+            if (!ok) {
+                report << std::setw(6) << mode << std::setw(8) << batch << "  create failed" << std::endl;
+                continue;
+            }
+            report << std::fixed << std::setprecision(1)
+                   << std::setw(6) << mode << std::setw(8) << batch << std::setw(11) << ms
+                   << std::setw(12) << block_writes << std::setw(12) << inode_writes << std::setw(12) << superblocks
+                   << std::setw(10) << syncs << std::setw(14) << std::setprecision(2)
+                   << (double)(block_writes + inode_writes + superblocks) / file_count << std::endl;
+        }
+    }
+    return 0;
+}
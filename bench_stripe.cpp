@@ -0,0 +1,111 @@
+#include "src/myfs.h"
+#include <chrono>
+#include <filesystem>
+#include <iomanip>
+#include <random>
+
+// 用法: bench_stripe [-s 条带大小(KB)] [-f 文件大小(MB)] [目录...]
+// 分别用 1 到 N 个镜像文件格式化 (N 为给出的目录数，不给时在当前目录下放 4 个)，比较大块顺序读写的吞吐量
+// 每个镜像放在一个目录里，目录分别位于不同的磁盘上时才能看出设备数带来的提升；
+// 同一磁盘上读写的主要是页缓存，结果反映的是并行拷贝的效果
+
+// 计时，返回毫秒数
+template <typename F>
+double measure(F&& f) {
+    auto begin = std::chrono::steady_clock::now();
+    f();
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+}
+
+int main(int argc, char* argv[]){
+    uint64_t stripe_kb = 64;
+    uint64_t file_mb = 64;
+    std::vector<std::string> dirs;
+    for (int i = 1; i < argc; i++) {
+        std::string_view arg = argv[i];
+        if (arg == "-s" && i + 1 < argc) {
+            stripe_kb = std::stoul(argv[++i]);
+        } else if (arg == "-f" && i + 1 < argc) {
+            file_mb = std::stoul(argv[++i]);
+        } else {
+            dirs.emplace_back(arg);
+        }
+    }
+    if (dirs.empty()) {
+        dirs.assign(4, ".");
+    }
+    const unsigned int CHUNK = 4 * 1024 * 1024;
+    const unsigned int BLOCK_SIZE = 64 * 1024;
+    const unsigned int ROUNDS = 3;
+
+    // 文件系统的提示信息会刷屏，基准测试期间丢弃
+    std::ostream report(std::cout.rdbuf());
+    std::ofstream null_stream;
+    std::cout.rdbuf(null_stream.rdbuf());
+    std::cerr.rdbuf(null_stream.rdbuf());
+
+    std::vector<char> data(CHUNK);
+    std::mt19937 rng(42);
+    for (auto& c : data) c = static_cast<char>(rng());
+    std::vector<char> read_buffer(CHUNK);
+    uint64_t file_size = file_mb * 1024 * 1024;
+
+    report << "File " << file_mb << " MB, stripe " << stripe_kb << " KB, block " << BLOCK_SIZE << " bytes" << std::endl;
+    report << std::setw(8) << "devices" << std::setw(14) << "write MB/s" << std::setw(14) << "read MB/s" << std::endl;
+    for (size_t device_count = 1; device_count <= dirs.size(); device_count++) {
+        std::vector<std::string> images;
+        for (size_t i = 0; i < device_count; i++) {
+            images.push_back((std::filesystem::path(dirs[i]) / ("bench_stripe" + std::to_string(i) + ".img")).string());
+        }
+        DeviceLayout layout;
+        layout.members.assign(images.begin() + 1, images.end());
+        layout.stripe_size = stripe_kb * 1024;
+        MyFileSystem fs(images[0]);
+        if (!fs.format(file_size * 2 + 64 * 1024 * 1024, 1, BLOCK_SIZE, true, layout) || !fs.mount(MountOptions())) {
+            report << std::setw(8) << device_count << "  format failed" << std::endl;
+            continue;
+        }
+        fs.create("/big");
+        int fd = fs.open("/big");
+        fs.fallocate(fd, 0, file_size);
+        bool ok = fd != -1;
+
+        // 每轮写完都 sync，取最好的一轮
+        double write_ms = 0;
+        double read_ms = 0;
+        for (unsigned int round = 0; round < ROUNDS && ok; round++) {
+            double ms = measure([&] {
+                for (uint64_t offset = 0; offset < file_size && ok; offset += CHUNK) {
+                    ok = fs.write(fd, offset, CHUNK, data.data());
+                }
+                fs.sync();
+            });
+            write_ms = round == 0 ? ms : std::min(write_ms, ms);
+            ms = measure([&] {
+                for (uint64_t offset = 0; offset < file_size && ok; offset += CHUNK) {
+                    ok = fs.read(fd, offset, CHUNK, read_buffer.data());
+                }
+            });
+            read_ms = round == 0 ? ms : std::min(read_ms, ms);
+        }
+        // 计时之外核对读出的内容
+        for (uint64_t offset = 0; offset < file_size && ok; offset += CHUNK) {
+            ok = fs.read(fd, offset, CHUNK, read_buffer.data()) && read_buffer == data;
+        }
+        fs.close(fd);
+        fs.unmount();
+        for (const std::string& image : images) {
+            std::filesystem::remove(image);
+        }
+
+        if (!ok) {
+            report << std::setw(8) << device_count << "  I/O failed" << std::endl;
+            continue;
+        }
+        report << std::fixed << std::setprecision(1)
+               << std::setw(8) << device_count
+               << std::setw(14) << file_mb * 1000.0 / write_ms
+               << std::setw(14) << file_mb * 1000.0 / read_ms << std::endl;
+    }
+    return 0;
+}
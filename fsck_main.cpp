@@ -0,0 +1,41 @@
+#include "src/myfs.h"
+#include <charconv>
+
+// 用法: fsck [-y] [-j 线程数] [镜像文件]
+// 先直接检查超级块 (挂载会拒绝有问题的超级块)，-y 时修复或重建它，然后挂载检查其余部分
+int main(int argc, char* argv[]){
+    std::string image = "mydisk.img";
+    bool repair = false;
+    unsigned int thread_count = 0;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "-y") {
+            repair = true;
+        } else if (arg == "-j") {
+            std::string_view count = i + 1 < argc ? argv[++i] : "";
+            auto [end, error] = std::from_chars(count.data(), count.data() + count.size(), thread_count);
+            if (count.empty() || error != std::errc() || end != count.data() + count.size()) {
+                std::cerr << "Invalid thread count '" << count << "'." << std::endl;
+                std::cerr << "Usage: " << argv[0] << " [-y] [-j threads] [image]" << std::endl;
+                return 16;
+            }
+        } else {
+            image = arg;
+        }
+    }
+
+    MyFileSystem fs(image);
+    unsigned int errors = 0;
+    if (!fs.check_superblock(repair, errors)) {
+        return errors == 0 ? 8 : 4;
+    }
+    if (!fs.mount()) {
+        std::cerr << "Failed to mount file system." << std::endl;
+        return 8;
+    }
+    errors += fs.fsck(repair, thread_count);
+    fs.unmount();
+    // 与 e2fsck 的退出码保持一致：0 无错误，1 已修复，4 有未修复的错误，8 操作错误，16 用法错误
+    if (errors == 0) return 0;
+    return repair ? 1 : 4;
+}
@@ -1,4 +1,7 @@
 #include "src/myfs.h"
+#include <charconv>
+#include <filesystem>
+#include <unordered_map>
 #include <vector>
 
 // 全局日志文件对象
@@ -13,13 +16,240 @@ void init_logging(const std::string& log_file_path) {
         std::cerr << "Error: Unable to open log file: " << log_file_path << std::endl;
     }
 }
-int main(){
-    std::string request;
+
+// 命令行的运行状态
+struct Shell {
+    MyFileSystem& fs;
     std::string current_path = "/";
+    std::string paths[2];   // 补全后的绝对路径，每条命令都重复使用，避免反复分配
+    std::string_view line;  // 当前命令的原始文本
+    bool running = true;
+
+    explicit Shell(MyFileSystem& fs) : fs(fs) {}
+
+    // 相对路径补全为绝对路径，结果放在 paths[slot]
+    const std::string& path(std::string_view arg, int slot = 0) {
+        std::string& result = paths[slot];
+        if (arg[0] == '/') {
+            result.assign(arg);
+        } else {
+            result.assign(current_path);
+            result.append(arg);
+        }
+        return result;
+    }
+
+    // 从参数 arg 开始到行尾的原始文本 (保留其中的空格)
+    std::string_view rest(std::string_view arg) const {
+        return line.substr(arg.data() - line.data());
+    }
+};
+
+using Args = std::vector<std::string_view>;
+
+// 解析数字参数
+static bool parse_number(std::string_view text, uint64_t& value) {
+    auto [end, error] = std::from_chars(text.data(), text.data() + text.size(), value);
+    if (error != std::errc() || end != text.data() + text.size()) {
+        std::cerr << "Invalid number: " << text << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// 命令表项：参数个数范围 (不含命令名) 和处理函数
+struct Command {
+    size_t min_args;
+    size_t max_args;
+    void (*run)(Shell& shell, const Args& args);
+};
+const size_t ANY = static_cast<size_t>(-1);
+
+static const std::unordered_map<std::string_view, Command> COMMANDS = {
+    {"exit", {0, 0, [](Shell& shell, const Args&) { shell.running = false; }}},
+    // 写回缓存的访问时间并把缓冲的写入落盘
+    {"sync", {0, 0, [](Shell& shell, const Args&) { shell.fs.sync(); }}},
+    {"print_bitmap", {0, 0, [](Shell& shell, const Args&) { shell.fs.print_bitmap(); }}},
+    {"ls", {0, 1, [](Shell& shell, const Args& args) {
+        shell.fs.list(args.size() == 1 ? shell.current_path : shell.path(args[1]));
+    }}},
+    {"cd", {1, 1, [](Shell& shell, const Args& args) { shell.fs.change_dir(shell.current_path, args[1]); }}},
+    // 按指定的块大小重新格式化: format <块大小> [条带大小(KB) 成员镜像...]
+    // 指定成员镜像时数据块按条带分布到 mydisk.img 和各成员镜像上
+    {"format", {1, ANY, [](Shell& shell, const Args& args) {
+        uint64_t new_block_size;
+        uint64_t stripe_kb = 0;
+        DeviceLayout layout;
+        if (args.size() == 3) {
+            std::cerr << "No member images given." << std::endl;
+            return;
+        }
+        if (args.size() > 3) {
+            if (!parse_number(args[2], stripe_kb)) return;
+            layout.stripe_size = stripe_kb * 1024;
+            layout.members.assign(args.begin() + 3, args.end());
+        }
+        if (parse_number(args[1], new_block_size) &&
+            shell.fs.format(100 * 1024 * 1024, 10, new_block_size, true, layout) && shell.fs.mount()) {
+            shell.current_path = "/";
+        }
+    }}},
+    {"mkdir", {1, 1, [](Shell& shell, const Args& args) { shell.fs.mkdir(shell.path(args[1])); }}},
+    {"rmdir", {1, 1, [](Shell& shell, const Args& args) { shell.fs.rmdir(shell.path(args[1])); }}},
+    // create <路径> [内容]
+    {"create", {1, ANY, [](Shell& shell, const Args& args) {
+        const std::string& path = shell.path(args[1]);
+        shell.fs.create(path);
+        if (args.size() >= 3) {
+            int fd = shell.fs.open(path);
+            std::string_view text = shell.rest(args[2]);
+            if (fd != -1) {
+                shell.fs.write(fd, 0, text.size(), text.data());
+                shell.fs.close(fd);
+            }
+        }
+    }}},
+    {"remove", {1, 1, [](Shell& shell, const Args& args) { shell.fs.remove(shell.path(args[1])); }}},
+    {"open", {1, 1, [](Shell& shell, const Args& args) {
+        int fd = shell.fs.open(shell.path(args[1]));
+        if (fd != -1) {
+            shell.fs.close(fd);
+        }
+    }}},
+    {"read", {1, 1, [](Shell& shell, const Args& args) {
+        int fd = shell.fs.open(shell.path(args[1]));
+        if (fd != -1) {
+            char buffer[100] = {0};
+            shell.fs.read(fd, 0, 100, buffer);
+            shell.fs.close(fd);
+            std::cout << "[Info] Read from file " << shell.paths[0] << " : " << buffer << std::endl;
+        }
+    }}},
+    // write <路径> <占位> <内容>，内容从偏移 0 开始写入
+    {"write", {2, ANY, [](Shell& shell, const Args& args) {
+        int fd = shell.fs.open(shell.path(args[1]));
+        if (fd != -1) {
+            std::string_view text = args.size() >= 4 ? shell.rest(args[3]) : std::string_view();
+            shell.fs.write(fd, 0, text.size(), text.data());
+            shell.fs.close(fd);
+        }
+    }}},
+    {"truncate", {2, 2, [](Shell& shell, const Args& args) {
+        uint64_t size;
+        int fd = shell.fs.open(shell.path(args[1]));
+        if (fd != -1 && parse_number(args[2], size)) {
+            shell.fs.truncate(fd, size);
+        }
+        if (fd != -1) {
+            shell.fs.close(fd);
+        }
+    }}},
+    {"fallocate", {3, 3, [](Shell& shell, const Args& args) {
+        uint64_t offset, length;
+        int fd = shell.fs.open(shell.path(args[1]));
+        if (fd != -1 && parse_number(args[2], offset) && parse_number(args[3], length)) {
+            shell.fs.fallocate(fd, offset, length);
+        }
+        if (fd != -1) {
+            shell.fs.close(fd);
+        }
+    }}},
+    {"clone", {2, 2, [](Shell& shell, const Args& args) {
+        shell.fs.clone(shell.path(args[1], 0), shell.path(args[2], 1));
+    }}},
+    {"frag", {0, 1, [](Shell& shell, const Args& args) {
+        shell.fs.frag_report(args.size() == 1 ? std::string() : shell.path(args[1]));
+    }}},
+    {"defrag", {0, 1, [](Shell& shell, const Args& args) {
+        shell.fs.defrag(args.size() == 1 ? std::string() : shell.path(args[1]));
+    }}},
+    // 写回统计：批数、每批大小和合并比例
+    {"writeback", {0, 0, [](Shell& shell, const Args&) { shell.fs.writeback_report(); }}},
+    // 压缩统计：省下的空间、压缩和解压的耗时、簇缓存命中率
+    {"compression", {0, 0, [](Shell& shell, const Args&) { shell.fs.compression_report(); }}},
+    // 去重统计：重复的块、查找索引的开销和镜像中块的共享情况
+    {"dedup", {0, 0, [](Shell& shell, const Args&) { shell.fs.dedup_report(); }}},
+    // fsck [repair]
+    {"fsck", {0, 1, [](Shell& shell, const Args& args) {
+        if (args.size() == 2 && args[1] != "repair") {
+            std::cerr << "Invalid Command." << std::endl;
+            return;
+        }
+        shell.fs.fsck(args.size() == 2);
+    }}},
+    {"du", {1, 1, [](Shell& shell, const Args& args) { shell.fs.du(shell.path(args[1])); }}},
+    // find <目录> <模式>，模式不是路径，不补全
+    {"find", {2, 2, [](Shell& shell, const Args& args) {
+        shell.fs.find(shell.path(args[1]), std::string(args[2]));
+    }}},
+    // rm -r <路径>
+    {"rm", {2, 2, [](Shell& shell, const Args& args) {
+        if (args[1] != "-r") {
+            std::cerr << "Invalid Command." << std::endl;
+            return;
+        }
+        shell.fs.remove_tree(shell.path(args[2]));
+    }}},
+    // cp -r <源> <目标>
+    {"cp", {3, 3, [](Shell& shell, const Args& args) {
+        if (args[1] != "-r") {
+            std::cerr << "Invalid Command." << std::endl;
+            return;
+        }
+        shell.fs.copy_tree(shell.path(args[2], 0), shell.path(args[3], 1));
+    }}},
+    // import <主机目录> <镜像路径>，主机路径不补全
+    {"import", {2, 2, [](Shell& shell, const Args& args) {
+        shell.fs.import_tree(std::string(args[1]), shell.path(args[2]));
+    }}},
+    // export <镜像路径> <主机目录>
+    {"export", {2, 2, [](Shell& shell, const Args& args) {
+        shell.fs.export_tree(shell.path(args[1]), std::string(args[2]));
+    }}},
+    // 批量操作: create_many <目录> <文件名>...
+    {"create_many", {2, ANY, [](Shell& shell, const Args& args) {
+        shell.fs.create_many(shell.path(args[1]), std::vector<std::string>(args.begin() + 2, args.end()));
+    }}},
+    {"mkdir_many", {2, ANY, [](Shell& shell, const Args& args) {
+        shell.fs.mkdir_many(shell.path(args[1]), std::vector<std::string>(args.begin() + 2, args.end()));
+    }}},
+    {"remove_many", {2, ANY, [](Shell& shell, const Args& args) {
+        shell.fs.remove_many(shell.path(args[1]), std::vector<std::string>(args.begin() + 2, args.end()));
+    }}},
+};
+
+// 用法: main [-o 挂载选项] [-t 记录文件]，挂载选项如 noatime,async,direct,compress,dedup
+// 指定 -t 时把对文件系统的调用记录下来，之后可以用 replay 回放
+int main(int argc, char* argv[]){
+    std::string request;
+    std::string trace_path;
+    MountOptions options;
+    for (int i = 1; i < argc; i++) {
+        if (std::string_view(argv[i]) == "-o" && i + 1 < argc) {
+            if (!parse_mount_options(argv[++i], options)) {
+                return 1;
+            }
+        } else if (std::string_view(argv[i]) == "-t" && i + 1 < argc) {
+            trace_path = argv[++i];
+        } else {
+            std::cerr << "Usage: " << argv[0] << " [-o noatime|relatime|lazytime|strictatime,sync|async,direct|buffered,hugepages,compress,dedup] [-t trace]"
+                      << std::endl;
+            return 1;
+        }
+    }
     MyFileSystem fs("mydisk.img");
     //若文件系统不存在则格式化
     if (std::filesystem::exists("mydisk.img")){
-        if (!fs.mount()) {
+        // 旧格式的镜像先改名保留，再升级为新格式
+        if (MyFileSystem::image_version("mydisk.img") == 1) {
+            std::cout << "Upgrading file system to the current format..." << std::endl;
+            std::filesystem::rename("mydisk.img", "mydisk.img.v1");
+            if (!fs.upgrade("mydisk.img.v1")) {
+                std::cerr << "Failed to upgrade file system." << std::endl;
+                return 1;
+            }
+        }
+        if (!fs.mount(options)) {
             std::cerr << "Failed to mount file system." << std::endl;
             return 1;
         }
@@ -30,83 +260,36 @@ int main(){
             std::cerr << "Failed to format file system." << std::endl;
             return 1;
         }
-        if (!fs.mount()) {
+        if (!fs.mount(options)) {
             std::cerr << "Failed to mount file system." << std::endl;
             return 1;
         }
     }
-    while(true){
-        std::cout<<"PS "<<current_path<<"> ";
+
+    if (!trace_path.empty() && !fs.start_trace(trace_path)) {
+        return 1;
+    }
+
+    // 命令按名字查表分发，参数是指向 request 的 string_view，解析过程不复制字符串
+    Shell shell(fs);
+    Args args;
+    while (shell.running && std::cin) {
+        std::cout << "PS " << shell.current_path << "> ";
         std::getline(std::cin, request);
-        //大量if else if 绝赞发行中
-        //后面再改
-        std::vector<std::string> request_split = split(request, " ");
-        if (request_split.size() == 1){
-            if(request == "exit"){
-                break;
-            }else if (request == "print_bitmap"){
-                fs.print_bitmap();
-                continue;
-            }else if (request =="ls") {
-                fs.list(current_path);
-                continue;
-            }else {
-                std::cerr<<"Invalid Command."<<std::endl;
-            }
+        split(request, " ", args);
+        if (args.empty()) {
             continue;
-        }else if(request_split.size()>=2){
-            if (request_split[1][0] != '/' and request_split[0] != "cd"){
-                request_split[1] = current_path + request_split[1];
-            }
-            if(request_split[0] == "mkdir"){
-                fs.mkdir(request_split[1]);
-            }else if(request_split[0] == "rmdir"){
-                fs.rmdir(request_split[1]);
-            }else if(request_split[0] == "create"){
-                fs.create(request_split[1]);
-                if (request_split.size() >= 3){
-                    int fd = fs.open(request_split[1]);
-                    std::string buffer;
-                    for(int i = 2; i < request_split.size(); i++){
-                        buffer += request_split[i];
-                        if (i != request_split.size() - 1)
-                            buffer += " ";
-                    }
-                    if (fd != -1) {
-                        fs.write(fd, 0, buffer.size(), buffer.c_str());
-                    }
-                }
-            }else if(request_split[0] == "remove"){
-                fs.remove(request_split[1]);
-            }else if(request_split[0] == "open"){
-                fs.open(request_split[1]);
-            }else if (request_split[0] == "ls"){
-                    fs.list(request_split[1]);
-            }else if(request_split[0] == "read"){
-                int fd = fs.open(request_split[1]);
-                if (fd != -1) {
-                    char buffer[100] = {0};
-                    fs.read(fd, 0, 100, buffer);
-                    std::cout << "[Info] Read from file " <<request_split[1]<<" : "<< buffer << std::endl;
-                }
-            }else if(request_split[0] == "write"){
-                int fd = fs.open(request_split[1]);
-                if (fd != -1) {
-                    std::string buffer;
-                    for(int i = 3; i < request_split.size(); i++){
-                        buffer += request_split[i];
-                        if (i != request_split.size() - 1)
-                            buffer += " ";
-                    }
-                    fs.write(fd, 0, buffer.size(), buffer.c_str());
-                }
-            }else if(request_split[0] == "cd"){
-                fs.change_dir(current_path,request_split[1]);
-            }else {
-                std::cerr<<"Invalid Command."<<std::endl;
-            }
         }
+        auto it = COMMANDS.find(args[0]);
+        size_t arg_count = args.size() - 1;
+        if (it == COMMANDS.end() || arg_count < it->second.min_args ||
+            (it->second.max_args != ANY && arg_count > it->second.max_args)) {
+            std::cerr << "Invalid Command." << std::endl;
+            continue;
+        }
+        shell.line = request;
+        it->second.run(shell, args);
     }
     fs.mount();
     return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,346 @@
+#include "src/myfs.h"
+#include <chrono>
+#include <condition_variable>
+#include <filesystem>
+#include <iomanip>
+#include <thread>
+
+// 用法: replay [-i 镜像快照] [-o 挂载选项] [-j 线程数] [--timed] 记录文件
+// 回放 main -t 记录的调用，输出每种操作的延迟分布，用于在真实负载下比较不同版本
+// 不指定 -i 时按记录中的镜像大小和块大小格式化一个新镜像，否则在快照的副本上回放 (快照本身不变)
+// 默认尽快回放，--timed 按记录中的时间间隔发出调用
+// -j 大于 1 时按句柄把读写分给多个线程，不同文件的读写并发提交 (文件系统内部串行执行，延迟中包含排队时间)，
+// 其余操作作为屏障，等各线程做完手头的请求后再执行
+// import_tree 从记录中的主机目录导入 (记录中没有文件内容，目录不存在时计为失败)；
+// export_tree 不写记录中的主机目录，而是导出到临时目录 replay_export，回放结束后删除
+
+using Clock = std::chrono::steady_clock;
+
+// 回放时使用的镜像
+const char* const REPLAY_IMAGE = "replay.img";
+// 回放 export_tree 时导出到这里
+const char* const REPLAY_EXPORT_DIR = "replay_export";
+// 记录中没有镜像大小时使用的默认值
+const uint64_t DEFAULT_REPLAY_DISK_SIZE = 100 * 1024 * 1024;
+
+// 一种操作的统计
+struct OpStats {
+    std::vector<double> latencies;  // 回放时的延迟 (微秒)
+    std::vector<double> recorded;   // 记录时的耗时 (微秒)
+    uint64_t failed = 0;
+};
+
+// 交给读写线程的请求
+struct PendingOp {
+    TraceRecord record;
+    Clock::time_point issued;
+};
+
+// 一个读写线程及其请求队列
+struct Lane {
+    std::mutex mutex;
+    std::condition_variable ready;
+    std::deque<PendingOp> queue;
+    bool stopping = false;
+    std::thread thread;
+};
+
+class Replayer {
+public:
+    Replayer(MyFileSystem& fs, unsigned int thread_count) : fs(fs), stats(TRACE_OP_COUNT) {
+        for (unsigned int i = 0; thread_count > 1 && i < thread_count; i++) {
+            lanes.push_back(std::make_unique<Lane>());
+            Lane* lane = lanes.back().get();
+            lane->thread = std::thread([this, lane] { lane_loop(*lane); });
+        }
+    }
+
+    ~Replayer() {
+        for (auto& lane : lanes) {
+            {
+                std::lock_guard<std::mutex> lock(lane->mutex);
+                lane->stopping = true;
+            }
+            lane->ready.notify_one();
+            lane->thread.join();
+        }
+    }
+
+    // 提交一条记录，读写交给对应的线程，其他操作等所有线程空闲后直接执行
+    void submit(const TraceRecord& record, Clock::time_point issued) {
+        if (lanes.empty() || !is_file_op(record.op)) {
+            drain();
+            run(record, issued, buffer);
+            return;
+        }
+        Lane& lane = *lanes[(uint64_t)record.fd % lanes.size()];
+        {
+            std::lock_guard<std::mutex> lock(pending_mutex);
+            pending++;
+        }
+        {
+            std::lock_guard<std::mutex> lock(lane.mutex);
+            lane.queue.push_back({record, issued});
+        }
+        lane.ready.notify_one();
+    }
+
+    // 等待所有线程做完已提交的请求
+    void drain() {
+        std::unique_lock<std::mutex> lock(pending_mutex);
+        all_idle.wait(lock, [&] { return pending == 0; });
+    }
+
+    std::vector<OpStats>& results() { return stats; }
+
+private:
+    // 只涉及一个句柄的操作，可以交给读写线程
+    static bool is_file_op(TraceOp op) {
+        switch (op) {
+        case TRACE_CLOSE: case TRACE_READ: case TRACE_READ_AT: case TRACE_WRITE: case TRACE_WRITE_AT:
+        case TRACE_SEEK: case TRACE_TRUNCATE: case TRACE_FALLOCATE:
+            return true;
+        default:
+            return false;
+        }
+    }
+
+    void lane_loop(Lane& lane) {
+        std::vector<char> lane_buffer;
+        while (true) {
+            PendingOp op;
+            {
+                std::unique_lock<std::mutex> lock(lane.mutex);
+                lane.ready.wait(lock, [&] { return lane.stopping || !lane.queue.empty(); });
+                if (lane.queue.empty()) return;
+                op = std::move(lane.queue.front());
+                lane.queue.pop_front();
+            }
+            run(op.record, op.issued, lane_buffer);
+            std::lock_guard<std::mutex> lock(pending_mutex);
+            if (--pending == 0) all_idle.notify_all();
+        }
+    }
+
+    // 执行并统计一条记录，延迟从提交时算起
+    void run(const TraceRecord& record, Clock::time_point issued, std::vector<char>& data) {
+        bool ok;
+        {
+            std::lock_guard<std::mutex> lock(fs_mutex);
+            ok = execute(record, data);
+        }
+        double latency = std::chrono::duration<double, std::micro>(Clock::now() - issued).count();
+        std::lock_guard<std::mutex> lock(stats_mutex);
+        OpStats& op_stats = stats[record.op];
+        op_stats.latencies.push_back(latency);
+        op_stats.recorded.push_back(record.duration / 1000.0);
+        if (!ok) op_stats.failed++;
+    }
+
+    // 记录中的句柄换成回放时的句柄
+    int handle(int64_t recorded_fd) {
+        auto it = fds.find(recorded_fd);
+        return it == fds.end() ? -1 : it->second;
+    }
+
+    static std::vector<std::string> split_names(const std::string& joined) {
+        std::vector<std::string> names;
+        size_t begin = 0;
+        while (!joined.empty() && begin <= joined.size()) {
+            size_t end = joined.find('\n', begin);
+            if (end == std::string::npos) end = joined.size();
+            names.push_back(joined.substr(begin, end - begin));
+            begin = end + 1;
+        }
+        return names;
+    }
+
+    bool execute(const TraceRecord& r, std::vector<char>& data) {
+        if (data.size() < r.arg2 && (r.op == TRACE_READ || r.op == TRACE_READ_AT ||
+                                     r.op == TRACE_WRITE || r.op == TRACE_WRITE_AT)) {
+            data.resize(r.arg2, 'r');
+        }
+        unsigned int length = static_cast<unsigned int>(r.arg2);
+        unsigned int bytes_read;
+        switch (r.op) {
+        case TRACE_MKDIR: return fs.mkdir(r.path);
+        case TRACE_RMDIR: return fs.rmdir(r.path);
+        case TRACE_CREATE: return fs.create(r.path);
+        case TRACE_REMOVE: return fs.remove(r.path);
+        case TRACE_OPEN: {
+            // 打开在屏障处执行，此时读写线程都空闲，可以直接修改句柄映射
+            int fd = fs.open(r.path);
+            if (fd != -1 && r.fd != -1) fds[r.fd] = fd;
+            return fd != -1;
+        }
+        case TRACE_CLOSE: return fs.close(handle(r.fd));
+        case TRACE_READ: return fs.read(handle(r.fd), r.arg1, length, data.data());
+        case TRACE_READ_AT: return fs.read(handle(r.fd), length, data.data(), bytes_read);
+        case TRACE_WRITE: return fs.write(handle(r.fd), r.arg1, length, data.data());
+        case TRACE_WRITE_AT: return fs.write(handle(r.fd), length, data.data());
+        case TRACE_SEEK: return fs.seek(handle(r.fd), r.arg1);
+        case TRACE_TRUNCATE: return fs.truncate(handle(r.fd), r.arg1);
+        case TRACE_FALLOCATE: return fs.fallocate(handle(r.fd), r.arg1, r.arg2);
+        case TRACE_LIST: return fs.list(r.path);
+        case TRACE_CLONE: return fs.clone(r.path, r.path2);
+        case TRACE_SYNC: return fs.sync();
+        case TRACE_DU: return fs.du(r.path);
+        case TRACE_FIND: return fs.find(r.path, r.path2);
+        case TRACE_REMOVE_TREE: return fs.remove_tree(r.path);
+        case TRACE_COPY_TREE: return fs.copy_tree(r.path, r.path2);
+        case TRACE_CREATE_MANY: return fs.create_many(r.path, split_names(r.path2));
+        case TRACE_MKDIR_MANY: return fs.mkdir_many(r.path, split_names(r.path2));
+        case TRACE_REMOVE_MANY: return fs.remove_many(r.path, split_names(r.path2));
+        case TRACE_DEFRAG: return fs.defrag(r.path);
+        case TRACE_READDIR_PLUS: {
+            std::vector<DirEntryPlus> entries;
+            uint64_t cursor = r.arg1;
+            return fs.readdir_plus(r.path, entries, cursor, r.arg2);
+        }
+        case TRACE_CHANGE_DIR: {
+            std::string cur = r.path;
+            return fs.change_dir(cur, r.path2);
+        }
+        case TRACE_FRAG_REPORT: return fs.frag_report(r.path);
+        case TRACE_FSCK: return fs.fsck(r.arg1 != 0, static_cast<unsigned int>(r.arg2)) == 0;
+        case TRACE_IMPORT_TREE: return fs.import_tree(r.path, r.path2, static_cast<unsigned int>(r.arg1));
+        case TRACE_EXPORT_TREE: {
+            std::error_code error;
+            std::filesystem::remove_all(REPLAY_EXPORT_DIR, error);
+            return fs.export_tree(r.path, REPLAY_EXPORT_DIR, static_cast<unsigned int>(r.arg1));
+        }
+        default: return false;
+        }
+    }
+
+    MyFileSystem& fs;
+    std::mutex fs_mutex;                      // 文件系统不能并发调用
+    std::unordered_map<int64_t, int> fds;     // 记录中的句柄 -> 回放时的句柄
+    std::vector<char> buffer;                 // 主线程的读写缓冲区
+    std::vector<std::unique_ptr<Lane>> lanes;
+    std::mutex pending_mutex;
+    std::condition_variable all_idle;
+    uint64_t pending = 0;                     // 交给读写线程还没做完的请求数
+    std::mutex stats_mutex;
+    std::vector<OpStats> stats;
+};
+
+// 已排序数组的百分位数
+static double percentile(const std::vector<double>& sorted, double p) {
+    if (sorted.empty()) return 0;
+    size_t index = std::min(sorted.size() - 1, (size_t)(p / 100 * sorted.size()));
+    return sorted[index];
+}
+
+int main(int argc, char* argv[]){
+    std::string trace_path;
+    std::string snapshot;
+    MountOptions options;
+    unsigned int thread_count = 1;
+    bool timed = false;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "-i" && i + 1 < argc) {
+            snapshot = argv[++i];
+        } else if (arg == "-o" && i + 1 < argc) {
+            if (!parse_mount_options(argv[++i], options)) return 1;
+        } else if (arg == "-j" && i + 1 < argc) {
+            thread_count = std::max(1ul, std::stoul(argv[++i]));
+        } else if (arg == "--timed") {
+            timed = true;
+        } else if (trace_path.empty() && arg[0] != '-') {
+            trace_path = arg;
+        } else {
+            trace_path.clear();
+            break;
+        }
+    }
+    if (trace_path.empty()) {
+        std::cerr << "Usage: " << argv[0] << " [-i snapshot.img] [-o mount options] [-j threads] [--timed] trace" << std::endl;
+        return 1;
+    }
+
+    TraceReader reader;
+    if (!reader.open(trace_path)) {
+        return 1;
+    }
+
+    // 文件系统的提示信息会刷屏，回放期间丢弃
+    std::ostream report(std::cout.rdbuf());
+    std::ostream errors(std::cerr.rdbuf());
+    std::ofstream null_stream;
+    std::cout.rdbuf(null_stream.rdbuf());
+    std::cerr.rdbuf(null_stream.rdbuf());
+
+    MyFileSystem fs(REPLAY_IMAGE);
+    if (!snapshot.empty()) {
+        std::error_code error;
+        std::filesystem::copy_file(snapshot, REPLAY_IMAGE, std::filesystem::copy_options::overwrite_existing, error);
+        if (error) {
+            errors << "Unable to copy " << snapshot << ": " << error.message() << std::endl;
+            return 1;
+        }
+    } else {
+        const TraceHeader& header = reader.header();
+        uint64_t disk_size = header.total_size != 0 ? header.total_size : DEFAULT_REPLAY_DISK_SIZE;
+        unsigned int block_size = is_supported_block_size(header.block_size) ? header.block_size : DEFAULT_BLOCK_SIZE;
+        if (!fs.format(disk_size, 10, block_size)) {
+            errors << "Failed to format " << REPLAY_IMAGE << "." << std::endl;
+            return 1;
+        }
+    }
+    if (!fs.mount(options)) {
+        errors << "Failed to mount " << REPLAY_IMAGE << "." << std::endl;
+        return 1;
+    }
+
+    uint64_t op_count = 0;
+    uint64_t trace_end = 0;
+    auto begin_time = Clock::now();
+    {
+        Replayer replayer(fs, thread_count);
+        TraceRecord record;
+        while (reader.next(record)) {
+            if (timed) {
+                std::this_thread::sleep_until(begin_time + std::chrono::nanoseconds(record.start));
+            }
+            replayer.submit(record, Clock::now());
+            op_count++;
+            trace_end = std::max(trace_end, record.start + record.duration);
+        }
+        replayer.drain();
+        fs.sync();
+        double seconds = std::chrono::duration<double>(Clock::now() - begin_time).count();
+
+        report << "Replayed " << op_count << " ops in " << std::fixed << std::setprecision(3) << seconds
+               << " s (recorded " << trace_end / 1e9 << " s), " << std::setprecision(0)
+               << op_count / std::max(seconds, 1e-9) << " ops/s, " << thread_count << " thread(s)"
+               << (timed ? ", timed" : "") << std::endl;
+        report << "Latency in microseconds (trace columns are the recorded durations)" << std::endl;
+        report << std::left << std::setw(12) << "op" << std::right << std::setw(9) << "count" << std::setw(8) << "failed"
+               << std::setw(10) << "mean" << std::setw(10) << "p50" << std::setw(10) << "p90" << std::setw(10) << "p99"
+               << std::setw(11) << "max" << std::setw(12) << "trace p50" << std::setw(12) << "trace p99" << std::endl;
+        report << std::setprecision(1);
+        for (int op = 0; op < TRACE_OP_COUNT; op++) {
+            OpStats& op_stats = replayer.results()[op];
+            if (op_stats.latencies.empty()) continue;
+            std::sort(op_stats.latencies.begin(), op_stats.latencies.end());
+            std::sort(op_stats.recorded.begin(), op_stats.recorded.end());
+            double total = 0;
+            for (double latency : op_stats.latencies) total += latency;
+            report << std::left << std::setw(12) << trace_op_name(static_cast<TraceOp>(op)) << std::right
+                   << std::setw(9) << op_stats.latencies.size() << std::setw(8) << op_stats.failed
+                   << std::setw(10) << total / op_stats.latencies.size()
+                   << std::setw(10) << percentile(op_stats.latencies, 50)
+                   << std::setw(10) << percentile(op_stats.latencies, 90)
+                   << std::setw(10) << percentile(op_stats.latencies, 99)
+                   << std::setw(11) << op_stats.latencies.back()
+                   << std::setw(12) << percentile(op_stats.recorded, 50)
+                   << std::setw(12) << percentile(op_stats.recorded, 99) << std::endl;
+        }
+    }
+    fs.unmount();
+    std::error_code error;
+    std::filesystem::remove_all(REPLAY_EXPORT_DIR, error);
+    return 0;
+}
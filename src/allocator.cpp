@@ -0,0 +1,121 @@
+#include "allocator.h"
+
+void ExtentAllocator::reset() {
+    by_start.clear();
+    by_length.clear();
+    free_count = 0;
+}
+
+void ExtentAllocator::insert_extent(uint64_t start, uint64_t length) {
+    by_start[start] = length;
+    by_length.insert({length, start});
+    free_count += length;
+}
+
+void ExtentAllocator::erase_extent(std::map<uint64_t, uint64_t>::iterator it) {
+    by_length.erase({it->second, it->first});
+    free_count -= it->second;
+    by_start.erase(it);
+}
+
+void ExtentAllocator::carve(std::map<uint64_t, uint64_t>::iterator it, uint64_t start, uint64_t count) {
+    uint64_t extent_start = it->first;
+    uint64_t extent_end = it->first + it->second;
+    erase_extent(it);
+    if (start > extent_start) {
+        insert_extent(extent_start, start - extent_start);
+    }
+    if (start + count < extent_end) {
+        insert_extent(start + count, extent_end - start - count);
+    }
+}
+
+void ExtentAllocator::add_free(uint64_t start, uint64_t length) {
+    if (length == 0) return;
+    // 与前一个区间相邻则合并
+    auto next = by_start.lower_bound(start);
+    if (next != by_start.begin()) {
+        auto prev = std::prev(next);
+        if (prev->first + prev->second == start) {
+            start = prev->first;
+            length += prev->second;
+            erase_extent(prev);
+        }
+    }
+    // 与后一个区间相邻则合并
+    next = by_start.lower_bound(start);
+    if (next != by_start.end() && start + length == next->first) {
+        length += next->second;
+        erase_extent(next);
+    }
+    insert_extent(start, length);
+}
+
+bool ExtentAllocator::allocate(uint64_t count, uint64_t hint, uint64_t& start) {
+    if (count == 0 || count > free_count) return false;
+
+    // 优先尝试紧接在 hint 之后分配，使文件的块尽量连续
+    if (hint != 0) {
+        auto it = by_start.upper_bound(hint);
+        if (it != by_start.begin()) {
+            --it;
+            if (it->first <= hint && hint + count <= it->first + it->second) {
+                carve(it, hint, count);
+                start = hint;
+                return true;
+            }
+        }
+    }
+
+    // 最佳适配：选择能容纳 count 个块的最小区间
+    auto fit = by_length.lower_bound({count, 0});
+    if (fit == by_length.end()) return false;
+    start = fit->second;
+    carve(by_start.find(start), start, count);
+    return true;
+}
+
+uint64_t ExtentAllocator::allocate_partial(uint64_t count, uint64_t hint, uint64_t& start) {
+    if (count == 0 || by_length.empty()) return 0;
+    if (allocate(count, hint, start)) return count;
+
+    // 没有足够大的区间，取当前最大的区间
+    auto largest = std::prev(by_length.end());
+    uint64_t length = largest->first;
+    start = largest->second;
+    carve(by_start.find(start), start, length);
+    return length;
+}
+
+bool ExtentAllocator::release(uint64_t start, uint64_t length) {
+    if (length == 0) return true;
+    auto next = by_start.lower_bound(start);
+    if (next != by_start.end() && next->first < start + length) return false;
+    if (next != by_start.begin()) {
+        auto prev = std::prev(next);
+        if (prev->first + prev->second > start) return false;
+    }
+    add_free(start, length);
+    return true;
+}
+
+bool ExtentAllocator::reserve(uint64_t start, uint64_t length) {
+    if (length == 0) return true;
+    auto it = by_start.upper_bound(start);
+    if (it == by_start.begin()) return false;
+    --it;
+    if (it->first > start || start + length > it->first + it->second) return false;
+    carve(it, start, length);
+    return true;
+}
+
+bool ExtentAllocator::is_free(uint64_t block_number) const {
+    auto it = by_start.upper_bound(block_number);
+    if (it == by_start.begin()) return false;
+    --it;
+    return block_number < it->first + it->second;
+}
+
+uint64_t ExtentAllocator::largest_extent() const {
+    return by_length.empty() ? 0 : by_length.rbegin()->first;
+}
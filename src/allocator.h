@@ -0,0 +1,49 @@
+#ifndef ALLOCATOR_H
+#define ALLOCATOR_H
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <set>
+#include <utility>
+
+// 空闲区间分配器
+// 挂载时由位图构建，按起始块号和长度两个维度索引空闲区间，
+// 可以一次性返回 N 个连续的数据块，释放时自动与相邻区间合并
+class ExtentAllocator {
+public:
+    // 清空所有空闲区间
+    void reset();
+
+    // 登记一段空闲区间 (构建时使用，会与相邻区间合并)
+    void add_free(uint64_t start, uint64_t length);
+
+    // 分配 count 个连续块，优先从 hint 处开始，否则选择能容纳的最小区间
+    bool allocate(uint64_t count, uint64_t hint, uint64_t& start);
+
+    // 分配不超过 count 个连续块 (空间不足以连续分配时使用)，返回实际分配的块数
+    uint64_t allocate_partial(uint64_t count, uint64_t hint, uint64_t& start);
+
+    // 归还一段区间，若与已有空闲区间重叠则拒绝
+    bool release(uint64_t start, uint64_t length);
+
+    // 将指定区间从空闲集合中摘除，区间必须完全空闲
+    bool reserve(uint64_t start, uint64_t length);
+
+    // 判断某个块是否空闲
+    bool is_free(uint64_t block_number) const;
+
+    uint64_t free_blocks() const { return free_count; }
+    uint64_t largest_extent() const;
+    size_t extent_count() const { return by_start.size(); }
+
+private:
+    void insert_extent(uint64_t start, uint64_t length);
+    void erase_extent(std::map<uint64_t, uint64_t>::iterator it);
+    // 从区间 it 中切出 [start, start + count)
+    void carve(std::map<uint64_t, uint64_t>::iterator it, uint64_t start, uint64_t count);
+
+    std::map<uint64_t, uint64_t> by_start;              // 起始块号 -> 长度
+    std::set<std::pair<uint64_t, uint64_t>> by_length;  // (长度, 起始块号)
+    uint64_t free_count = 0;
+};
+#endif // ALLOCATOR_H
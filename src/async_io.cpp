@@ -0,0 +1,158 @@
+#include "async_io.h"
+#include "myfs.h"
+#include "reclaim.h"
+#include "thread_pool.h"
+
+// 异步读写使用的工作线程数，所有请求共用一个磁盘文件，线程多了只会争用锁
+const unsigned int ASYNC_IO_THREADS = 2;
+
+AsyncQueue::AsyncQueue(unsigned int thread_count) {
+    for (unsigned int i = 0; i < thread_count; i++) {
+        workers.emplace_back(&AsyncQueue::worker_loop, this);
+    }
+}
+
+AsyncQueue::~AsyncQueue() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    request_ready.notify_all();
+    for (auto& worker : workers) {
+        worker.join();
+    }
+}
+
+std::future<bool> AsyncQueue::submit(int key, std::function<bool()> operation) {
+    Request request;
+    request.operation = std::move(operation);
+    std::future<bool> result = request.promise.get_future();
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto& queue = queues[key];
+        // 队列为空说明这个 key 没有正在执行的请求，可以直接排队执行
+        bool idle = queue.empty();
+        queue.push_back(std::move(request));
+        pending++;
+        if (!idle) {
+            return result;
+        }
+        ready.push_back(key);
+    }
+    request_ready.notify_one();
+    return result;
+}
+
+void AsyncQueue::wait() {
+    std::unique_lock<std::mutex> lock(mutex);
+    all_done.wait(lock, [this] { return pending == 0; });
+}
+
+void AsyncQueue::worker_loop() {
+    while (true) {
+        int key;
+        std::function<bool()> operation;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            request_ready.wait(lock, [this] { return stopping || !ready.empty(); });
+            if (ready.empty()) {
+                return;
+            }
+            key = ready.front();
+            ready.pop_front();
+            operation = std::move(queues[key].front().operation);
+        }
+
+        bool ok = false;
+        std::exception_ptr error;
+        try {
+            ok = operation();
+        } catch (...) {
+            error = std::current_exception();
+        }
+
+        std::promise<bool> promise;
+        bool notify_next = false;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            auto& queue = queues[key];
+            promise = std::move(queue.front().promise);
+            queue.pop_front();
+            // 同一个 key 的下一个请求排到末尾，让其他 inode 的请求也有机会执行
+            if (queue.empty()) {
+                queues.erase(key);
+            } else {
+                ready.push_back(key);
+                notify_next = true;
+            }
+        }
+        if (notify_next) {
+            request_ready.notify_one();
+        }
+        if (error) {
+            promise.set_exception(error);
+        } else {
+            promise.set_value(ok);
+        }
+
+        // 先交付结果再减少计数，wait() 返回时所有 future 都已就绪
+        std::lock_guard<std::mutex> lock(mutex);
+        if (--pending == 0) {
+            all_done.notify_all();
+        }
+    }
+}
+
+MyFileSystem::MyFileSystem(const std::string& disk_path) : disk_file_path(disk_path) {
+    buffer_pool.init(BUFFER_POOL_SLOTS, false);
+}
+
+MyFileSystem::~MyFileSystem() {
+    stop_reclaim();
+    sync();
+    stop_trace();
+}
+
+// 取得异步请求队列，第一次使用时创建
+AsyncQueue& MyFileSystem::async_queue() {
+    if (!async_io) {
+        async_io = std::make_unique<AsyncQueue>(ASYNC_IO_THREADS);
+    }
+    return *async_io;
+}
+
+// 异步读取
+std::future<bool> MyFileSystem::read_async(int fd, uint64_t offset, unsigned int length, char* buffer) {
+    FileHandle* handle = file_handle(fd);
+    if (!handle) {
+        std::promise<bool> failed;
+        failed.set_value(false);
+        return failed.get_future();
+    }
+    // 按 inode 排队，同一文件通过不同句柄提交的请求也按顺序执行
+    return async_queue().submit(handle->inode_number, [this, fd, offset, length, buffer] {
+        std::lock_guard<std::mutex> lock(io_mutex);
+        return read(fd, offset, length, buffer);
+    });
+}
+
+// 异步写入
+std::future<bool> MyFileSystem::write_async(int fd, uint64_t offset, unsigned int length, const char* buffer) {
+    FileHandle* handle = file_handle(fd);
+    if (!handle) {
+        std::promise<bool> failed;
+        failed.set_value(false);
+        return failed.get_future();
+    }
+    return async_queue().submit(handle->inode_number, [this, fd, offset, length, buffer] {
+        std::lock_guard<std::mutex> lock(io_mutex);
+        return write(fd, offset, length, buffer);
+    });
+}
+
+// 等待所有异步请求完成
+void MyFileSystem::wait_async() {
+    if (async_io) {
+        async_io->wait();
+    }
+}
@@ -0,0 +1,48 @@
+#ifndef ASYNC_IO_H
+#define ASYNC_IO_H
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// 异步 I/O 请求队列
+// 同一个 key (inode 编号) 的请求按提交顺序逐个执行，不同 key 的请求轮流交给工作线程，
+// 提交者拿到 future 后即可返回，继续做自己的计算
+class AsyncQueue {
+public:
+    explicit AsyncQueue(unsigned int thread_count);
+    // 执行完所有已提交的请求后退出
+    ~AsyncQueue();
+
+    AsyncQueue(const AsyncQueue&) = delete;
+    AsyncQueue& operator=(const AsyncQueue&) = delete;
+
+    // 提交一个请求，返回其执行结果
+    std::future<bool> submit(int key, std::function<bool()> operation);
+
+    // 等待所有已提交的请求完成
+    void wait();
+
+private:
+    struct Request {
+        std::function<bool()> operation;
+        std::promise<bool> promise;
+    };
+
+    void worker_loop();
+
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable request_ready;
+    std::condition_variable all_done;
+    // 每个 key 的请求队列，正在执行的请求仍留在队首，保证同一 key 不会并发执行
+    std::unordered_map<int, std::deque<Request>> queues;
+    std::deque<int> ready;      // 队首请求可以开始执行的 key
+    unsigned int pending = 0;   // 已提交但还未完成的请求数
+    bool stopping = false;
+};
+#endif // ASYNC_IO_H
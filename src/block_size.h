@@ -0,0 +1,41 @@
+#ifndef BLOCK_SIZE_H
+#define BLOCK_SIZE_H
+#include <bit>
+#include <cstdint>
+
+// 格式化时可选的块大小 (必须是 2 的幂)
+const unsigned int MIN_BLOCK_SIZE = 1024;
+const unsigned int MAX_BLOCK_SIZE = 65536;
+const unsigned int DEFAULT_BLOCK_SIZE = 4096;
+
+// 某一块大小下的编译期常量，块号与偏移量的换算可以化为移位和掩码
+template <unsigned int Size>
+struct BlockGeometry {
+    static_assert(Size >= MIN_BLOCK_SIZE && Size <= MAX_BLOCK_SIZE && std::has_single_bit(Size),
+                  "unsupported block size");
+    static constexpr unsigned int SIZE = Size;
+    static constexpr unsigned int SHIFT = std::countr_zero(Size);
+    static constexpr unsigned int MASK = Size - 1;
+    static constexpr unsigned int POINTERS = Size / sizeof(uint64_t);  // 一个间接块可容纳的块指针数量
+    static constexpr uint64_t BITMAP_BITS = (uint64_t)Size * 8;        // 一个位图块覆盖的数据块数量
+};
+
+// 判断块大小是否受支持
+inline bool is_supported_block_size(unsigned int size) {
+    return size >= MIN_BLOCK_SIZE && size <= MAX_BLOCK_SIZE && std::has_single_bit(size);
+}
+
+// 按运行时的块大小调用 f(BlockGeometry<Size>())，使内层循环使用编译期常量
+template <typename F>
+decltype(auto) dispatch_block_size(unsigned int block_size, F&& f) {
+    switch (block_size) {
+        case 1024: return f(BlockGeometry<1024>());
+        case 2048: return f(BlockGeometry<2048>());
+        case 8192: return f(BlockGeometry<8192>());
+        case 16384: return f(BlockGeometry<16384>());
+        case 32768: return f(BlockGeometry<32768>());
+        case 65536: return f(BlockGeometry<65536>());
+        default: return f(BlockGeometry<DEFAULT_BLOCK_SIZE>());
+    }
+}
+#endif // BLOCK_SIZE_H
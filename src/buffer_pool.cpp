@@ -0,0 +1,91 @@
+#include "buffer_pool.h"
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/mman.h>
+#endif
+
+// 大页的大小，使用大页时池的总大小按它向上取整
+const size_t HUGE_PAGE_SIZE = 2 * 1024 * 1024;
+
+BufferPool::~BufferPool() {
+    free_arena();
+}
+
+void BufferPool::init(size_t slot_count, bool huge) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (arena != nullptr && free_slots.size() == slot_count && want_huge_pages == huge) {
+        return;
+    }
+    free_arena();
+    want_huge_pages = huge;
+    arena_size = slot_count * BUFFER_POOL_SLOT_SIZE;
+#if defined(__unix__) || defined(__APPLE__)
+#ifdef MAP_HUGETLB
+    if (huge) {
+        // 需要系统预留了大页 (vm.nr_hugepages)，否则失败
+        size_t size = (arena_size + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE;
+        void* memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (memory != MAP_FAILED) {
+            arena = static_cast<char*>(memory);
+            arena_size = size;
+            mapped = true;
+            huge_pages = true;
+        }
+    }
+#endif
+    if (arena == nullptr) {
+        void* memory = mmap(nullptr, arena_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (memory != MAP_FAILED) {
+            arena = static_cast<char*>(memory);
+            mapped = true;
+#ifdef MADV_HUGEPAGE
+            // 没有预留大页时请求透明大页
+            if (huge) madvise(memory, arena_size, MADV_HUGEPAGE);
+#endif
+        }
+    }
+#endif
+    if (arena == nullptr) {
+        arena = static_cast<char*>(::operator new(arena_size, std::align_val_t(DIRECT_IO_ALIGNMENT)));
+    }
+    for (size_t i = slot_count; i > 0; i--) {
+        free_slots.push_back(arena + (i - 1) * BUFFER_POOL_SLOT_SIZE);
+    }
+}
+
+char* BufferPool::acquire() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!free_slots.empty()) {
+            char* buffer = free_slots.back();
+            free_slots.pop_back();
+            return buffer;
+        }
+    }
+    return static_cast<char*>(::operator new(BUFFER_POOL_SLOT_SIZE, std::align_val_t(DIRECT_IO_ALIGNMENT)));
+}
+
+void BufferPool::release(char* buffer) {
+    if (buffer >= arena && buffer < arena + arena_size) {
+        std::lock_guard<std::mutex> lock(mutex);
+        free_slots.push_back(buffer);
+    } else {
+        ::operator delete(buffer, std::align_val_t(DIRECT_IO_ALIGNMENT));
+    }
+}
+
+void BufferPool::free_arena() {
+    if (arena == nullptr) return;
+#if defined(__unix__) || defined(__APPLE__)
+    if (mapped) {
+        munmap(arena, arena_size);
+    } else
+#endif
+    {
+        ::operator delete(arena, std::align_val_t(DIRECT_IO_ALIGNMENT));
+    }
+    arena = nullptr;
+    arena_size = 0;
+    mapped = false;
+    huge_pages = false;
+    free_slots.clear();
+}
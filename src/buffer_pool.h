@@ -0,0 +1,79 @@
+#ifndef BUFFER_POOL_H
+#define BUFFER_POOL_H
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <new>
+#include <vector>
+
+// 直接 I/O (O_DIRECT) 要求缓冲区地址、文件偏移和长度都按这个值对齐
+const size_t DIRECT_IO_ALIGNMENT = 4096;
+// 缓冲区池中每个缓冲区的大小，不小于最大的块大小，也是直接 I/O 中转时一次读写的长度
+const size_t BUFFER_POOL_SLOT_SIZE = 256 * 1024;
+
+// 按 DIRECT_IO_ALIGNMENT 对齐分配内存的分配器，用于需要直接交给磁盘读写的长缓冲区
+template <typename T>
+struct AlignedAllocator {
+    using value_type = T;
+    AlignedAllocator() = default;
+    template <typename U>
+    AlignedAllocator(const AlignedAllocator<U>&) {}
+    T* allocate(size_t n) {
+        return static_cast<T*>(::operator new(n * sizeof(T), std::align_val_t(DIRECT_IO_ALIGNMENT)));
+    }
+    void deallocate(T* p, size_t) { ::operator delete(p, std::align_val_t(DIRECT_IO_ALIGNMENT)); }
+    template <typename U>
+    bool operator==(const AlignedAllocator<U>&) const { return true; }
+};
+using AlignedBuffer = std::vector<char, AlignedAllocator<char>>;
+
+// 对齐的块缓冲区池：一次性分配一片内存 (可以用大页)，切成固定大小的缓冲区反复使用，
+// 读写、目录和位图操作不再在栈上或堆上临时分配块缓冲区，内存用量固定
+// 池中的缓冲区用完时临时分配，归还时释放
+class BufferPool {
+public:
+    BufferPool() = default;
+    ~BufferPool();
+    BufferPool(const BufferPool&) = delete;
+    BufferPool& operator=(const BufferPool&) = delete;
+
+    // 分配 slot_count 个缓冲区，huge_pages 为 true 时先尝试大页，不可用时退回普通页
+    // 只能在没有借出的缓冲区时调用
+    void init(size_t slot_count, bool huge_pages);
+
+    // 借出一个 BUFFER_POOL_SLOT_SIZE 字节、按 DIRECT_IO_ALIGNMENT 对齐的缓冲区
+    char* acquire();
+    // 归还缓冲区
+    void release(char* buffer);
+
+    // 实际使用了大页
+    bool huge() const { return huge_pages; }
+
+private:
+    void free_arena();
+
+    std::mutex mutex;
+    char* arena = nullptr;
+    size_t arena_size = 0;
+    bool mapped = false;        // arena 由 mmap 分配
+    bool huge_pages = false;
+    bool want_huge_pages = false;
+    std::vector<char*> free_slots;
+};
+
+// 在作用域内借用池中的一个缓冲区
+class PooledBuffer {
+public:
+    explicit PooledBuffer(BufferPool& pool) : pool(pool), buffer(pool.acquire()) {}
+    ~PooledBuffer() { pool.release(buffer); }
+    PooledBuffer(const PooledBuffer&) = delete;
+    PooledBuffer& operator=(const PooledBuffer&) = delete;
+
+    char* data() { return buffer; }
+    static constexpr size_t size() { return BUFFER_POOL_SLOT_SIZE; }
+
+private:
+    BufferPool& pool;
+    char* buffer;
+};
+#endif // BUFFER_POOL_H
@@ -0,0 +1,116 @@
+#include "myfs.h"
+#include <unordered_map>
+
+// 去掉目录路径末尾多余的 '/'
+static std::string trim_directory_path(const std::string& path) {
+    std::string result = path;
+    while (result.size() > 1 && result.back() == '/') result.pop_back();
+    return result;
+}
+
+// 在同一目录下批量创建文件或目录
+bool MyFileSystem::create_entries(const std::string& parent_path, const std::vector<std::string>& names, FileType type) {
+    std::string parent = trim_directory_path(parent_path);
+    int parent_inode_number = path_to_inode(parent);
+    if (parent_inode_number == -1) {
+        std::cerr << "Directory does not exist." << std::endl;
+        return false;
+    }
+    std::vector<std::pair<std::string, FileType>> entries;
+    entries.reserve(names.size());
+    for (auto& name : names) {
+        entries.push_back({name, type});
+    }
+    std::vector<unsigned int> inode_numbers;
+    if (!add_entries(parent_inode_number, parent, entries, inode_numbers)) {
+        return false;
+    }
+    std::cout << "Created " << names.size() << (type == DIRECTORY ? " directories" : " files")
+              << " in " << parent << std::endl;
+    return true;
+}
+
+// 批量创建文件
+bool MyFileSystem::create_many(const std::string& parent_path, const std::vector<std::string>& names) {
+    TraceScope trace(trace_writer.get(), TRACE_CREATE_MANY, -1, 0, 0, parent_path,
+                     trace_writer ? join_trace_names(names) : std::string());
+    OperationScope operation(*this);
+    return create_entries(parent_path, names, REGULAR_FILE);
+}
+
+// 批量创建目录
+bool MyFileSystem::mkdir_many(const std::string& parent_path, const std::vector<std::string>& names) {
+    TraceScope trace(trace_writer.get(), TRACE_MKDIR_MANY, -1, 0, 0, parent_path,
+                     trace_writer ? join_trace_names(names) : std::string());
+    OperationScope operation(*this);
+    return create_entries(parent_path, names, DIRECTORY);
+}
+
+// 批量删除同一目录下的文件
+bool MyFileSystem::remove_many(const std::string& parent_path, const std::vector<std::string>& names) {
+    TraceScope trace(trace_writer.get(), TRACE_REMOVE_MANY, -1, 0, 0, parent_path,
+                     trace_writer ? join_trace_names(names) : std::string());
+    OperationScope operation(*this);
+    std::string parent = trim_directory_path(parent_path);
+    int parent_inode_number = path_to_inode(parent);
+    if (parent_inode_number == -1) {
+        std::cerr << "Directory does not exist." << std::endl;
+        return false;
+    }
+    Inode parent_inode = read_inode(parent_inode_number);
+    if (parent_inode.type != DIRECTORY) {
+        std::cerr << "Not a directory." << std::endl;
+        return false;
+    }
+
+    // 一次读出父目录的所有目录项
+    std::unordered_map<std::string, unsigned int> children;
+    BlockMap block_map;
+    load_block_map(parent_inode, block_map);
+    PooledBuffer block_buffer(buffer_pool);
+    for (uint64_t i = 0; i < block_map.size(); i++) {
+        if (block_map.get(i) == 0) continue;
+        read_data_block(block_map.get(i), block_buffer.data());
+        for (unsigned int j = 0; j < block_size / DIRECTORY_ENTRY_SIZE; j++) {
+            const DirectoryEntry* entry = reinterpret_cast<const DirectoryEntry*>(block_buffer.data() + j * DIRECTORY_ENTRY_SIZE);
+            if (entry->inode_number != 0) {
+                children[entry->filename] = entry->inode_number;
+            }
+        }
+    }
+
+    // 先检查全部名字，有一个不合法就什么都不删
+    std::deque<TreeNode> nodes;
+    std::vector<unsigned int> inode_numbers;
+    for (auto& name : names) {
+        auto it = children.find(name);
+        if (it == children.end()) {
+            std::cerr << name << " not found in " << parent << std::endl;
+            return false;
+        }
+        TreeNode& node = nodes.emplace_back();
+        node.inode_number = it->second;
+        node.name = name;
+        node.inode = read_inode(it->second);
+        if (node.inode.type != REGULAR_FILE) {
+            std::cerr << name << " is not a regular file." << std::endl;
+            return false;
+        }
+        if (superblock.version < 5) {
+            load_block_map(node.inode, node.block_map);
+        }
+        inode_numbers.push_back(it->second);
+        children.erase(it);
+    }
+
+    if (!remove_entries(parent_inode_number, inode_numbers)) {
+        return false;
+    }
+    std::vector<const TreeNode*> removed;
+    for (auto& node : nodes) {
+        removed.push_back(&node);
+    }
+    release_nodes(removed);
+    std::cout << "Removed " << names.size() << " files from " << parent << std::endl;
+    return true;
+}
@@ -0,0 +1,120 @@
+#include "myfs.h"
+#include "crc32c.h"
+
+// 校验和表中的 0 表示"未记录" (格式化后从未写过的块和 inode)，算出的 CRC 恰好为 0 时记为 1
+static uint32_t checksum_value(const void* data, size_t length) {
+    uint32_t crc = crc32c(data, length);
+    return crc == 0 ? 1 : crc;
+}
+
+// 挂载时读入校验和表
+void MyFileSystem::load_checksums() {
+    checksums.clear();
+    checksum_dirty.clear();
+    if (superblock.checksum_start == 0) {
+        return;
+    }
+    uint64_t table_blocks = checksum_table_blocks();
+    checksums.assign(table_blocks * block_size / sizeof(uint32_t), 0);
+    checksum_dirty.assign(table_blocks, 0);
+    // 校验和表自身不做校验，直接读取
+    read_raw_blocks(superblock.checksum_start, table_blocks, reinterpret_cast<char*>(checksums.data()));
+}
+
+// 超级块的 CRC32C，跳过 checksum 字段本身
+uint32_t MyFileSystem::superblock_checksum() const {
+    uint32_t crc = crc32c(&superblock, offsetof(Superblock, checksum));
+    if (superblock.version >= 7) {
+        crc = crc32c(reinterpret_cast<const char*>(&superblock) + SUPERBLOCK_V3_SIZE, SUPERBLOCK_SIZE - SUPERBLOCK_V3_SIZE, crc);
+    } else if (superblock.version >= 5) {
+        crc = crc32c(reinterpret_cast<const char*>(&superblock) + SUPERBLOCK_V3_SIZE, SUPERBLOCK_V6_SIZE - SUPERBLOCK_V3_SIZE, crc);
+    } else if (superblock.version >= 4) {
+        // 版本 4 中 stripe_blocks 之后是结构体末尾的填充
+        crc = crc32c(reinterpret_cast<const char*>(&superblock) + SUPERBLOCK_V3_SIZE, SUPERBLOCK_V4_SIZE - SUPERBLOCK_V3_SIZE, crc);
+    }
+    return crc;
+}
+
+// 把校验和表中修改过的块写回，相邻的脏块合并为一次写入
+void MyFileSystem::flush_checksums() {
+    const uint64_t entries_per_block = block_size / sizeof(uint32_t);
+    for (uint64_t i = 0; i < checksum_dirty.size();) {
+        if (!checksum_dirty[i]) {
+            i++;
+            continue;
+        }
+        uint64_t end = i;
+        while (end < checksum_dirty.size() && checksum_dirty[end]) {
+            checksum_dirty[end++] = 0;
+        }
+        write_raw_blocks(superblock.checksum_start + i, end - i,
+                         reinterpret_cast<const char*>(checksums.data() + i * entries_per_block));
+        i = end;
+    }
+}
+
+// 记录数据块的校验和
+void MyFileSystem::set_block_checksums(uint64_t start, uint64_t count, const char* buffer) {
+    if (checksums.empty() || count == 0) return;
+    // 去重索引按原来的校验和找到这些块的登记项
+    if (!dedup_indexed.empty()) {
+        forget_dedup_blocks(start, count);
+    }
+    for (uint64_t i = 0; i < count; i++) {
+        checksums[start + i] = checksum_value(buffer + i * block_size, block_size);
+    }
+    const uint64_t entries_per_block = block_size / sizeof(uint32_t);
+    for (uint64_t b = start / entries_per_block; b <= (start + count - 1) / entries_per_block; b++) {
+        checksum_dirty[b] = 1;
+    }
+}
+
+// 数据块内容的校验和
+uint32_t MyFileSystem::block_checksum(const char* buffer) const {
+    return checksum_value(buffer, block_size);
+}
+
+// 数据块的内容与记录的校验和是否一致 (未记录时视为一致)
+bool MyFileSystem::block_checksum_matches(uint64_t block_number, const char* buffer) const {
+    if (checksums.empty() || block_number >= superblock.data_block_count || checksums[block_number] == 0) {
+        return true;
+    }
+    return checksums[block_number] == checksum_value(buffer, block_size);
+}
+
+// 校验数据块
+bool MyFileSystem::verify_block_checksums(uint64_t start, uint64_t count, const char* buffer) const {
+    if (checksums.empty()) return true;
+    bool ok = true;
+    for (uint64_t i = 0; i < count; i++) {
+        if (!block_checksum_matches(start + i, buffer + i * block_size)) {
+            std::cerr << "Checksum mismatch in data block " << start + i << "." << std::endl;
+            ok = false;
+        }
+    }
+    return ok;
+}
+
+// 记录 inode 的校验和
+void MyFileSystem::set_inode_checksum(unsigned int inode_number, const Inode& inode) {
+    if (checksums.empty()) return;
+    uint64_t index = superblock.data_block_count + inode_number;
+    checksums[index] = checksum_value(&inode, sizeof(Inode));
+    checksum_dirty[index / (block_size / sizeof(uint32_t))] = 1;
+}
+
+// inode 的内容与记录的校验和是否一致
+bool MyFileSystem::inode_checksum_matches(unsigned int inode_number, const Inode& inode) const {
+    if (checksums.empty()) return true;
+    uint32_t expected = checksums[superblock.data_block_count + inode_number];
+    return expected == 0 || expected == checksum_value(&inode, sizeof(Inode));
+}
+
+// 校验 inode
+bool MyFileSystem::verify_inode_checksum(unsigned int inode_number, const Inode& inode) const {
+    if (!inode_checksum_matches(inode_number, inode)) {
+        std::cerr << "Checksum mismatch in inode " << inode_number << "." << std::endl;
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,115 @@
+#include "myfs.h"
+
+// 克隆文件 (写时复制)
+bool MyFileSystem::clone(const std::string& src_path, const std::string& dst_path) {
+    TraceScope trace(trace_writer.get(), TRACE_CLONE, -1, 0, 0, src_path, dst_path);
+    OperationScope operation(*this);
+    int src_inode_number = path_to_inode(src_path);
+    if (src_inode_number == -1) {
+        std::cerr << "Source file does not exist." << std::endl;
+        return false;
+    }
+    Inode src_inode = read_inode(src_inode_number);
+    if (src_inode.type != REGULAR_FILE) {
+        std::cerr << "Not a regular file." << std::endl;
+        return false;
+    }
+
+    if (block_refcount.empty() && !create_refcount_table()) {
+        return false;
+    }
+
+    BlockMap block_map;
+    load_block_map(src_inode, block_map);
+
+    // 统计每个共享块在文件中出现的次数 (去重后同一块可能出现很多次)，
+    // 加上之后引用计数不能溢出
+    std::unordered_map<uint64_t, unsigned int> occurrences;
+    for (uint64_t block_number : block_map) {
+        if (maps_data_block(block_number)) {
+            occurrences[block_number]++;
+        }
+    }
+    for (const auto& [block_number, count] : occurrences) {
+        if (block_refcount[block_number] + count > 0xFFFF) {
+            std::cerr << "Too many references to data block " << block_number << "." << std::endl;
+            return false;
+        }
+    }
+
+    if (!create(dst_path)) {
+        return false;
+    }
+    int dst_inode_number = path_to_inode(dst_path);
+
+    // 只复制块映射 (压缩簇连同标记一起)，每个共享块的引用计数加上它出现的次数
+    uint64_t min_block = superblock.data_block_count;
+    uint64_t max_block = 0;
+    for (const auto& [block_number, count] : occurrences) {
+        block_refcount[block_number] += count;
+        if (block_number < min_block) min_block = block_number;
+        if (block_number > max_block) max_block = block_number;
+    }
+    if (min_block <= max_block) {
+        write_refcounts(min_block, max_block - min_block + 1);
+    }
+
+    // 目标文件使用自己的间接块
+    Inode dst_inode = read_inode(dst_inode_number);
+    BlockMap dst_map;
+    dst_map.blocks = block_map.blocks;
+    if (!store_block_map(dst_inode, dst_map)) {
+        release_blocks(block_map, 0);
+        remove(dst_path);
+        return false;
+    }
+    dst_inode.size = src_inode.size;
+    dst_inode.permissions = src_inode.permissions;
+    dst_inode.modified_time = time(nullptr);
+    write_inode(dst_inode_number, dst_inode);
+
+    std::cout << "File cloned: " << src_path << " -> " << dst_path << std::endl;
+    return true;
+}
+
+// 读取块引用计数表
+void MyFileSystem::load_refcounts() {
+    block_refcount.clear();
+    if (superblock.refcount_start == 0) {
+        return;
+    }
+    uint64_t table_blocks = (superblock.data_block_count + refcounts_per_block() - 1) / refcounts_per_block();
+    block_refcount.assign(table_blocks * refcounts_per_block(), 0);
+    for (uint64_t i = 0; i < table_blocks; i++) {
+        read_data_block(superblock.refcount_start + i,
+                        reinterpret_cast<char*>(block_refcount.data() + i * refcounts_per_block()));
+    }
+}
+
+// 创建块引用计数表 (第一次克隆时)，占用一段连续的数据块
+bool MyFileSystem::create_refcount_table() {
+    uint64_t table_blocks = (superblock.data_block_count + refcounts_per_block() - 1) / refcounts_per_block();
+    uint64_t start;
+    if (!allocator.allocate(table_blocks, 0, start)) {
+        std::cerr << "Unable to allocate reference count table." << std::endl;
+        return false;
+    }
+    update_bitmap_range(start, table_blocks, true);
+    superblock.free_data_block_count -= table_blocks;
+
+    block_refcount.assign(table_blocks * refcounts_per_block(), 0);
+    superblock.refcount_start = start;
+    write_refcounts(0, superblock.data_block_count);
+    write_superblock();
+    return true;
+}
+
+// 写回引用计数表
+void MyFileSystem::write_refcounts(uint64_t start, uint64_t count) {
+    uint64_t first = start / refcounts_per_block();
+    uint64_t last = (start + count - 1) / refcounts_per_block();
+    for (uint64_t i = first; i <= last; i++) {
+        write_data_block(superblock.refcount_start + i,
+                         reinterpret_cast<const char*>(block_refcount.data() + i * refcounts_per_block()));
+    }
+}
@@ -0,0 +1,327 @@
+#include "myfs.h"
+#include "lz.h"
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+
+// 压缩簇中压缩数据之前的头部
+struct ClusterHeader {
+    uint32_t compressed_size;  // 紧随其后的压缩数据的字节数
+    uint32_t original_size;    // 解压后的字节数，簇中其余部分为 0
+};
+
+// 扫描 inode 表时每次读取的 inode 数
+const unsigned int CLUSTER_SCAN_CHUNK = 256;
+
+// 距 start 的纳秒数
+static uint64_t elapsed_ns(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+// 读出压缩簇并解压
+bool MyFileSystem::decompress_cluster(const BlockMap& block_map, uint64_t cluster, char* buffer, ImageReader* image) {
+    const uint64_t head = (uint64_t)cluster * COMPRESS_CLUSTER_BLOCKS;
+    const uint64_t cluster_size = (uint64_t)COMPRESS_CLUSTER_BLOCKS * block_size;
+    uint64_t count = 0;
+    while (count + 1 < COMPRESS_CLUSTER_BLOCKS && maps_data_block(block_map.get(head + 1 + count))) count++;
+
+    // 压缩数据所在的块通常是连续的，合并为一次读取
+    AlignedBuffer packed(count * block_size);
+    bool ok = count > 0;
+    for (uint64_t k = 0; k < count && ok;) {
+        uint64_t block_number = block_map.get(head + 1 + k);
+        uint64_t run = 1;
+        while (k + run < count && block_map.get(head + 1 + k + run) == block_number + run) run++;
+        ok = image ? read_data_blocks(block_number, run, packed.data() + k * block_size, *image)
+                   : read_data_blocks(block_number, run, packed.data() + k * block_size);
+        k += run;
+    }
+    if (ok) {
+        ClusterHeader header;
+        memcpy(&header, packed.data(), sizeof(header));
+        ok = header.compressed_size <= packed.size() - sizeof(header) && header.original_size <= cluster_size &&
+             lz_decompress(packed.data() + sizeof(header), header.compressed_size, buffer, header.original_size);
+        if (ok) {
+            memset(buffer + header.original_size, 0, cluster_size - header.original_size);
+        }
+    }
+    if (!ok) {
+        std::cerr << "Unable to decompress cluster " << cluster << "." << std::endl;
+    }
+    return ok;
+}
+
+// 取得解压后的压缩簇
+const char* MyFileSystem::read_cluster(const BlockMap& block_map, uint64_t cluster) {
+    uint64_t first_block = block_map.get((uint64_t)cluster * COMPRESS_CLUSTER_BLOCKS + 1);
+    for (auto it = cluster_cache.begin(); it != cluster_cache.end(); ++it) {
+        if (it->first == first_block) {
+            cluster_cache.splice(cluster_cache.begin(), cluster_cache, it);
+            compression_stats.cache_hits++;
+            return it->second.data();
+        }
+    }
+    char* buffer = cache_cluster(first_block);
+    auto start = std::chrono::steady_clock::now();
+    if (!decompress_cluster(block_map, cluster, buffer, nullptr)) {
+        cluster_cache.pop_front();
+        return nullptr;
+    }
+    compression_stats.decompress_ns += elapsed_ns(start);
+    compression_stats.decompressed_clusters++;
+    return buffer;
+}
+
+// 在簇缓存中占一个位置
+char* MyFileSystem::cache_cluster(uint64_t first_block) {
+    auto it = std::find_if(cluster_cache.begin(), cluster_cache.end(),
+                           [&](const auto& entry) { return entry.first == first_block; });
+    if (it == cluster_cache.end() && cluster_cache.size() >= CLUSTER_CACHE_SLOTS) {
+        // 淘汰最久没用的，缓冲区留给新的簇
+        it = std::prev(cluster_cache.end());
+        it->first = first_block;
+    }
+    if (it == cluster_cache.end()) {
+        cluster_cache.emplace_front(first_block, AlignedBuffer((uint64_t)COMPRESS_CLUSTER_BLOCKS * block_size));
+    } else {
+        cluster_cache.splice(cluster_cache.begin(), cluster_cache, it);
+    }
+    return cluster_cache.front().second.data();
+}
+
+// 数据块被释放，以它们开头的压缩簇作废
+void MyFileSystem::drop_cached_clusters(uint64_t start, uint64_t count) {
+    cluster_cache.remove_if([&](const auto& entry) { return entry.first >= start && entry.first < start + count; });
+}
+
+// 读出一簇的内容
+bool MyFileSystem::load_cluster(const BlockMap& block_map, uint64_t cluster, uint64_t size, char* buffer) {
+    const uint64_t head = (uint64_t)cluster * COMPRESS_CLUSTER_BLOCKS;
+    const uint64_t cluster_size = (uint64_t)COMPRESS_CLUSTER_BLOCKS * block_size;
+    if (block_map.get(head) == COMPRESSED_CLUSTER) {
+        const char* content = read_cluster(block_map, cluster);
+        if (!content) {
+            return false;
+        }
+        memcpy(buffer, content, cluster_size);
+    } else {
+        for (uint64_t k = 0; k < COMPRESS_CLUSTER_BLOCKS;) {
+            uint64_t block_number = block_map.get(head + k);
+            uint64_t run = 1;
+            if (block_number == 0) {
+                memset(buffer + k * block_size, 0, block_size);
+            } else {
+                while (k + run < COMPRESS_CLUSTER_BLOCKS && block_map.get(head + k + run) == block_number + run) run++;
+                if (!read_data_blocks(block_number, run, buffer + k * block_size)) {
+                    return false;
+                }
+            }
+            k += run;
+        }
+    }
+    // 文件末尾之后的内容视为 0 (fallocate 预留的块中可能是旧数据)
+    uint64_t start = cluster * cluster_size;
+    if (size < start + cluster_size) {
+        uint64_t keep = size > start ? size - start : 0;
+        memset(buffer + keep, 0, cluster_size - keep);
+    }
+    return true;
+}
+
+// 写入一簇
+bool MyFileSystem::store_cluster(BlockMap& block_map, uint64_t cluster, const char* buffer, bool compress) {
+    const uint64_t head = (uint64_t)cluster * COMPRESS_CLUSTER_BLOCKS;
+    const uint64_t cluster_size = (uint64_t)COMPRESS_CLUSTER_BLOCKS * block_size;
+
+    // 末尾全为 0 的部分不必存放
+    uint64_t used = cluster_size;
+    while (used > 0 && buffer[used - 1] == 0) used--;
+    uint64_t count = (used + block_size - 1) / block_size;
+
+    // 压缩后至少要省下一个块才压缩存放；最后一簇不完整时放不下标记，不压缩
+    AlignedBuffer packed;
+    bool compressed = false;
+    if (compress && count > 1 && head + COMPRESS_CLUSTER_BLOCKS <= max_file_blocks()) {
+        auto start = std::chrono::steady_clock::now();
+        packed.resize((count - 1) * block_size);
+        size_t size = lz_compress(buffer, used, packed.data() + sizeof(ClusterHeader), packed.size() - sizeof(ClusterHeader));
+        compression_stats.compress_ns += elapsed_ns(start);
+        compression_stats.compress_bytes += used;
+        if (size > 0) {
+            ClusterHeader header;
+            header.compressed_size = size;
+            header.original_size = used;
+            memcpy(packed.data(), &header, sizeof(header));
+            uint64_t stored = (sizeof(header) + size + block_size - 1) / block_size;
+            memset(packed.data() + sizeof(header) + size, 0, stored * block_size - sizeof(header) - size);
+            compression_stats.compressed_clusters++;
+            compression_stats.input_blocks += count;
+            compression_stats.stored_blocks += stored;
+            count = stored;
+            compressed = true;
+        } else {
+            compression_stats.raw_clusters++;
+        }
+    }
+    const char* data = compressed ? packed.data() : buffer;
+    const uint64_t first_slot = compressed ? 1 : 0;
+
+    // 原来的块数和存放方式都相同、且没有与克隆文件共享时原地改写
+    std::vector<uint64_t> old_blocks;
+    for (uint64_t k = 0; k < COMPRESS_CLUSTER_BLOCKS; k++) {
+        if (maps_data_block(block_map.get(head + k))) old_blocks.push_back(block_map.get(head + k));
+    }
+    bool reuse = count > 0 && old_blocks.size() == count && (block_map.get(head) == COMPRESSED_CLUSTER) == compressed;
+    for (uint64_t k = 0; k < count && reuse; k++) {
+        reuse = block_map.get(head + first_slot + k) == old_blocks[k] && !is_shared(old_blocks[k]);
+    }
+
+    std::vector<uint64_t> new_blocks;
+    if (reuse) {
+        new_blocks.swap(old_blocks);
+    } else {
+        // 尽量紧接在前一簇之后分配
+        uint64_t hint = head > 0 && maps_data_block(block_map.get(head - 1)) ? block_map.get(head - 1) + 1 : 0;
+        while (new_blocks.size() < count) {
+            uint64_t start;
+            uint64_t allocated = allocate_data_blocks(count - new_blocks.size(), hint, start);
+            if (allocated == 0) {
+                for (uint64_t block_number : new_blocks) {
+                    free_data_block(block_number);
+                }
+                return false;
+            }
+            for (uint64_t k = 0; k < allocated; k++) {
+                new_blocks.push_back(start + k);
+            }
+            hint = start + allocated;
+        }
+    }
+    for (uint64_t k = 0; k < count;) {
+        uint64_t run = 1;
+        while (k + run < count && new_blocks[k + run] == new_blocks[k] + run) run++;
+        write_data_blocks(new_blocks[k], run, data + k * block_size);
+        k += run;
+    }
+
+    // 新数据写下后再切换映射，释放原来的块
+    for (uint64_t k = 0; k < COMPRESS_CLUSTER_BLOCKS; k++) {
+        uint64_t entry = 0;
+        if (compressed && k == 0) {
+            entry = COMPRESSED_CLUSTER;
+        } else if (k >= first_slot && k - first_slot < count) {
+            entry = new_blocks[k - first_slot];
+        }
+        if (block_map.get(head + k) != entry) block_map[head + k] = entry;
+    }
+    std::sort(old_blocks.begin(), old_blocks.end());
+    for (size_t i = 0; i < old_blocks.size();) {
+        size_t end = i + 1;
+        while (end < old_blocks.size() && old_blocks[end] == old_blocks[end - 1] + 1) end++;
+        free_data_blocks(old_blocks[i], end - i);
+        i = end;
+    }
+
+    // 刚写入的簇很可能马上被读到，直接放入簇缓存
+    if (compressed) {
+        memcpy(cache_cluster(new_blocks[0]), buffer, cluster_size);
+    }
+    return true;
+}
+
+// 按簇读改写
+bool MyFileSystem::write_clusters(Inode& inode, BlockMap& block_map, uint64_t offset, unsigned int length,
+                                  const char* buffer) {
+    const uint64_t cluster_size = (uint64_t)COMPRESS_CLUSTER_BLOCKS * block_size;
+    const uint64_t end_offset = offset + length;
+    AlignedBuffer data(cluster_size);
+    for (uint64_t cluster = offset / cluster_size; cluster * cluster_size < end_offset; cluster++) {
+        uint64_t start = cluster * cluster_size;
+        uint64_t from = std::max(offset, start);
+        uint64_t to = std::min(end_offset, start + cluster_size);
+        // 没有整簇覆盖时先读出原来的内容
+        if ((from > start || to < start + cluster_size) && !load_cluster(block_map, cluster, inode.size, data.data())) {
+            store_block_map(inode, block_map);
+            return false;
+        }
+        memcpy(data.data() + (from - start), buffer + (from - offset), to - from);
+        if (!store_cluster(block_map, cluster, data.data(), true)) {
+            // 已写完的簇换了位置，映射表仍要写回
+            store_block_map(inode, block_map);
+            return false;
+        }
+    }
+    return store_block_map(inode, block_map);
+}
+
+// 把压缩簇解压为普通块
+bool MyFileSystem::expand_clusters(BlockMap& block_map, uint64_t first, uint64_t last, bool& changed) {
+    AlignedBuffer data;
+    for (uint64_t cluster = first / COMPRESS_CLUSTER_BLOCKS; cluster <= last / COMPRESS_CLUSTER_BLOCKS; cluster++) {
+        if (block_map.get(cluster * COMPRESS_CLUSTER_BLOCKS) != COMPRESSED_CLUSTER) continue;
+        const char* content = read_cluster(block_map, cluster);
+        if (!content) {
+            return false;
+        }
+        // store_cluster 会改动簇缓存，先复制出来
+        data.assign(content, content + (uint64_t)COMPRESS_CLUSTER_BLOCKS * block_size);
+        if (!store_cluster(block_map, cluster, data.data(), false)) {
+            return false;
+        }
+        changed = true;
+    }
+    return true;
+}
+
+// 输出压缩统计
+void MyFileSystem::compression_report() {
+    OperationScope operation(*this);
+    const CompressionStats& stats = compression_stats;
+    auto ms = [](uint64_t ns) { return ns / 1e6; };
+    auto rate = [](uint64_t bytes, uint64_t ns) { return ns == 0 ? 0.0 : bytes * 1e3 / ns; };
+    std::cout << std::fixed << std::setprecision(2);
+    std::cout << "Compression: " << (mount_options.compress ? "on" : "off") << ", cluster "
+              << COMPRESS_CLUSTER_BLOCKS * block_size / 1024 << "K" << std::endl;
+    std::cout << "Written: " << stats.compressed_clusters << " clusters compressed (" << stats.input_blocks << " -> "
+              << stats.stored_blocks << " blocks), " << stats.raw_clusters << " stored uncompressed" << std::endl;
+    std::cout << "Compress time: " << ms(stats.compress_ns) << " ms (" << rate(stats.compress_bytes, stats.compress_ns)
+              << " MB/s), decompress time: " << ms(stats.decompress_ns) << " ms for " << stats.decompressed_clusters
+              << " clusters (" << rate(stats.decompressed_clusters * COMPRESS_CLUSTER_BLOCKS * block_size, stats.decompress_ns)
+              << " MB/s)" << std::endl;
+    uint64_t lookups = stats.cache_hits + stats.decompressed_clusters;
+    std::cout << "Cluster cache: " << stats.cache_hits << " hits, " << stats.decompressed_clusters << " misses (hit rate "
+              << (lookups == 0 ? 0.0 : 100.0 * stats.cache_hits / lookups) << "%)" << std::endl;
+
+    // 镜像中现有的压缩簇，不压缩时需要的块数按文件大小计
+    uint64_t clusters = 0;
+    uint64_t logical_blocks = 0;
+    uint64_t stored_blocks = 0;
+    uint64_t files = 0;
+    std::vector<Inode> inodes(CLUSTER_SCAN_CHUNK);
+    BlockMap block_map;
+    for (unsigned int first = 1; first < superblock.inode_count; first += CLUSTER_SCAN_CHUNK) {
+        unsigned int count = std::min(CLUSTER_SCAN_CHUNK, superblock.inode_count - first);
+        read_inodes(first, count, inodes.data());
+        for (unsigned int i = 0; i < count; i++) {
+            if (!inodes[i].used || inodes[i].type != REGULAR_FILE) continue;
+            load_block_map(inodes[i], block_map);
+            uint64_t file_blocks = (inodes[i].size + block_size - 1) / block_size;
+            bool has_clusters = false;
+            for (uint64_t head = 0; head < block_map.size(); head += COMPRESS_CLUSTER_BLOCKS) {
+                if (block_map.get(head) != COMPRESSED_CLUSTER) continue;
+                has_clusters = true;
+                clusters++;
+                logical_blocks += std::min<uint64_t>(COMPRESS_CLUSTER_BLOCKS, file_blocks > head ? file_blocks - head : 0);
+                for (uint64_t k = 1; k < COMPRESS_CLUSTER_BLOCKS; k++) {
+                    if (maps_data_block(block_map.get(head + k))) stored_blocks++;
+                }
+            }
+            if (has_clusters) files++;
+        }
+    }
+    uint64_t saved = logical_blocks > stored_blocks ? logical_blocks - stored_blocks : 0;
+    std::cout << "On disk: " << clusters << " compressed clusters in " << files << " files, " << stored_blocks
+              << " blocks instead of " << logical_blocks << " (saved " << saved * block_size / 1024 << "K, ratio "
+              << (stored_blocks == 0 ? 0.0 : (double)logical_blocks / stored_blocks) << ")" << std::endl;
+    std::cout.unsetf(std::ios::fixed);
+}
@@ -0,0 +1,221 @@
+#include "crc32c.h"
+#include <array>
+#include <cstring>
+#if defined(__x86_64__) || defined(__i386__)
+#include <nmmintrin.h>
+#elif defined(__aarch64__)
+#include <arm_acle.h>
+#if defined(__linux__)
+#include <sys/auxv.h>
+#include <asm/hwcap.h>
+#endif
+#endif
+
+namespace {
+const uint32_t CRC32C_POLYNOMIAL = 0x82F63B78; // 反射形式
+
+// slicing-by-8 查找表，编译期生成
+constexpr std::array<std::array<uint32_t, 256>, 8> make_tables() {
+    std::array<std::array<uint32_t, 256>, 8> tables{};
+    for (uint32_t i = 0; i < 256; i++) {
+        uint32_t crc = i;
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc >> 1) ^ ((crc & 1) ? CRC32C_POLYNOMIAL : 0);
+        }
+        tables[0][i] = crc;
+    }
+    for (uint32_t i = 0; i < 256; i++) {
+        for (int t = 1; t < 8; t++) {
+            tables[t][i] = (tables[t - 1][i] >> 8) ^ tables[0][tables[t - 1][i] & 0xFF];
+        }
+    }
+    return tables;
+}
+constexpr auto TABLES = make_tables();
+
+// 硬件实现把数据分成三段交错计算，三段的结果再合并：
+// CRC 指令有 3 个周期的延迟、每周期可以发出一条，单条依赖链只能用到三分之一的吞吐量
+// 长段用于大块，短段用于 4K 及以下的块和大块的剩余部分
+const size_t LONG_LANE = 8192;
+const size_t SHORT_LANE = 256;
+
+// GF(2) 上模多项式的乘法 (反射形式，最高位是 x^0 的系数)
+constexpr uint32_t multiply_mod(uint32_t a, uint32_t b) {
+    uint32_t product = 0;
+    for (uint32_t m = 1u << 31; m != 0; m >>= 1) {
+        if (a & m) product ^= b;
+        b = (b & 1) ? (b >> 1) ^ CRC32C_POLYNOMIAL : b >> 1;
+    }
+    return product;
+}
+
+// x^bits 模多项式
+constexpr uint32_t power_of_x(uint64_t bits) {
+    uint32_t result = 1u << 31;  // x^0
+    uint32_t square = 1u << 30;  // x^1
+    for (; bits != 0; bits >>= 1) {
+        if (bits & 1) result = multiply_mod(result, square);
+        square = multiply_mod(square, square);
+    }
+    return result;
+}
+
+// 把 CRC 寄存器推进 length 个 0 字节 (乘以 x^(8 * length))，按四个字节分别查表
+using ShiftTable = std::array<std::array<uint32_t, 256>, 4>;
+
+constexpr ShiftTable make_shift_table(size_t length) {
+    ShiftTable table{};
+    uint32_t factor = power_of_x(8 * (uint64_t)length);
+    for (uint32_t i = 0; i < 256; i++) {
+        for (int t = 0; t < 4; t++) {
+            table[t][i] = multiply_mod(i << (8 * t), factor);
+        }
+    }
+    return table;
+}
+constexpr ShiftTable LONG_SHIFT = make_shift_table(LONG_LANE);
+constexpr ShiftTable SHORT_SHIFT = make_shift_table(SHORT_LANE);
+
+uint32_t shift(const ShiftTable& table, uint32_t crc) {
+    return table[0][crc & 0xFF] ^ table[1][(crc >> 8) & 0xFF] ^ table[2][(crc >> 16) & 0xFF] ^ table[3][crc >> 24];
+}
+
+uint32_t software_update(const unsigned char* p, size_t length, uint32_t crc) {
+    while (length >= 8) {
+        uint64_t word;
+        memcpy(&word, p, 8);
+        word ^= crc;  // 小端机器上低 4 字节与 crc 对齐
+        crc = TABLES[7][word & 0xFF] ^ TABLES[6][(word >> 8) & 0xFF] ^
+              TABLES[5][(word >> 16) & 0xFF] ^ TABLES[4][(word >> 24) & 0xFF] ^
+              TABLES[3][(word >> 32) & 0xFF] ^ TABLES[2][(word >> 40) & 0xFF] ^
+              TABLES[1][(word >> 48) & 0xFF] ^ TABLES[0][word >> 56];
+        p += 8;
+        length -= 8;
+    }
+    while (length--) {
+        crc = (crc >> 8) ^ TABLES[0][(crc ^ *p++) & 0xFF];
+    }
+    return crc;
+}
+
+#if defined(__x86_64__)
+__attribute__((target("sse4.2")))
+uint32_t hardware_single(const unsigned char* p, size_t length, uint32_t crc) {
+    uint64_t crc64 = crc;
+    while (length >= 8) {
+        uint64_t word;
+        memcpy(&word, p, 8);
+        crc64 = _mm_crc32_u64(crc64, word);
+        p += 8;
+        length -= 8;
+    }
+    crc = static_cast<uint32_t>(crc64);
+    while (length--) {
+        crc = _mm_crc32_u8(crc, *p++);
+    }
+    return crc;
+}
+
+// 相邻三段各 lane 字节 (8 的倍数)，后两段从 0 开始算，合并时把前面的结果推进一段的长度
+__attribute__((target("sse4.2")))
+uint32_t hardware_triple(const unsigned char* p, size_t lane, uint32_t crc, const ShiftTable& table) {
+    uint64_t crc0 = crc, crc1 = 0, crc2 = 0;
+    for (size_t i = 0; i < lane; i += 8) {
+        uint64_t word0, word1, word2;
+        memcpy(&word0, p + i, 8);
+        memcpy(&word1, p + lane + i, 8);
+        memcpy(&word2, p + 2 * lane + i, 8);
+        crc0 = _mm_crc32_u64(crc0, word0);
+        crc1 = _mm_crc32_u64(crc1, word1);
+        crc2 = _mm_crc32_u64(crc2, word2);
+    }
+    crc = shift(table, static_cast<uint32_t>(crc0)) ^ static_cast<uint32_t>(crc1);
+    return shift(table, crc) ^ static_cast<uint32_t>(crc2);
+}
+
+bool hardware_supported() {
+    return __builtin_cpu_supports("sse4.2");
+}
+#elif defined(__aarch64__)
+__attribute__((target("+crc")))
+uint32_t hardware_single(const unsigned char* p, size_t length, uint32_t crc) {
+    while (length >= 8) {
+        uint64_t word;
+        memcpy(&word, p, 8);
+        crc = __crc32cd(crc, word);
+        p += 8;
+        length -= 8;
+    }
+    while (length--) {
+        crc = __crc32cb(crc, *p++);
+    }
+    return crc;
+}
+
+__attribute__((target("+crc")))
+uint32_t hardware_triple(const unsigned char* p, size_t lane, uint32_t crc, const ShiftTable& table) {
+    uint32_t crc0 = crc, crc1 = 0, crc2 = 0;
+    for (size_t i = 0; i < lane; i += 8) {
+        uint64_t word0, word1, word2;
+        memcpy(&word0, p + i, 8);
+        memcpy(&word1, p + lane + i, 8);
+        memcpy(&word2, p + 2 * lane + i, 8);
+        crc0 = __crc32cd(crc0, word0);
+        crc1 = __crc32cd(crc1, word1);
+        crc2 = __crc32cd(crc2, word2);
+    }
+    return shift(table, shift(table, crc0) ^ crc1) ^ crc2;
+}
+
+bool hardware_supported() {
+#if defined(__linux__)
+    return (getauxval(AT_HWCAP) & HWCAP_CRC32) != 0;
+#else
+    return true;  // 其他平台上的 ARMv8 处理器都带 CRC 指令
+#endif
+}
+#endif
+
+#if defined(__x86_64__) || defined(__aarch64__)
+uint32_t hardware_update(const unsigned char* p, size_t length, uint32_t crc) {
+    for (; length >= 3 * LONG_LANE; p += 3 * LONG_LANE, length -= 3 * LONG_LANE) {
+        crc = hardware_triple(p, LONG_LANE, crc, LONG_SHIFT);
+    }
+    for (; length >= 3 * SHORT_LANE; p += 3 * SHORT_LANE, length -= 3 * SHORT_LANE) {
+        crc = hardware_triple(p, SHORT_LANE, crc, SHORT_SHIFT);
+    }
+    return hardware_single(p, length, crc);
+}
+#else
+uint32_t hardware_update(const unsigned char* p, size_t length, uint32_t crc) {
+    return software_update(p, length, crc);
+}
+
+bool hardware_supported() {
+    return false;
+}
+#endif
+
+// 启动时选定实现，之后直接通过函数指针调用
+using UpdateFunction = uint32_t (*)(const unsigned char*, size_t, uint32_t);
+const bool HARDWARE = hardware_supported();
+const UpdateFunction UPDATE = HARDWARE ? hardware_update : software_update;
+}
+
+uint32_t crc32c(const void* data, size_t length, uint32_t crc) {
+    return ~UPDATE(static_cast<const unsigned char*>(data), length, ~crc);
+}
+
+uint32_t crc32c_software(const void* data, size_t length, uint32_t crc) {
+    return ~software_update(static_cast<const unsigned char*>(data), length, ~crc);
+}
+
+const char* crc32c_implementation() {
+#if defined(__x86_64__)
+    return HARDWARE ? "sse4.2" : "software";
+#elif defined(__aarch64__)
+    return HARDWARE ? "armv8-crc" : "software";
+#else
+    return "software";
+#endif
+}
@@ -0,0 +1,15 @@
+#ifndef CRC32C_H
+#define CRC32C_H
+#include <cstddef>
+#include <cstdint>
+
+// CRC32C (Castagnoli 多项式)，CPU 支持时使用 SSE4.2 / ARMv8 的 CRC 指令，否则使用查表的软件实现
+// crc 为上一段数据的结果，用于分段计算；第一段传 0
+uint32_t crc32c(const void* data, size_t length, uint32_t crc = 0);
+
+// 软件实现 (slicing-by-8)，供没有 CRC 指令的 CPU 使用，也用于基准测试对比
+uint32_t crc32c_software(const void* data, size_t length, uint32_t crc = 0);
+
+// 当前使用的实现名称
+const char* crc32c_implementation();
+#endif // CRC32C_H
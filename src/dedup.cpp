@@ -0,0 +1,449 @@
+#include "myfs.h"
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+
+// 去重写入时每个块的处理方式
+enum DedupAction {
+    DEDUP_WRITE,      // 写入 (原地或写到新分配的块中)，写完后登记到索引
+    DEDUP_SHARE,      // 改为引用索引中内容相同的已有块
+    DEDUP_REPEAT,     // 与本次写入中前面的某个块相同，那个块写完后引用它
+    DEDUP_UNCHANGED,  // 与原来映射的块内容相同，不必写
+    DEDUP_ZERO        // 全为 0，不分配
+};
+
+// 扫描 inode 表时每次读取的 inode 数
+const unsigned int DEDUP_SCAN_CHUNK = 256;
+
+// 距 start 的纳秒数
+static uint64_t elapsed_ns(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+// 数据块是否全为 0
+static bool is_zero_block(const char* data, size_t size) {
+    return data[0] == 0 && memcmp(data, data + 1, size - 1) == 0;
+}
+
+// 创建去重索引，桶数按每个数据块都能登记一项计算
+bool MyFileSystem::create_dedup_index() {
+    uint64_t buckets = (superblock.data_block_count + dedup_bucket_entries() - 1) / dedup_bucket_entries();
+    uint64_t start;
+    if (!allocator.allocate(buckets, 0, start)) {
+        std::cerr << "Unable to allocate deduplication index." << std::endl;
+        return false;
+    }
+    update_bitmap_range(start, buckets, true);
+    superblock.free_data_block_count -= buckets;
+
+    // 分到的块中可能是已删除文件的旧数据，全部清零
+    PooledBuffer zeros(buffer_pool);
+    memset(zeros.data(), 0, PooledBuffer::size());
+    const uint64_t chunk = PooledBuffer::size() / block_size;
+    for (uint64_t i = 0; i < buckets; i += chunk) {
+        write_data_blocks(start + i, std::min(chunk, buckets - i), zeros.data());
+    }
+    superblock.dedup_start = start;
+    superblock.dedup_buckets = buckets;
+    write_superblock();
+    dedup_cache.clear();
+    dedup_indexed.assign(superblock.data_block_count, 0);
+    return true;
+}
+
+// 扫描去重索引
+void MyFileSystem::load_dedup_index() {
+    dedup_cache.clear();
+    dedup_indexed.clear();
+    if (superblock.dedup_start == 0 || checksums.empty()) {
+        return;
+    }
+    dedup_indexed.assign(superblock.data_block_count, 0);
+    PooledBuffer chunk(buffer_pool);
+    const uint64_t per_read = PooledBuffer::size() / block_size;
+    for (uint64_t i = 0; i < superblock.dedup_buckets; i += per_read) {
+        uint64_t count = std::min(per_read, superblock.dedup_buckets - i);
+        read_data_blocks(superblock.dedup_start + i, count, chunk.data());
+        const DedupEntry* entries = reinterpret_cast<const DedupEntry*>(chunk.data());
+        for (uint64_t j = 0; j < count * dedup_bucket_entries(); j++) {
+            if (entries[j].block_number != 0 && entries[j].block_number < superblock.data_block_count) {
+                dedup_indexed[entries[j].block_number] = 1;
+            }
+        }
+    }
+}
+
+// 取得去重索引的一个桶
+DedupEntry* MyFileSystem::dedup_bucket(uint64_t bucket) {
+    for (auto it = dedup_cache.begin(); it != dedup_cache.end(); ++it) {
+        if (it->first == bucket) {
+            dedup_cache.splice(dedup_cache.begin(), dedup_cache, it);
+            dedup_stats.cache_hits++;
+            return reinterpret_cast<DedupEntry*>(it->second.data());
+        }
+    }
+    if (dedup_cache.size() >= DEDUP_CACHE_SLOTS) {
+        // 淘汰最久没用的，缓冲区留给新的桶 (修改过的桶都已写回)
+        dedup_cache.splice(dedup_cache.begin(), dedup_cache, std::prev(dedup_cache.end()));
+        dedup_cache.front().first = bucket;
+    } else {
+        dedup_cache.emplace_front(bucket, AlignedBuffer(block_size));
+    }
+    char* data = dedup_cache.front().second.data();
+    if (!read_data_block(superblock.dedup_start + bucket, data)) {
+        // 损坏的桶当作空桶，下次登记时覆盖
+        memset(data, 0, block_size);
+    }
+    dedup_stats.bucket_reads++;
+    return reinterpret_cast<DedupEntry*>(data);
+}
+
+// 写回修改过的桶
+void MyFileSystem::store_dedup_bucket(uint64_t bucket, const DedupEntry* entries) {
+    write_data_block(superblock.dedup_start + bucket, reinterpret_cast<const char*>(entries));
+}
+
+// 查找内容相同的已登记数据块
+uint64_t MyFileSystem::dedup_lookup(uint32_t hash, const char* data) {
+    if (dedup_indexed.empty()) {
+        return 0;
+    }
+    const DedupEntry* entries = dedup_bucket(hash % superblock.dedup_buckets);
+    for (unsigned int i = 0; i < dedup_bucket_entries(); i++) {
+        uint64_t block_number = entries[i].block_number;
+        // 块被改写时已从索引中删去，校验和表与索引不一致的项不用
+        if (block_number == 0 || entries[i].hash != hash || block_number >= superblock.data_block_count ||
+            checksums[block_number] != hash) {
+            continue;
+        }
+        // 校验和只有 32 位，相同时还要比较内容才能共享
+        PooledBuffer candidate(buffer_pool);
+        if (read_data_block(block_number, candidate.data()) && memcmp(candidate.data(), data, block_size) == 0) {
+            return block_number;
+        }
+        dedup_stats.hash_mismatches++;
+    }
+    return 0;
+}
+
+// 登记刚写入的数据块
+void MyFileSystem::dedup_insert(std::vector<std::pair<uint32_t, uint64_t>>& blocks) {
+    if (dedup_indexed.empty() || blocks.empty()) {
+        return;
+    }
+    const uint64_t buckets = superblock.dedup_buckets;
+    std::sort(blocks.begin(), blocks.end(),
+              [&](const auto& a, const auto& b) { return a.first % buckets < b.first % buckets; });
+    for (size_t i = 0; i < blocks.size();) {
+        uint64_t bucket = blocks[i].first % buckets;
+        DedupEntry* entries = dedup_bucket(bucket);
+        for (; i < blocks.size() && blocks[i].first % buckets == bucket; i++) {
+            // 有空项时用空项，桶满时覆盖序号最小 (最早登记) 的项
+            DedupEntry* victim = nullptr;
+            uint32_t sequence = 0;
+            for (unsigned int j = 0; j < dedup_bucket_entries(); j++) {
+                DedupEntry& entry = entries[j];
+                if (entry.block_number != 0) {
+                    sequence = std::max(sequence, entry.sequence + 1);
+                }
+                if (!victim || (victim->block_number != 0 && (entry.block_number == 0 || entry.sequence < victim->sequence))) {
+                    victim = &entry;
+                }
+            }
+            if (victim->block_number != 0) {
+                dedup_indexed[victim->block_number] = 0;
+                dedup_stats.evictions++;
+            }
+            victim->block_number = blocks[i].second;
+            victim->hash = blocks[i].first;
+            victim->sequence = sequence;
+            dedup_indexed[blocks[i].second] = 1;
+        }
+        store_dedup_bucket(bucket, entries);
+    }
+}
+
+// 从去重索引中删去即将改写或释放的块，同一个桶中的块一起删
+void MyFileSystem::forget_dedup_blocks(uint64_t start, uint64_t count) {
+    std::vector<std::pair<uint64_t, uint64_t>> forgotten;  // (桶号, 块号)
+    for (uint64_t b = start; b < start + count; b++) {
+        if (dedup_indexed[b]) {
+            dedup_indexed[b] = 0;
+            forgotten.push_back({checksums[b] % superblock.dedup_buckets, b});
+        }
+    }
+    std::sort(forgotten.begin(), forgotten.end());
+    for (size_t i = 0; i < forgotten.size();) {
+        uint64_t bucket = forgotten[i].first;
+        DedupEntry* entries = dedup_bucket(bucket);
+        for (; i < forgotten.size() && forgotten[i].first == bucket; i++) {
+            for (unsigned int j = 0; j < dedup_bucket_entries(); j++) {
+                if (entries[j].block_number == forgotten[i].second) {
+                    entries[j] = DedupEntry();
+                    break;
+                }
+            }
+        }
+        store_dedup_bucket(bucket, entries);
+    }
+}
+
+// 按块去重写入
+bool MyFileSystem::write_dedup(Inode& inode, BlockMap& block_map, uint64_t offset, unsigned int length,
+                               const char* buffer) {
+    const uint64_t end_offset = offset + length;
+    const uint64_t first = offset / block_size;
+    const uint64_t count = (end_offset - 1) / block_size - first + 1;
+    bool map_changed = false;
+    if (!expand_clusters(block_map, first, first + count - 1, map_changed)) {
+        if (map_changed) store_block_map(inode, block_map);
+        return false;
+    }
+    if (superblock.dedup_start == 0 && !create_dedup_index()) {
+        // 没有索引时照常写入，只是找不到重复的块
+        std::cerr << "Writing without deduplication." << std::endl;
+        mount_options.dedup = false;
+    }
+
+    // 首尾没有整块覆盖的块先读出原来的内容再合并 (文件末尾之后和空洞视为 0)，整块直接使用调用者的缓冲区
+    PooledBuffer head(buffer_pool);
+    PooledBuffer tail(buffer_pool);
+    std::vector<const char*> data(count);
+    for (uint64_t k = 0; k < count; k++) {
+        uint64_t block_start = (first + k) * block_size;
+        if (block_start >= offset && block_start + block_size <= end_offset) {
+            data[k] = buffer + (block_start - offset);
+            continue;
+        }
+        char* block = k == 0 ? head.data() : tail.data();
+        uint64_t block_number = block_map.get(first + k);
+        if (block_start >= inode.size || block_number == 0) {
+            memset(block, 0, block_size);
+        } else if (!read_data_block(block_number, block)) {
+            // 原有数据已损坏，不能在其基础上写入
+            if (map_changed) store_block_map(inode, block_map);
+            return false;
+        }
+        uint64_t from = std::max(offset, block_start);
+        uint64_t to = std::min(end_offset, block_start + block_size);
+        memcpy(block + (from - block_start), buffer + (from - offset), to - from);
+        data[k] = block;
+    }
+
+    // 逐块计算校验和，先在本次写入的块中找相同的，再查索引；只查不改，失败时不必回滚
+    std::vector<DedupAction> actions(count, DEDUP_WRITE);
+    std::vector<uint32_t> hashes(count, 0);
+    std::vector<uint64_t> targets(count, 0);                  // SHARE: 引用的块号；REPEAT: 相同的块的序号
+    std::unordered_map<uint32_t, uint64_t> written;           // 本次要写的块：校验和 -> 序号
+    std::unordered_map<uint64_t, unsigned int> repeats;       // 本次要写的块被后面的块引用的次数
+    std::unordered_map<uint64_t, unsigned int> new_refs;      // 索引中的块增加的引用数
+    bool sharing = false;
+    for (uint64_t k = 0; k < count; k++) {
+        if (is_zero_block(data[k], block_size)) {
+            actions[k] = DEDUP_ZERO;
+            continue;
+        }
+        auto start = std::chrono::steady_clock::now();
+        hashes[k] = block_checksum(data[k]);
+        dedup_stats.hash_ns += elapsed_ns(start);
+
+        start = std::chrono::steady_clock::now();
+        auto same = written.find(hashes[k]);
+        unsigned int same_refs = same == written.end() ? 0 : repeats[same->second];
+        if (same != written.end() && same_refs < 0xFFFF && memcmp(data[same->second], data[k], block_size) == 0) {
+            actions[k] = DEDUP_REPEAT;
+            targets[k] = same->second;
+            repeats[same->second]++;
+            sharing = true;
+        } else {
+            uint64_t found = dedup_lookup(hashes[k], data[k]);
+            // 引用计数不能溢出
+            unsigned int refs = 0;
+            if (found != 0) {
+                auto pending = new_refs.find(found);
+                refs = (block_refcount.empty() ? 0 : block_refcount[found]) + (pending == new_refs.end() ? 0 : pending->second);
+            }
+            if (found != 0 && found == block_map.get(first + k)) {
+                actions[k] = DEDUP_UNCHANGED;
+            } else if (found != 0 && refs < 0xFFFF) {
+                actions[k] = DEDUP_SHARE;
+                targets[k] = found;
+                new_refs[found]++;
+                sharing = true;
+            } else if (same == written.end() || same_refs >= 0xFFFF) {
+                written[hashes[k]] = k;
+            }
+        }
+        dedup_stats.lookup_ns += elapsed_ns(start);
+    }
+
+    // 先给要引用的已有块加上引用，之后原来的块无论释放还是改写都不会影响它们
+    if (sharing && block_refcount.empty() && !create_refcount_table()) {
+        if (map_changed) store_block_map(inode, block_map);
+        return false;
+    }
+    for (auto& [block_number, refs] : new_refs) {
+        block_refcount[block_number] += refs;
+        write_refcounts(block_number, 1);
+    }
+
+    // 原来的块没有被共享时原地写入，空洞和共享的块写到新分配的块中，尽量紧接在前一个逻辑块之后
+    uint64_t needed = 0;
+    for (uint64_t k = 0; k < count; k++) {
+        uint64_t current = block_map.get(first + k);
+        if (actions[k] == DEDUP_WRITE && (!maps_data_block(current) || is_shared(current))) needed++;
+    }
+    std::vector<std::pair<uint64_t, uint64_t>> runs;
+    uint64_t hint = (first > 0 && maps_data_block(block_map.get(first - 1))) ? block_map.get(first - 1) + 1 : 0;
+    for (uint64_t allocated_blocks = 0; allocated_blocks < needed;) {
+        uint64_t start;
+        uint64_t allocated = allocate_data_blocks(needed - allocated_blocks, hint, start);
+        if (allocated == 0) {
+            // 分配失败，归还本次分配的块并撤销加上的引用
+            for (auto& run : runs) {
+                free_data_blocks(run.first, run.second);
+            }
+            for (auto& [block_number, refs] : new_refs) {
+                block_refcount[block_number] -= refs;
+                write_refcounts(block_number, 1);
+            }
+            if (map_changed) store_block_map(inode, block_map);
+            return false;
+        }
+        runs.push_back({start, allocated});
+        allocated_blocks += allocated;
+        hint = start + allocated;
+    }
+
+    std::vector<uint64_t> old_blocks;  // 不再引用的原来的块，最后一起释放 (共享的只减少引用数)
+    auto run = runs.begin();
+    uint64_t used = 0;
+    for (uint64_t k = 0; k < count; k++) {
+        uint64_t current = block_map.get(first + k);
+        if (actions[k] != DEDUP_WRITE || (maps_data_block(current) && !is_shared(current))) continue;
+        if (maps_data_block(current)) old_blocks.push_back(current);
+        block_map[first + k] = run->first + used;
+        if (++used == run->second) {
+            ++run;
+            used = 0;
+        }
+        map_changed = true;
+    }
+    // 物理上连续、数据在缓冲区中也连续的块合并为一次写入
+    for (uint64_t k = 0; k < count;) {
+        if (actions[k] != DEDUP_WRITE) {
+            k++;
+            continue;
+        }
+        uint64_t block_number = block_map.get(first + k);
+        uint64_t length_blocks = 1;
+        while (k + length_blocks < count && actions[k + length_blocks] == DEDUP_WRITE &&
+               block_map.get(first + k + length_blocks) == block_number + length_blocks &&
+               data[k + length_blocks] == data[k] + length_blocks * block_size) {
+            length_blocks++;
+        }
+        write_data_blocks(block_number, length_blocks, data[k]);
+        k += length_blocks;
+    }
+
+    // 写完后再改映射：重复的块引用已有的块或本次写下的块，全为 0 的块变成空洞
+    std::vector<std::pair<uint32_t, uint64_t>> inserted;
+    for (uint64_t k = 0; k < count; k++) {
+        uint64_t current = block_map.get(first + k);
+        switch (actions[k]) {
+        case DEDUP_WRITE:
+            inserted.push_back({hashes[k], current});
+            break;
+        case DEDUP_REPEAT: {
+            uint64_t block_number = block_map.get(first + targets[k]);
+            block_refcount[block_number]++;
+            write_refcounts(block_number, 1);
+            if (maps_data_block(current)) old_blocks.push_back(current);
+            block_map[first + k] = block_number;
+            map_changed = true;
+            dedup_stats.duplicate_blocks++;
+            break;
+        }
+        case DEDUP_SHARE:
+            if (maps_data_block(current)) old_blocks.push_back(current);
+            block_map[first + k] = targets[k];
+            map_changed = true;
+            dedup_stats.duplicate_blocks++;
+            break;
+        case DEDUP_ZERO:
+            if (maps_data_block(current)) old_blocks.push_back(current);
+            if (current != 0) {
+                block_map[first + k] = 0;
+                map_changed = true;
+            }
+            dedup_stats.zero_blocks++;
+            break;
+        case DEDUP_UNCHANGED:
+            dedup_stats.unchanged_blocks++;
+            break;
+        }
+    }
+    dedup_stats.written_blocks += count;
+
+    // 原来的块按块号排序，连续的一起释放
+    std::sort(old_blocks.begin(), old_blocks.end());
+    for (size_t i = 0; i < old_blocks.size();) {
+        size_t n = 1;
+        while (i + n < old_blocks.size() && old_blocks[i + n] == old_blocks[i] + n) n++;
+        free_data_blocks(old_blocks[i], n);
+        i += n;
+    }
+    dedup_insert(inserted);
+    return !map_changed || store_block_map(inode, block_map);
+}
+
+// 输出去重统计
+void MyFileSystem::dedup_report() {
+    OperationScope operation(*this);
+    const DedupStats& stats = dedup_stats;
+    auto ms = [](uint64_t ns) { return ns / 1e6; };
+    auto ratio = [](uint64_t a, uint64_t b) { return b == 0 ? 0.0 : (double)a / b; };
+    std::cout << std::fixed << std::setprecision(2);
+    std::cout << "Deduplication: " << (mount_options.dedup ? "on" : "off");
+    if (superblock.dedup_start != 0) {
+        std::cout << ", index " << superblock.dedup_buckets << " buckets x " << dedup_bucket_entries() << " entries, "
+                  << std::count(dedup_indexed.begin(), dedup_indexed.end(), 1) << " in use";
+    }
+    std::cout << std::endl;
+    uint64_t stored = stats.written_blocks - stats.duplicate_blocks - stats.zero_blocks - stats.unchanged_blocks;
+    std::cout << "Written: " << stats.written_blocks << " blocks, " << stats.duplicate_blocks << " duplicates, "
+              << stats.zero_blocks << " zero, " << stats.unchanged_blocks << " unchanged, " << stored
+              << " stored (dedup ratio " << ratio(stats.written_blocks, stored) << ")" << std::endl;
+    std::cout << "Lookup overhead: hash " << ms(stats.hash_ns) << " ms, index lookup " << ms(stats.lookup_ns) << " ms ("
+              << ratio(stats.hash_ns + stats.lookup_ns, stats.written_blocks) << " ns per block), "
+              << stats.hash_mismatches << " hash collisions" << std::endl;
+    std::cout << "Bucket cache: " << stats.cache_hits << " hits, " << stats.bucket_reads << " misses (hit rate "
+              << 100.0 * ratio(stats.cache_hits, stats.cache_hits + stats.bucket_reads) << "%), " << stats.evictions
+              << " entries evicted" << std::endl;
+
+    // 镜像中文件引用的数据块 (包括克隆共享的)，同一个块被引用多次只占一份空间
+    uint64_t references = 0;
+    uint64_t unique = 0;
+    std::vector<char> seen(superblock.data_block_count, 0);
+    std::vector<Inode> inodes(DEDUP_SCAN_CHUNK);
+    BlockMap block_map;
+    for (unsigned int first = 1; first < superblock.inode_count; first += DEDUP_SCAN_CHUNK) {
+        unsigned int count = std::min(DEDUP_SCAN_CHUNK, superblock.inode_count - first);
+        read_inodes(first, count, inodes.data());
+        for (unsigned int i = 0; i < count; i++) {
+            if (!inodes[i].used || inodes[i].type != REGULAR_FILE) continue;
+            load_block_map(inodes[i], block_map);
+            for (uint64_t block_number : block_map) {
+                if (!maps_data_block(block_number) || block_number >= superblock.data_block_count) continue;
+                references++;
+                if (!seen[block_number]) {
+                    seen[block_number] = 1;
+                    unique++;
+                }
+            }
+        }
+    }
+    std::cout << "On disk: " << references << " block references to " << unique << " data blocks (saved "
+              << (references - unique) * block_size / 1024 << "K, ratio " << ratio(references, unique) << ")" << std::endl;
+    std::cout.unsetf(std::ios::fixed);
+}
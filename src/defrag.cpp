@@ -0,0 +1,192 @@
+#include "myfs.h"
+#include <iomanip>
+#include <algorithm>
+
+// 每批搬移的最大块数，限制单次占用的缓冲区和整理过程中的停顿
+const unsigned int DEFRAG_BATCH_BLOCKS = 64;
+// 扫描 inode 表时每次读取的 inode 数
+const unsigned int INODE_SCAN_CHUNK = 256;
+
+// 打印一组碎片统计
+static void print_frag_stats(const std::string& name, const FragStats& stats) {
+    double average_gap = stats.gaps == 0 ? 0.0 : (double)stats.total_gap / stats.gaps;
+    double extents_per_file = stats.files == 0 ? 0.0 : (double)stats.extents / stats.files;
+    std::cout << name << ": files " << stats.files
+              << ", blocks " << stats.blocks
+              << ", extents " << stats.extents
+              << ", extents/file " << std::fixed << std::setprecision(2) << extents_per_file
+              << ", average gap " << average_gap << " blocks" << std::endl;
+    std::cout.unsetf(std::ios::fixed);
+}
+
+// 统计块映射表的碎片情况
+FragStats MyFileSystem::block_map_fragmentation(const BlockMap& block_map) {
+    FragStats stats;
+    uint64_t previous = 0;
+    for (uint64_t block_number : block_map) {
+        if (!maps_data_block(block_number)) continue;
+        stats.blocks++;
+        if (previous == 0 || block_number != previous + 1) {
+            stats.extents++;
+            if (previous != 0) {
+                // 相邻区段之间跨过的块数
+                stats.total_gap += block_number > previous ? block_number - previous - 1 : previous - block_number + 1;
+                stats.gaps++;
+            }
+        }
+        previous = block_number;
+    }
+    return stats;
+}
+
+// 输出碎片报告
+bool MyFileSystem::frag_report(const std::string& path) {
+    TraceScope trace(trace_writer.get(), TRACE_FRAG_REPORT, -1, 0, 0, path);
+    OperationScope operation(*this);
+    if (!path.empty() && path != "/") {
+        int inode_number = path_to_inode(path);
+        if (inode_number == -1) {
+            std::cerr << "File does not exist." << std::endl;
+            return false;
+        }
+        Inode inode = read_inode(inode_number);
+        if (inode.type != REGULAR_FILE) {
+            std::cerr << "Not a regular file." << std::endl;
+            return false;
+        }
+        BlockMap block_map;
+        load_block_map(inode, block_map);
+        FragStats stats = block_map_fragmentation(block_map);
+        stats.files = 1;
+        print_frag_stats(path, stats);
+        return true;
+    }
+
+    // 扫描整个 inode 表
+    FragStats total;
+    std::vector<Inode> inodes(INODE_SCAN_CHUNK);
+    BlockMap block_map;
+    for (unsigned int first = 1; first < superblock.inode_count; first += INODE_SCAN_CHUNK) {
+        unsigned int count = std::min(INODE_SCAN_CHUNK, superblock.inode_count - first);
+        read_inodes(first, count, inodes.data());
+        for (unsigned int i = 0; i < count; i++) {
+            if (!inodes[i].used || inodes[i].type != REGULAR_FILE) continue;
+            load_block_map(inodes[i], block_map);
+            FragStats stats = block_map_fragmentation(block_map);
+            total.files++;
+            total.blocks += stats.blocks;
+            total.extents += stats.extents;
+            total.total_gap += stats.total_gap;
+            total.gaps += stats.gaps;
+        }
+    }
+    print_frag_stats("Image", total);
+    std::cout << "Free space: " << allocator.free_blocks() << " blocks in " << allocator.extent_count()
+              << " extents, largest " << allocator.largest_extent() << " blocks" << std::endl;
+    return true;
+}
+
+// 在线碎片整理
+bool MyFileSystem::defrag(const std::string& path) {
+    TraceScope trace(trace_writer.get(), TRACE_DEFRAG, -1, 0, 0, path);
+    OperationScope operation(*this);
+    if (!path.empty() && path != "/") {
+        int inode_number = path_to_inode(path);
+        if (inode_number == -1) {
+            std::cerr << "File does not exist." << std::endl;
+            return false;
+        }
+        if (read_inode(inode_number).type != REGULAR_FILE) {
+            std::cerr << "Not a regular file." << std::endl;
+            return false;
+        }
+        bool moved = defrag_file(inode_number);
+        std::cout << "Defragmented " << (moved ? 1 : 0) << " file(s)." << std::endl;
+        return true;
+    }
+
+    unsigned int moved = 0;
+    std::vector<Inode> inodes(INODE_SCAN_CHUNK);
+    for (unsigned int first = 1; first < superblock.inode_count; first += INODE_SCAN_CHUNK) {
+        unsigned int count = std::min(INODE_SCAN_CHUNK, superblock.inode_count - first);
+        read_inodes(first, count, inodes.data());
+        for (unsigned int i = 0; i < count; i++) {
+            if (!inodes[i].used || inodes[i].type != REGULAR_FILE) continue;
+            if (defrag_file(first + i)) moved++;
+        }
+    }
+    std::cout << "Defragmented " << moved << " file(s)." << std::endl;
+    return true;
+}
+
+// 整理单个文件
+bool MyFileSystem::defrag_file(unsigned int inode_number) {
+    Inode inode = read_inode(inode_number);
+    BlockMap block_map;
+    load_block_map(inode, block_map);
+
+    FragStats stats = block_map_fragmentation(block_map);
+    if (stats.extents <= 1) {
+        return false;
+    }
+    // 与克隆文件共享的块不搬移，否则会破坏共享
+    for (uint64_t block_number : block_map) {
+        if (maps_data_block(block_number) && is_shared(block_number)) {
+            return false;
+        }
+    }
+
+    // 先为整个文件预留一段连续空间，再分批搬移
+    uint64_t target;
+    if (!allocator.allocate(stats.blocks, 0, target)) {
+        return false;
+    }
+    update_bitmap_range(target, stats.blocks, true);
+    superblock.free_data_block_count -= stats.blocks;
+    write_superblock();
+
+    AlignedBuffer batch_buffer(DEFRAG_BATCH_BLOCKS * block_size);
+    uint64_t next_target = target;
+    uint64_t logical = 0;
+    while (logical < block_map.size()) {
+        // 收集一批逻辑块，压缩簇的标记留在原处，压缩数据块按顺序搬移
+        std::vector<uint64_t> batch;
+        while (logical < block_map.size() && batch.size() < DEFRAG_BATCH_BLOCKS) {
+            if (maps_data_block(block_map[logical])) batch.push_back(logical);
+            logical++;
+        }
+        if (batch.empty()) break;
+
+        // 复制数据到新位置，新块是连续的，合并成一次写入
+        bool readable = true;
+        for (size_t k = 0; k < batch.size(); k++) {
+            readable = read_data_block(block_map[batch[k]], batch_buffer.data() + k * block_size) && readable;
+        }
+        if (!readable) {
+            // 校验失败的数据不搬移，释放还没用上的预留空间
+            free_data_blocks(next_target, target + stats.blocks - next_target);
+            return false;
+        }
+        write_data_blocks(next_target, batch.size(), batch_buffer.data());
+
+        // 新数据落盘后再切换块映射，旧块此时仍保持原内容，中途崩溃不会丢数据
+        std::vector<uint64_t> old_blocks;
+        for (size_t k = 0; k < batch.size(); k++) {
+            old_blocks.push_back(block_map[batch[k]]);
+            block_map[batch[k]] = next_target + k;
+        }
+        store_block_map(inode, block_map);
+        write_inode(inode_number, inode);
+        // 旧块按物理地址排序后合并释放
+        std::sort(old_blocks.begin(), old_blocks.end());
+        size_t run = 0;
+        for (size_t k = 1; k <= old_blocks.size(); k++) {
+            if (k == old_blocks.size() || old_blocks[k] != old_blocks[k - 1] + 1) {
+                free_data_blocks(old_blocks[run], k - run);
+                run = k;
+            }
+        }
+        next_target += batch.size();
+    }
+    return true;
+}
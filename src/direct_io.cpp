@@ -0,0 +1,76 @@
+#include "myfs.h"
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+
+// 以 O_DIRECT 打开各设备
+void MyFileSystem::open_direct() {
+    close_direct();
+    if (!mount_options.direct) {
+        return;
+    }
+#ifdef O_DIRECT
+    if (block_size % DIRECT_IO_ALIGNMENT != 0) {
+        std::cerr << "Block size " << block_size << " is too small for direct I/O, using buffered I/O." << std::endl;
+        return;
+    }
+    direct_fds.assign(device_paths.size(), -1);
+    for (size_t i = 0; i < device_paths.size(); i++) {
+        // 旧镜像的数据区紧跟在 inode 表之后，不一定对齐
+        if (i == 0 && stripe.primary_base % DIRECT_IO_ALIGNMENT != 0) {
+            std::cerr << "Data area of " << device_paths[i] << " is not aligned, using buffered I/O." << std::endl;
+            continue;
+        }
+        direct_fds[i] = ::open(device_paths[i].c_str(), O_RDWR | O_DIRECT);
+        if (direct_fds[i] == -1) {
+            // 如 tmpfs 不支持 O_DIRECT
+            std::cerr << "Direct I/O is not available for " << device_paths[i] << ", using buffered I/O." << std::endl;
+        }
+    }
+    // 之后数据区绕过文件流，先把流中缓冲的写入落盘
+    flush_devices();
+#else
+    std::cerr << "Direct I/O is not supported on this platform, using buffered I/O." << std::endl;
+#endif
+}
+
+// 关闭 O_DIRECT 文件描述符
+void MyFileSystem::close_direct() {
+    for (int fd : direct_fds) {
+        if (fd != -1) ::close(fd);
+    }
+    direct_fds.clear();
+}
+
+// 通过 O_DIRECT 文件描述符读写
+bool MyFileSystem::direct_io(int fd, uint64_t offset, char* buffer, uint64_t length, bool write) {
+    // 分多次完成一段读写，被信号打断时重试
+    auto transfer = [&](uint64_t position, char* data, uint64_t bytes) {
+        while (bytes > 0) {
+            ssize_t done = write ? ::pwrite(fd, data, bytes, position) : ::pread(fd, data, bytes, position);
+            if (done < 0 && errno == EINTR) continue;
+            if (done <= 0) {
+                std::cerr << "Direct I/O failed at offset " << position << "." << std::endl;
+                return false;
+            }
+            position += done;
+            data += done;
+            bytes -= done;
+        }
+        return true;
+    };
+    if (reinterpret_cast<uintptr_t>(buffer) % DIRECT_IO_ALIGNMENT == 0) {
+        // 对齐的缓冲区直接交给磁盘，不经过任何中间拷贝
+        return transfer(offset, buffer, length);
+    }
+    // 调用者的缓冲区没有对齐，经池中的缓冲区分段中转
+    PooledBuffer bounce(buffer_pool);
+    for (uint64_t done = 0; done < length;) {
+        uint64_t bytes = std::min<uint64_t>(PooledBuffer::size(), length - done);
+        if (write) memcpy(bounce.data(), buffer + done, bytes);
+        if (!transfer(offset + done, bounce.data(), bytes)) return false;
+        if (!write) memcpy(buffer + done, bounce.data(), bytes);
+        done += bytes;
+    }
+    return true;
+}
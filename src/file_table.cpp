@@ -0,0 +1,315 @@
+#include "myfs.h"
+
+// 同时打开的文件句柄数上限
+const unsigned int MAX_OPEN_FILES = 1024;
+// 顺序读的预读窗口从这个大小开始，每次加倍，直到上限
+const uint64_t READAHEAD_MIN_BYTES = 16 * 1024;
+const uint64_t READAHEAD_MAX_BYTES = 256 * 1024;
+
+// 打开文件
+int MyFileSystem::open(const std::string& path) {
+    TraceScope trace(trace_writer.get(), TRACE_OPEN, -1, 0, 0, path);
+    OperationScope operation(*this);
+    int inode_number = path_to_inode(path);
+    if (inode_number == -1) {
+        std::cerr << "File does not exist." << std::endl;
+        return -1;
+    }
+
+    Inode inode = read_inode(inode_number);
+    if (inode.type != REGULAR_FILE) {
+        std::cerr << "Not a regular file." << std::endl;
+        return -1;
+    }
+
+    // 优先复用已关闭的表项
+    int fd = 0;
+    while (fd < (int)open_files.size() && open_files[fd].inode_number != -1) fd++;
+    if (fd == (int)open_files.size()) {
+        if (open_files.size() >= MAX_OPEN_FILES) {
+            std::cerr << "Too many open files." << std::endl;
+            return -1;
+        }
+        open_files.emplace_back();
+    }
+    open_files[fd] = FileHandle();
+    open_files[fd].inode_number = inode_number;
+
+    // 第一个句柄把 inode 读入缓存，之后的读写和访问时间更新都只改内存
+    CachedInode& cached = inode_cache[inode_number];
+    if (cached.handles == 0) {
+        cached.inode = inode;
+    }
+    cached.handles++;
+
+    //更新访问时间
+    touch_atime(inode_number, inode);
+
+    trace.set_fd(fd);
+    return fd;
+}
+
+// 关闭文件句柄
+bool MyFileSystem::close(int fd) {
+    TraceScope trace(trace_writer.get(), TRACE_CLOSE, fd);
+    OperationScope operation(*this);
+    if (fd < 0 || fd >= (int)open_files.size() || open_files[fd].inode_number == -1) {
+        std::cerr << "Invalid file handle." << std::endl;
+        return false;
+    }
+    FileHandle& handle = open_files[fd];
+    if (!handle.removed) {
+        // 最后一个句柄关闭时写回 inode 并移出缓存
+        auto it = inode_cache.find(handle.inode_number);
+        if (it != inode_cache.end() && --it->second.handles == 0) {
+            if (it->second.dirty) {
+                Inode inode = read_inode(handle.inode_number);
+                lazy_atimes.erase(handle.inode_number);
+                store_inode(handle.inode_number, inode);
+            }
+            inode_cache.erase(it);
+        }
+    }
+    handle = FileHandle();
+    return true;
+}
+
+// 取得有效的文件句柄
+FileHandle* MyFileSystem::file_handle(int fd) {
+    if (fd < 0 || fd >= (int)open_files.size() || open_files[fd].inode_number == -1) {
+        std::cerr << "Invalid file handle." << std::endl;
+        return nullptr;
+    }
+    if (open_files[fd].removed) {
+        std::cerr << "File has been removed." << std::endl;
+        return nullptr;
+    }
+    return &open_files[fd];
+}
+
+// 读取文件
+bool MyFileSystem::read(int fd, uint64_t offset, unsigned int length, char* buffer) {
+    TraceScope trace(trace_writer.get(), TRACE_READ, fd, offset, length);
+    OperationScope operation(*this);
+    FileHandle* handle = file_handle(fd);
+    if (!handle) {
+        return false;
+    }
+    unsigned int inode_number = handle->inode_number;
+    bool sequential = offset == handle->next_offset;
+    handle->next_offset = offset + length;
+    uint64_t max_blocks = std::max<uint64_t>(1, READAHEAD_MAX_BYTES / block_size);
+    if (!sequential || length > max_blocks * block_size) {
+        // 随机读或一次读得足够多时不预读
+        handle->readahead_blocks = 0;
+        return read_file(inode_number, offset, length, buffer);
+    }
+
+    Inode inode = read_inode(inode_number);
+    if (offset >= inode.size) {
+        std::cerr << "Offset out of range." << std::endl;
+        return false;
+    }
+    uint64_t bytes = std::min<uint64_t>(length, inode.size - offset);
+    uint64_t buffered_start = handle->readahead_start * block_size;
+    if (handle->readahead_generation != data_generation || offset < buffered_start ||
+        offset + bytes > buffered_start + handle->readahead.size()) {
+        // 预读缓冲区用完或已作废，窗口加倍后重新预读
+        uint64_t min_blocks = std::max<uint64_t>(1, READAHEAD_MIN_BYTES / block_size);
+        uint64_t needed = (offset % block_size + bytes + block_size - 1) / block_size;
+        handle->readahead_blocks = std::min(max_blocks, std::max(min_blocks, handle->readahead_blocks * 2));
+        handle->readahead_blocks = std::max(handle->readahead_blocks, needed);
+        if (!fill_readahead(*handle, inode, offset / block_size, handle->readahead_blocks)) {
+            return false;
+        }
+        buffered_start = handle->readahead_start * block_size;
+    }
+    memcpy(buffer, handle->readahead.data() + (offset - buffered_start), bytes);
+
+    //更新访问时间
+    touch_atime(inode_number, inode);
+    return true;
+}
+
+// 从当前位置读取
+bool MyFileSystem::read(int fd, unsigned int length, char* buffer, unsigned int& bytes_read) {
+    TraceScope trace(trace_writer.get(), TRACE_READ_AT, fd, 0, length);
+    OperationScope operation(*this);
+    bytes_read = 0;
+    FileHandle* handle = file_handle(fd);
+    if (!handle) {
+        return false;
+    }
+    uint64_t size = read_inode(handle->inode_number).size;
+    if (handle->position >= size || length == 0) {
+        return true;
+    }
+    unsigned int bytes = std::min<uint64_t>(length, size - handle->position);
+    if (!read(fd, handle->position, bytes, buffer)) {
+        return false;
+    }
+    handle->position += bytes;
+    bytes_read = bytes;
+    return true;
+}
+
+// 写入文件
+bool MyFileSystem::write(int fd, uint64_t offset, unsigned int length, const char* buffer) {
+    TraceScope trace(trace_writer.get(), TRACE_WRITE, fd, offset, length);
+    OperationScope operation(*this);
+    FileHandle* handle = file_handle(fd);
+    if (!handle) {
+        return false;
+    }
+    return write_file(handle->inode_number, offset, length, buffer);
+}
+
+// 从当前位置写入
+bool MyFileSystem::write(int fd, unsigned int length, const char* buffer) {
+    TraceScope trace(trace_writer.get(), TRACE_WRITE_AT, fd, 0, length);
+    OperationScope operation(*this);
+    FileHandle* handle = file_handle(fd);
+    if (!handle || !write_file(handle->inode_number, handle->position, length, buffer)) {
+        return false;
+    }
+    handle->position += length;
+    return true;
+}
+
+// 设置当前位置
+bool MyFileSystem::seek(int fd, uint64_t position) {
+    TraceScope trace(trace_writer.get(), TRACE_SEEK, fd, position);
+    OperationScope operation(*this);
+    FileHandle* handle = file_handle(fd);
+    if (!handle) {
+        return false;
+    }
+    handle->position = position;
+    return true;
+}
+
+// 修改文件大小
+bool MyFileSystem::truncate(int fd, uint64_t size) {
+    TraceScope trace(trace_writer.get(), TRACE_TRUNCATE, fd, size);
+    OperationScope operation(*this);
+    FileHandle* handle = file_handle(fd);
+    return handle && truncate_file(handle->inode_number, size);
+}
+
+// 预留数据块
+bool MyFileSystem::fallocate(int fd, uint64_t offset, uint64_t length) {
+    TraceScope trace(trace_writer.get(), TRACE_FALLOCATE, fd, offset, length);
+    OperationScope operation(*this);
+    FileHandle* handle = file_handle(fd);
+    return handle && fallocate_file(handle->inode_number, offset, length);
+}
+
+// 预读
+bool MyFileSystem::fill_readahead(FileHandle& handle, const Inode& inode, uint64_t first, uint64_t count) {
+    uint64_t file_blocks = (inode.size + block_size - 1) / block_size;
+    count = std::min(count, file_blocks - first);
+    BlockMap local_map;
+    const BlockMap& block_map = file_block_map(handle.inode_number, inode, local_map);
+    handle.readahead.resize(count * block_size);
+    handle.readahead_generation = 0;
+    // 物理上连续的块合并为一次读取
+    for (uint64_t i = 0; i < count;) {
+        uint64_t block_number = block_map.get(first + i);
+        uint64_t run = 1;
+        if (in_compressed_cluster(block_map, first + i)) {
+            // 压缩簇经簇缓存解压
+            const char* cluster = read_cluster(block_map, (first + i) / COMPRESS_CLUSTER_BLOCKS);
+            if (!cluster) {
+                handle.readahead.clear();
+                return false;
+            }
+            memcpy(handle.readahead.data() + i * block_size,
+                   cluster + (first + i) % COMPRESS_CLUSTER_BLOCKS * block_size, block_size);
+        } else if (block_number == 0) {
+            // 空洞读出为 0
+            memset(handle.readahead.data() + i * block_size, 0, block_size);
+        } else {
+            while (i + run < count && block_map.get(first + i + run) == block_number + run) run++;
+            if (!read_data_blocks(block_number, run, handle.readahead.data() + i * block_size)) {
+                handle.readahead.clear();
+                return false;
+            }
+        }
+        i += run;
+    }
+    handle.readahead_start = first;
+    handle.readahead_generation = data_generation;
+    return true;
+}
+
+// 更新缓存的 inode
+void MyFileSystem::update_cached_inode(CachedInode& cached, const Inode& inode) {
+    const Inode& old = cached.inode;
+    if (old.size != inode.size || old.indirect_block != inode.indirect_block ||
+        old.double_indirect_block != inode.double_indirect_block ||
+        memcmp(old.direct_blocks, inode.direct_blocks, sizeof(inode.direct_blocks)) != 0) {
+        data_generation++;
+    }
+    cached.inode = inode;
+    cached.dirty = true;
+}
+
+// 文件被删除
+void MyFileSystem::drop_cached_inode(unsigned int inode_number) {
+    inode_cache.erase(inode_number);
+    for (auto& handle : open_files) {
+        if (handle.inode_number == (int)inode_number) {
+            handle.removed = true;
+        }
+    }
+    data_generation++;
+}
+
+// 取得文件的块映射表
+BlockMap& MyFileSystem::file_block_map(unsigned int inode_number, const Inode& inode, BlockMap& local) {
+    if (!inode_cache.empty()) {
+        auto it = inode_cache.find(inode_number);
+        if (it != inode_cache.end()) {
+            CachedInode& cached = it->second;
+            if (cached.map_generation != data_generation) {
+                load_block_map(inode, cached.block_map);
+                cached.map_generation = data_generation;
+            }
+            return cached.block_map;
+        }
+    }
+    load_block_map(inode, local);
+    return local;
+}
+
+// 写入后重新标记缓存的块映射表为有效
+void MyFileSystem::keep_block_map(unsigned int inode_number) {
+    if (inode_cache.empty()) return;
+    auto it = inode_cache.find(inode_number);
+    if (it != inode_cache.end()) {
+        it->second.map_generation = data_generation;
+    }
+}
+
+// 写回打开文件的 inode
+void MyFileSystem::write_back_inodes() {
+    for (auto& [inode_number, cached] : inode_cache) {
+        if (!cached.dirty) continue;
+        // 连同 lazytime 缓存的访问时间一起写
+        Inode inode = read_inode(inode_number);
+        lazy_atimes.erase(inode_number);
+        cached.inode = inode;
+        cached.dirty = false;
+        store_inode(inode_number, inode);
+    }
+}
+
+// 关闭所有文件句柄
+void MyFileSystem::close_all_files(bool write_back) {
+    if (write_back && disk.is_open()) {
+        write_back_inodes();
+    }
+    open_files.clear();
+    inode_cache.clear();
+    data_generation++;
+}
@@ -0,0 +1,648 @@
+#include "myfs.h"
+#include "thread_pool.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+
+// 每个扫描任务负责的 inode 数
+const unsigned int FSCK_CHUNK_INODES = 1024;
+
+// 扫描得到的目录项
+struct FsckEntry {
+    unsigned int parent;        // 所在目录的 inode 编号
+    unsigned int child;         // 目录项指向的 inode 编号
+    uint64_t block_number;      // 目录项所在的数据块
+    unsigned int slot;          // 在数据块中的下标
+};
+
+// 坏指针所在的位置
+enum FsckPointerKind {
+    FSCK_DATA_BLOCK,            // 指向数据块的指针，index 为逻辑块号
+    FSCK_INDIRECT_BLOCK,        // 一级间接块本身
+    FSCK_DOUBLE_INDIRECT_BLOCK, // 二级间接块本身
+    FSCK_LEVEL1_TABLE           // 二级间接块中的第 index 个一级表
+};
+
+// 越界或指向元数据区的块指针
+struct FsckBadPointer {
+    unsigned int inode_number;
+    FsckPointerKind kind;
+    uint64_t index;
+};
+
+// 一个 inode 表分块的扫描结果
+struct FsckChunkResult {
+    std::vector<FsckEntry> entries;
+    std::vector<FsckBadPointer> bad_pointers;
+    std::vector<std::pair<unsigned int, uint64_t>> bad_dir_sizes;  // (inode 编号, 正确的大小)
+    std::vector<unsigned int> bad_inode_checksums;   // 校验和不一致的 inode
+    std::vector<uint64_t> bad_block_checksums;       // 校验和不一致的间接块和目录块
+};
+
+// 各版本的 inode 表紧跟在格式化时的超级块结构体之后 (结构体大小按 8 字节对齐)
+static uint64_t inode_table_offset(unsigned int version) {
+    uint64_t size = superblock_disk_size(version);
+    return (size + alignof(Superblock) - 1) / alignof(Superblock) * alignof(Superblock);
+}
+
+// 挂载前检查超级块
+// 版本、块大小和 inode 数无法从镜像的其他部分推断，它们损坏时只能放弃；
+// 其余布局字段按格式化时的规则由这三者和镜像大小重新计算，指向无效位置的引用计数表和去重索引丢弃
+// (之后的检查会重建引用计数表，去重索引在下次去重写入时重新创建)
+bool MyFileSystem::check_superblock(bool repair, unsigned int& errors) {
+    if (disk.is_open()) {
+        return true;
+    }
+    disk.open(disk_file_path, std::ios::in | std::ios::out | std::ios::binary);
+    if (!disk.is_open()) {
+        std::cerr << "Unable to open disk file." << std::endl;
+        return false;
+    }
+    disk.seekg(0, std::ios::end);
+    uint64_t image_size = disk.tellg();
+    read_superblock();
+    block_size = superblock.block_size;
+    unsigned int found = 0;
+    auto report = [&](const std::string& problem) {
+        std::cout << problem << std::endl;
+        found++;
+    };
+
+    // 无法重建的字段
+    bool usable = true;
+    if (superblock.version < FS_MIN_VERSION || superblock.version > FS_VERSION) {
+        report("Unsupported superblock version " + std::to_string(superblock.version) + ".");
+        usable = false;
+    } else if (!is_supported_block_size(superblock.block_size)) {
+        report("Unsupported block size " + std::to_string(superblock.block_size) + ".");
+        usable = false;
+    } else if (superblock.inode_count == 0 ||
+               inode_table_offset(superblock.version) + (uint64_t)superblock.inode_count * INODE_SIZE >= image_size) {
+        report("Inode count " + std::to_string(superblock.inode_count) + " does not fit in the image.");
+        usable = false;
+    } else if (superblock.version >= 4 && (superblock.device_count == 0 || superblock.stripe_blocks == 0)) {
+        report("Invalid device layout.");
+        usable = false;
+    }
+    if (!usable) {
+        std::cout << "Superblock cannot be rebuilt, the image needs to be restored or reformatted." << std::endl;
+        errors += found;
+        disk.close();
+        return false;
+    }
+
+    if (superblock.magic_number != MAGIC_NUMBER) {
+        report("Bad magic number.");
+        superblock.magic_number = MAGIC_NUMBER;
+    }
+    // 单设备镜像格式化时正好扩展到 total_size
+    if (superblock.total_size > image_size && superblock.device_count <= 1) {
+        report("Total size is " + std::to_string(superblock.total_size) + ", image is " + std::to_string(image_size) + ".");
+        superblock.total_size = image_size;
+    }
+    uint64_t inode_start = inode_table_offset(superblock.version);
+    if (superblock.free_inode_start != inode_start) {
+        report("Inode table starts at " + std::to_string(superblock.free_inode_start) + ", should be " + std::to_string(inode_start) + ".");
+        superblock.free_inode_start = inode_start;
+    }
+    // 数据区紧跟在 inode 表之后，新镜像再向上对齐到 DIRECT_IO_ALIGNMENT
+    uint64_t inode_table_end = inode_start + (uint64_t)superblock.inode_count * INODE_SIZE;
+    if (superblock.free_data_block_start < inode_table_end ||
+        superblock.free_data_block_start - inode_table_end >= DIRECT_IO_ALIGNMENT) {
+        uint64_t data_start = (inode_table_end + DIRECT_IO_ALIGNMENT - 1) / DIRECT_IO_ALIGNMENT * DIRECT_IO_ALIGNMENT;
+        report("Data area starts at " + std::to_string(superblock.free_data_block_start) + ", should be " + std::to_string(data_start) + ".");
+        superblock.free_data_block_start = data_start;
+    }
+    uint64_t data_blocks = superblock.total_size > superblock.free_data_block_start
+                               ? (superblock.total_size - superblock.free_data_block_start) / block_size : 0;
+    if (superblock.data_block_count != data_blocks) {
+        report("Data block count is " + std::to_string(superblock.data_block_count) + ", should be " + std::to_string(data_blocks) + ".");
+        superblock.data_block_count = data_blocks;
+    }
+    uint64_t metadata_start = bitmap_start_block();
+    uint64_t metadata_end = metadata_start + calculate_bitmap_blocks();
+    if (metadata_end >= superblock.data_block_count) {
+        report("Image is too small for its inode table and bitmap.");
+        std::cout << "Superblock cannot be rebuilt, the image needs to be restored or reformatted." << std::endl;
+        errors += found;
+        disk.close();
+        return false;
+    }
+    // 校验和表紧跟在位图之后
+    if (superblock.checksum_start != 0 && superblock.checksum_start != metadata_end) {
+        report("Checksum table starts at block " + std::to_string(superblock.checksum_start) + ", should be " + std::to_string(metadata_end) + ".");
+        superblock.checksum_start = metadata_end;
+    }
+    if (superblock.checksum_start != 0) {
+        metadata_end += checksum_table_blocks();
+    }
+    // 引用计数表和去重索引由分配器分配，不能包含 0 号块、越界或与位图、校验和表重叠
+    auto misplaced = [&](uint64_t start, uint64_t count) {
+        return start == 0 || start + count > superblock.data_block_count ||
+               (start < metadata_end && start + count > metadata_start);
+    };
+    uint64_t refcount_blocks = (superblock.data_block_count * sizeof(unsigned short) + block_size - 1) / block_size;
+    if (superblock.refcount_start != 0 && misplaced(superblock.refcount_start, refcount_blocks)) {
+        report("Reference count table at block " + std::to_string(superblock.refcount_start) + " is out of range.");
+        superblock.refcount_start = 0;
+    }
+    if (superblock.dedup_start != 0 && misplaced(superblock.dedup_start, superblock.dedup_buckets)) {
+        report("Deduplication index at block " + std::to_string(superblock.dedup_start) + " is out of range.");
+        superblock.dedup_start = 0;
+        superblock.dedup_buckets = 0;
+    }
+    // 字段都没问题时再核对校验和，前面有修改的字段校验和必然不符，不再重复报告
+    if (found == 0 && superblock.version >= 3 && superblock.checksum != superblock_checksum()) {
+        report("Superblock checksum mismatch.");
+    }
+
+    errors += found;
+    if (found > 0 && repair) {
+        if (superblock.version >= 3) {
+            superblock.checksum = superblock_checksum();
+        }
+        disk.seekp(0, std::ios::beg);
+        disk.write(reinterpret_cast<const char*>(&superblock), superblock_disk_size(superblock.version));
+        disk.flush();
+        if (!disk) {
+            std::cerr << "Unable to write superblock." << std::endl;
+            disk.close();
+            return false;
+        }
+        std::cout << "Superblock repaired." << std::endl;
+    } else if (found > 0) {
+        std::cout << "Superblock is damaged, run fsck -y to repair it." << std::endl;
+    }
+    disk.close();
+    return found == 0 || repair;
+}
+
+// 一致性检查
+unsigned int MyFileSystem::fsck(bool repair, unsigned int thread_count) {
+    TraceScope trace(trace_writer.get(), TRACE_FSCK, -1, repair, thread_count);
+    OperationScope operation(*this);
+    auto begin_time = std::chrono::steady_clock::now();
+    const unsigned int entries_per_block = block_size / DIRECTORY_ENTRY_SIZE;
+    unsigned int errors = 0;
+    unsigned int repaired = 0;
+
+    // 检查超级块中的布局信息
+    // 数据区紧跟在 inode 表之后，新镜像再向上对齐到 DIRECT_IO_ALIGNMENT
+    uint64_t inode_table_end = superblock.free_inode_start + (uint64_t)superblock.inode_count * INODE_SIZE;
+    if (superblock.free_data_block_start < inode_table_end ||
+        superblock.free_data_block_start - inode_table_end >= DIRECT_IO_ALIGNMENT ||
+        bitmap_start_block() + calculate_bitmap_blocks() > superblock.data_block_count) {
+        std::cout << "Superblock layout is inconsistent, giving up." << std::endl;
+        return 1;
+    }
+
+    // 不能分配给文件的块：0 号块、位图、校验和表、引用计数表和去重索引
+    std::vector<char> reserved(superblock.data_block_count, 0);
+    reserved[0] = 1;
+    for (uint64_t i = 0; i < calculate_bitmap_blocks(); i++) {
+        reserved[bitmap_start_block() + i] = 1;
+    }
+    if (superblock.checksum_start != 0) {
+        for (uint64_t i = 0; i < checksum_table_blocks(); i++) {
+            reserved[superblock.checksum_start + i] = 1;
+        }
+    }
+    uint64_t refcount_blocks = 0;
+    if (superblock.refcount_start != 0) {
+        refcount_blocks = (superblock.data_block_count * sizeof(unsigned short) + block_size - 1) / block_size;
+        for (uint64_t i = 0; i < refcount_blocks; i++) {
+            reserved[superblock.refcount_start + i] = 1;
+        }
+    }
+    for (uint64_t i = 0; i < superblock.dedup_buckets && superblock.dedup_start != 0; i++) {
+        reserved[superblock.dedup_start + i] = 1;
+    }
+
+    // 第一阶段：多线程扫描 inode 表，统计块引用并收集目录项
+    std::vector<std::atomic<unsigned int>> block_refs(superblock.data_block_count);
+    std::vector<char> inode_used(superblock.inode_count, 0);
+    std::vector<char> inode_is_dir(superblock.inode_count, 0);
+    std::vector<char> inode_reclaiming(superblock.inode_count, 0);  // 已删除、等待后台回收
+    unsigned int chunk_count = (superblock.inode_count + FSCK_CHUNK_INODES - 1) / FSCK_CHUNK_INODES;
+    std::vector<FsckChunkResult> results(chunk_count);
+    // 扫描线程直接读镜像，打开文件的 inode 要先写回
+    write_back_inodes();
+    flush_writeback();
+    {
+        ThreadPool pool(thread_count);
+        for (unsigned int chunk = 0; chunk < chunk_count; chunk++) {
+            pool.submit([&, chunk] {
+                // 每个任务使用独立的文件句柄，互不干扰
+                std::unique_ptr<ImageReader> image = open_image_reader();
+                FsckChunkResult& result = results[chunk];
+                unsigned int first = chunk * FSCK_CHUNK_INODES;
+                unsigned int count = std::min(FSCK_CHUNK_INODES, superblock.inode_count - first);
+                std::vector<Inode> inodes(count);
+                image->primary().seekg(superblock.free_inode_start + (uint64_t)first * sizeof(Inode), std::ios::beg);
+                image->primary().read(reinterpret_cast<char*>(inodes.data()), count * sizeof(Inode));
+
+                std::vector<uint64_t> indirect(indirect_entries());
+                std::vector<uint64_t> level1(indirect_entries());
+                std::vector<char> block_buffer(block_size);
+                std::vector<uint64_t> directory_blocks;  // 目录映射到的目录块 (包括经过间接块映射的)
+                auto valid = [&](uint64_t block_number) {
+                    return block_number < superblock.data_block_count && !reserved[block_number];
+                };
+                // 读取一个间接块并统计其中的块指针，base 为第一项对应的逻辑块号
+                auto scan_table = [&](unsigned int inode_number, uint64_t table, uint64_t base) {
+                    image->read_blocks(table, 1, reinterpret_cast<char*>(indirect.data()));
+                    if (!block_checksum_matches(table, reinterpret_cast<const char*>(indirect.data()))) {
+                        result.bad_block_checksums.push_back(table);
+                    }
+                    for (unsigned int i = 0; i < indirect_entries(); i++) {
+                        if (!maps_data_block(indirect[i])) continue;
+                        if (!valid(indirect[i])) {
+                            result.bad_pointers.push_back({inode_number, FSCK_DATA_BLOCK, base + i});
+                            continue;
+                        }
+                        block_refs[indirect[i]]++;
+                        if (inodes[inode_number - first].type == DIRECTORY) {
+                            directory_blocks.push_back(indirect[i]);
+                        }
+                    }
+                };
+
+                for (unsigned int k = 0; k < count; k++) {
+                    unsigned int inode_number = first + k;
+                    const Inode& inode = inodes[k];
+                    if (!inode_checksum_matches(inode_number, inode)) {
+                        result.bad_inode_checksums.push_back(inode_number);
+                    }
+                    // 根目录格式化时没有设置 used 标记
+                    if (!inode.used && inode_number != 0) continue;
+                    inode_used[inode_number] = 1;
+                    inode_is_dir[inode_number] = inode.type == DIRECTORY;
+                    inode_reclaiming[inode_number] = inode.type == RECLAIMING;
+
+                    directory_blocks.clear();
+                    for (int i = 0; i < DIRECT_BLOCK_COUNT; i++) {
+                        uint64_t block_number = inode.direct_blocks[i];
+                        if (!maps_data_block(block_number)) continue;
+                        if (!valid(block_number)) {
+                            result.bad_pointers.push_back({inode_number, FSCK_DATA_BLOCK, (uint64_t)i});
+                            continue;
+                        }
+                        block_refs[block_number]++;
+                        if (inode.type == DIRECTORY) {
+                            directory_blocks.push_back(block_number);
+                        }
+                    }
+                    if (inode.indirect_block != 0) {
+                        if (!valid(inode.indirect_block)) {
+                            result.bad_pointers.push_back({inode_number, FSCK_INDIRECT_BLOCK, 0});
+                        } else {
+                            block_refs[inode.indirect_block]++;
+                            scan_table(inode_number, inode.indirect_block, DIRECT_BLOCK_COUNT);
+                        }
+                    }
+                    if (inode.double_indirect_block != 0) {
+                        if (!valid(inode.double_indirect_block)) {
+                            result.bad_pointers.push_back({inode_number, FSCK_DOUBLE_INDIRECT_BLOCK, 0});
+                        } else {
+                            block_refs[inode.double_indirect_block]++;
+                            image->read_blocks(inode.double_indirect_block, 1, reinterpret_cast<char*>(level1.data()));
+                            if (!block_checksum_matches(inode.double_indirect_block, reinterpret_cast<const char*>(level1.data()))) {
+                                result.bad_block_checksums.push_back(inode.double_indirect_block);
+                            }
+                            uint64_t base = DIRECT_BLOCK_COUNT + indirect_entries();
+                            for (unsigned int j = 0; j < indirect_entries(); j++) {
+                                if (level1[j] == 0) continue;
+                                if (!valid(level1[j])) {
+                                    result.bad_pointers.push_back({inode_number, FSCK_LEVEL1_TABLE, (uint64_t)j});
+                                    continue;
+                                }
+                                block_refs[level1[j]]++;
+                                scan_table(inode_number, level1[j], base + (uint64_t)j * indirect_entries());
+                            }
+                        }
+                    }
+
+                    if (inode.type != DIRECTORY) continue;
+                    // 收集目录项，并核对目录大小
+                    uint64_t entry_count = 0;
+                    for (uint64_t block_number : directory_blocks) {
+                        image->read_blocks(block_number, 1, block_buffer.data());
+                        if (!block_checksum_matches(block_number, block_buffer.data())) {
+                            result.bad_block_checksums.push_back(block_number);
+                        }
+                        for (unsigned int j = 0; j < entries_per_block; j++) {
+                            const DirectoryEntry* entry = reinterpret_cast<const DirectoryEntry*>(block_buffer.data() + j * DIRECTORY_ENTRY_SIZE);
+                            if (entry->inode_number == 0) continue;
+                            result.entries.push_back({inode_number, entry->inode_number, block_number, j});
+                            entry_count++;
+                        }
+                    }
+                    if (inode.size != entry_count * DIRECTORY_ENTRY_SIZE) {
+                        result.bad_dir_sizes.push_back({inode_number, entry_count * DIRECTORY_ENTRY_SIZE});
+                    }
+                }
+            });
+        }
+        pool.wait();
+    }
+
+    // 第二阶段：核对目录树
+    std::vector<std::vector<unsigned int>> children(superblock.inode_count);
+    std::vector<unsigned int> link_count(superblock.inode_count, 0);
+    std::vector<FsckEntry> bad_entries;
+    for (auto& result : results) {
+        for (auto& entry : result.entries) {
+            if (entry.child >= superblock.inode_count || !inode_used[entry.child]) {
+                std::cout << "Directory entry in inode " << entry.parent << " points to unused inode " << entry.child << "." << std::endl;
+                bad_entries.push_back(entry);
+                continue;
+            }
+            if (inode_reclaiming[entry.child]) {
+                std::cout << "Directory entry in inode " << entry.parent << " points to deleted inode " << entry.child << "." << std::endl;
+                bad_entries.push_back(entry);
+                continue;
+            }
+            children[entry.parent].push_back(entry.child);
+            link_count[entry.child]++;
+        }
+        for (auto& bad : result.bad_pointers) {
+            std::cout << "Inode " << bad.inode_number << " has an invalid block pointer at ";
+            switch (bad.kind) {
+                case FSCK_DATA_BLOCK: std::cout << "block " << bad.index; break;
+                case FSCK_INDIRECT_BLOCK: std::cout << "indirect block"; break;
+                case FSCK_DOUBLE_INDIRECT_BLOCK: std::cout << "double indirect block"; break;
+                case FSCK_LEVEL1_TABLE: std::cout << "indirect table " << bad.index; break;
+            }
+            std::cout << "." << std::endl;
+        }
+        for (auto& bad : result.bad_dir_sizes) {
+            std::cout << "Directory inode " << bad.first << " has wrong size." << std::endl;
+        }
+        for (unsigned int inode_number : result.bad_inode_checksums) {
+            std::cout << "Inode " << inode_number << " does not match its checksum." << std::endl;
+        }
+        for (uint64_t block_number : result.bad_block_checksums) {
+            std::cout << "Block " << block_number << " does not match its checksum." << std::endl;
+        }
+        errors += result.bad_pointers.size() + result.bad_dir_sizes.size() +
+                  result.bad_inode_checksums.size() + result.bad_block_checksums.size();
+    }
+    errors += bad_entries.size();
+
+    // 从根目录出发标记可达的 inode
+    std::vector<char> reachable(superblock.inode_count, 0);
+    std::vector<unsigned int> pending = {0};
+    reachable[0] = 1;
+    while (!pending.empty()) {
+        unsigned int current = pending.back();
+        pending.pop_back();
+        for (unsigned int child : children[current]) {
+            if (reachable[child]) continue;
+            reachable[child] = 1;
+            if (inode_is_dir[child]) pending.push_back(child);
+        }
+    }
+    std::vector<unsigned int> orphans;
+    for (unsigned int i = 1; i < superblock.inode_count; i++) {
+        // 等待回收的 inode 本来就不在目录树中，其数据块已在上面计入
+        if (!inode_used[i] || inode_reclaiming[i]) continue;
+        if (!reachable[i]) {
+            std::cout << "Inode " << i << " is not reachable from the root directory." << std::endl;
+            orphans.push_back(i);
+        } else if (link_count[i] > 1) {
+            std::cout << "Inode " << i << " is referenced by " << link_count[i] << " directory entries." << std::endl;
+            errors++;
+        }
+    }
+    errors += orphans.size();
+
+    // 第三阶段：在修复模式下先修正 inode 和目录，再统一重建位图
+    if (repair) {
+        for (auto& result : results) {
+            // 校验和不一致时以磁盘上的内容为准重新记录校验和，内容本身的问题由后面的检查处理
+            for (unsigned int inode_number : result.bad_inode_checksums) {
+                Inode inode;
+                read_inodes(inode_number, 1, &inode);
+                set_inode_checksum(inode_number, inode);
+                repaired++;
+            }
+            std::vector<char> block_buffer(block_size);
+            for (uint64_t block_number : result.bad_block_checksums) {
+                read_data_block(block_number, block_buffer.data());
+                set_block_checksums(block_number, 1, block_buffer.data());
+                repaired++;
+            }
+        }
+        flush_checksums();
+        for (auto& result : results) {
+            std::vector<uint64_t> table(indirect_entries());
+            // 清除间接块 block_number 中的第 entry 项
+            auto clear_entry = [&](uint64_t block_number, uint64_t entry) {
+                read_data_block(block_number, reinterpret_cast<char*>(table.data()));
+                table[entry] = 0;
+                write_data_block(block_number, reinterpret_cast<const char*>(table.data()));
+            };
+            for (auto& bad : result.bad_pointers) {
+                Inode inode = read_inode(bad.inode_number);
+                uint64_t base = DIRECT_BLOCK_COUNT + indirect_entries();
+                if (bad.kind == FSCK_INDIRECT_BLOCK) {
+                    inode.indirect_block = 0;
+                } else if (bad.kind == FSCK_DOUBLE_INDIRECT_BLOCK) {
+                    inode.double_indirect_block = 0;
+                } else if (bad.kind == FSCK_LEVEL1_TABLE) {
+                    clear_entry(inode.double_indirect_block, bad.index);
+                } else if (bad.index < DIRECT_BLOCK_COUNT) {
+                    inode.direct_blocks[bad.index] = 0;
+                } else if (bad.index < base) {
+                    clear_entry(inode.indirect_block, bad.index - DIRECT_BLOCK_COUNT);
+                } else {
+                    read_data_block(inode.double_indirect_block, reinterpret_cast<char*>(table.data()));
+                    clear_entry(table[(bad.index - base) / indirect_entries()], (bad.index - base) % indirect_entries());
+                }
+                write_inode(bad.inode_number, inode);
+                repaired++;
+            }
+            for (auto& bad : result.bad_dir_sizes) {
+                Inode inode = read_inode(bad.first);
+                inode.size = bad.second;
+                write_inode(bad.first, inode);
+                repaired++;
+            }
+        }
+        for (auto& entry : bad_entries) {
+            std::vector<char> block_buffer(block_size);
+            read_data_block(entry.block_number, block_buffer.data());
+            DirectoryEntry* slot = reinterpret_cast<DirectoryEntry*>(block_buffer.data() + entry.slot * DIRECTORY_ENTRY_SIZE);
+            slot->inode_number = 0;
+            memset(slot->filename, 0, sizeof(slot->filename));
+            write_data_block(entry.block_number, block_buffer.data());
+            Inode parent = read_inode(entry.parent);
+            if (parent.size >= DIRECTORY_ENTRY_SIZE) parent.size -= DIRECTORY_ENTRY_SIZE;
+            write_inode(entry.parent, parent);
+            repaired++;
+        }
+        // 不可达的 inode 直接回收，它们占用的块不再计入引用
+        auto drop_ref = [&](uint64_t block_number) {
+            if (block_number != 0 && block_number < superblock.data_block_count && block_refs[block_number] > 0) {
+                block_refs[block_number]--;
+            }
+        };
+        BlockMap block_map;
+        for (unsigned int inode_number : orphans) {
+            Inode inode = read_inode(inode_number);
+            load_block_map(inode, block_map);
+            for (uint64_t block_number : block_map) {
+                drop_ref(block_number);
+            }
+            for (uint64_t table : block_map.level1) {
+                drop_ref(table);
+            }
+            drop_ref(inode.indirect_block);
+            drop_ref(inode.double_indirect_block);
+            write_inode(inode_number, Inode());
+            inode_used[inode_number] = 0;
+            repaired++;
+        }
+    }
+
+    // 有块被多个 inode 引用但还没有引用计数表时，在未被引用的块中为它找一段连续空间
+    if (repair && block_refcount.empty()) {
+        bool need_table = false;
+        for (uint64_t i = 0; i < superblock.data_block_count && !need_table; i++) {
+            need_table = block_refs[i] > 1;
+        }
+        refcount_blocks = (superblock.data_block_count * sizeof(unsigned short) + block_size - 1) / block_size;
+        uint64_t run_length = 0;
+        for (uint64_t i = 0; need_table && i < superblock.data_block_count; i++) {
+            run_length = (reserved[i] || block_refs[i] > 0) ? 0 : run_length + 1;
+            if (run_length == refcount_blocks) {
+                superblock.refcount_start = i + 1 - refcount_blocks;
+                block_refcount.assign(refcount_blocks * block_size / sizeof(unsigned short), 0);
+                for (uint64_t j = superblock.refcount_start; j <= i; j++) {
+                    reserved[j] = 1;
+                }
+                break;
+            }
+        }
+    }
+
+    // 第四阶段：核对位图和引用计数表
+    uint64_t bitmap_blocks = calculate_bitmap_blocks();
+    std::vector<char> bitmap(bitmap_blocks * block_size);
+    read_data_blocks(bitmap_start_block(), bitmap_blocks, bitmap.data());
+    bool bitmap_changed = false;
+    bool refcounts_changed = false;
+    uint64_t allocated_blocks = 0;
+    for (uint64_t i = 0; i < superblock.data_block_count; i++) {
+        bool marked = bitmap[i / 8] & (1 << (i % 8));
+        bool in_use = reserved[i] || block_refs[i] > 0;
+        if (in_use != marked) {
+            std::cout << "Block " << i << (in_use ? " is in use but marked free." : " is marked in use but not referenced.") << std::endl;
+            errors++;
+            if (repair) {
+                if (in_use) bitmap[i / 8] |= (1 << (i % 8));
+                else bitmap[i / 8] &= ~(1 << (i % 8));
+                bitmap_changed = true;
+                repaired++;
+            }
+        }
+        if (repair ? in_use : marked) allocated_blocks++;
+
+        // 被多个 inode 引用的块必须在引用计数表中登记
+        if (reserved[i]) continue;
+        unsigned int expected = block_refs[i] > 1 ? block_refs[i] - 1 : 0;
+        unsigned int recorded = block_refcount.empty() ? 0 : block_refcount[i];
+        if (expected != recorded) {
+            std::cout << "Block " << i << " has " << block_refs[i] << " owners but reference count " << recorded + 1 << "." << std::endl;
+            errors++;
+            if (repair && !block_refcount.empty()) {
+                block_refcount[i] = std::min(expected, 0xFFFFu);
+                refcounts_changed = true;
+                repaired++;
+            }
+        }
+    }
+    if (bitmap_changed) {
+        write_data_blocks(bitmap_start_block(), bitmap_blocks, bitmap.data());
+    }
+    if (refcounts_changed) {
+        write_refcounts(0, superblock.data_block_count);
+    }
+
+    // 去重索引中的项必须指向仍被引用、校验和与登记时相同的块，否则之后可能与无关的块共享
+    if (!dedup_indexed.empty()) {
+        bool index_changed = false;
+        for (uint64_t bucket = 0; bucket < superblock.dedup_buckets; bucket++) {
+            DedupEntry* entries = dedup_bucket(bucket);
+            bool bucket_changed = false;
+            for (unsigned int i = 0; i < dedup_bucket_entries(); i++) {
+                uint64_t block_number = entries[i].block_number;
+                if (block_number == 0) continue;
+                if (block_number < superblock.data_block_count && !reserved[block_number] && block_refs[block_number] > 0 &&
+                    checksums[block_number] == entries[i].hash && entries[i].hash % superblock.dedup_buckets == bucket) {
+                    continue;
+                }
+                std::cout << "Deduplication index entry for block " << block_number << " is stale." << std::endl;
+                errors++;
+                if (repair) {
+                    entries[i] = DedupEntry();
+                    bucket_changed = true;
+                    repaired++;
+                }
+            }
+            if (bucket_changed) {
+                store_dedup_bucket(bucket, entries);
+                index_changed = true;
+            }
+        }
+        if (index_changed) {
+            load_dedup_index();
+        }
+    }
+
+    // 第五阶段：核对超级块中的空闲计数
+    uint64_t free_blocks = superblock.data_block_count - allocated_blocks;
+    if (superblock.free_data_block_count != free_blocks) {
+        std::cout << "Free data block count is " << superblock.free_data_block_count << ", should be " << free_blocks << "." << std::endl;
+        errors++;
+        if (repair) {
+            superblock.free_data_block_count = free_blocks;
+            repaired++;
+        }
+    }
+    uint64_t free_inodes = 0;
+    for (unsigned int i = 1; i < superblock.inode_count; i++) {
+        if (!inode_used[i]) free_inodes++;
+    }
+    if (superblock.free_inode_count != free_inodes) {
+        std::cout << "Free inode count is " << superblock.free_inode_count << ", should be " << free_inodes << "." << std::endl;
+        errors++;
+        if (repair) {
+            superblock.free_inode_count = free_inodes;
+            repaired++;
+        }
+    }
+    if (superblock.version >= 5) {
+        unsigned int reclaiming = std::count(inode_reclaiming.begin(), inode_reclaiming.end(), 1);
+        if (superblock.reclaim_count != reclaiming) {
+            std::cout << "Reclaim count is " << superblock.reclaim_count << ", should be " << reclaiming << "." << std::endl;
+            errors++;
+            if (repair) {
+                superblock.reclaim_count = reclaiming;
+                repaired++;
+            }
+        }
+    }
+    if (repair && repaired > 0) {
+        write_superblock();
+        load_allocator();
+    }
+
+    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - begin_time);
+    std::cout << "Checked " << superblock.inode_count << " inodes and " << superblock.data_block_count
+              << " data blocks in " << elapsed.count() << " ms: " << errors << " error(s)";
+    if (repair) std::cout << ", " << repaired << " repaired";
+    std::cout << "." << std::endl;
+    return errors;
+}
@@ -0,0 +1,171 @@
+#include "lz.h"
+#include <bit>
+#include <cstdint>
+#include <cstring>
+
+// 最短的匹配长度
+const size_t LZ_MIN_MATCH = 4;
+// 输入的最后这么多字节总是作为字面量输出，匹配不会延伸到这里
+const size_t LZ_LAST_LITERALS = 5;
+// 匹配距离的上限 (2 字节)
+const size_t LZ_MAX_DISTANCE = 65535;
+// 哈希表的位数，表中记录每个 4 字节序列最近一次出现的位置
+const unsigned int LZ_HASH_BITS = 12;
+
+static uint32_t read32(const unsigned char* p) {
+    uint32_t value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+static uint64_t read64(const unsigned char* p) {
+    uint64_t value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+static uint32_t hash4(uint32_t sequence) {
+    return (sequence * 2654435761u) >> (32 - LZ_HASH_BITS);
+}
+
+// 从 p 和 ref 开始比较，返回相同的字节数 (不超过 limit - p)
+static size_t common_length(const unsigned char* p, const unsigned char* ref, const unsigned char* limit) {
+    const unsigned char* start = p;
+    // 小端机器上每次比较 8 字节，第一个不同的字节由异或结果的末尾零位数得出
+    if constexpr (std::endian::native == std::endian::little) {
+        while (p + sizeof(uint64_t) <= limit) {
+            uint64_t diff = read64(p) ^ read64(ref);
+            if (diff != 0) {
+                return p - start + std::countr_zero(diff) / 8;
+            }
+            p += sizeof(uint64_t);
+            ref += sizeof(uint64_t);
+        }
+    }
+    while (p < limit && *p == *ref) {
+        p++;
+        ref++;
+    }
+    return p - start;
+}
+
+// 输出长度的扩展字节 (已减去标记字节中的 15)
+static bool put_length(unsigned char*& op, const unsigned char* oend, size_t length) {
+    while (length >= 255) {
+        if (op >= oend) return false;
+        *op++ = 255;
+        length -= 255;
+    }
+    if (op >= oend) return false;
+    *op++ = (unsigned char)length;
+    return true;
+}
+
+size_t lz_compress(const char* src, size_t length, char* dst, size_t capacity) {
+    const unsigned char* base = reinterpret_cast<const unsigned char*>(src);
+    const unsigned char* iend = base + length;
+    const unsigned char* ip = base;
+    const unsigned char* anchor = base;  // 还没有输出的字面量的起点
+    unsigned char* op = reinterpret_cast<unsigned char*>(dst);
+    const unsigned char* oend = op + capacity;
+    uint32_t table[1 << LZ_HASH_BITS] = {};
+
+    // 输出一个序列：anchor 到 literal_end 的字面量，再加一个匹配 (match_length 为 0 表示最后一个序列)
+    auto emit = [&](const unsigned char* literal_end, size_t match_length, size_t distance) {
+        size_t literals = literal_end - anchor;
+        if (op >= oend) return false;
+        unsigned char* token = op++;
+        *token = (unsigned char)((literals >= 15 ? 15 : literals) << 4);
+        if (literals >= 15 && !put_length(op, oend, literals - 15)) return false;
+        if ((size_t)(oend - op) < literals) return false;
+        memcpy(op, anchor, literals);
+        op += literals;
+        if (match_length == 0) return true;
+        if (oend - op < 2) return false;
+        *op++ = (unsigned char)(distance & 0xFF);
+        *op++ = (unsigned char)(distance >> 8);
+        size_t extra = match_length - LZ_MIN_MATCH;
+        *token |= (unsigned char)(extra >= 15 ? 15 : extra);
+        return extra < 15 || put_length(op, oend, extra - 15);
+    };
+
+    if (length > LZ_LAST_LITERALS + LZ_MIN_MATCH) {
+        const unsigned char* match_limit = iend - LZ_LAST_LITERALS;
+        unsigned int misses = 0;
+        while (ip + LZ_MIN_MATCH <= match_limit) {
+            uint32_t sequence = read32(ip);
+            uint32_t h = hash4(sequence);
+            const unsigned char* ref = base + table[h];
+            table[h] = (uint32_t)(ip - base);
+            if (ref >= ip || (size_t)(ip - ref) > LZ_MAX_DISTANCE || read32(ref) != sequence) {
+                // 连续找不到匹配时逐渐加大步长，不可压缩的数据很快就能扫完
+                ip += 1 + (misses++ >> 6);
+                continue;
+            }
+            misses = 0;
+            // 匹配向前延伸到还没有输出的字面量中
+            while (ip > anchor && ref > base && ip[-1] == ref[-1]) {
+                ip--;
+                ref--;
+            }
+            size_t match_length = LZ_MIN_MATCH + common_length(ip + LZ_MIN_MATCH, ref + LZ_MIN_MATCH, match_limit);
+            if (!emit(ip, match_length, ip - ref)) return 0;
+            ip += match_length;
+            anchor = ip;
+            // 匹配末尾附近的位置也记入哈希表，重复的内容可以接着匹配
+            if (ip + LZ_MIN_MATCH <= match_limit) {
+                table[hash4(read32(ip - 2))] = (uint32_t)(ip - 2 - base);
+            }
+        }
+    }
+    if (!emit(iend, 0, 0)) return 0;
+    return op - reinterpret_cast<unsigned char*>(dst);
+}
+
+bool lz_decompress(const char* src, size_t length, char* dst, size_t expected) {
+    const unsigned char* ip = reinterpret_cast<const unsigned char*>(src);
+    const unsigned char* iend = ip + length;
+    unsigned char* start = reinterpret_cast<unsigned char*>(dst);
+    unsigned char* op = start;
+    unsigned char* oend = op + expected;
+
+    // 读取长度的扩展字节
+    auto get_length = [&](size_t& value) {
+        unsigned char byte;
+        do {
+            if (ip >= iend) return false;
+            byte = *ip++;
+            value += byte;
+        } while (byte == 255);
+        return true;
+    };
+
+    while (ip < iend) {
+        unsigned char token = *ip++;
+        size_t literals = token >> 4;
+        if (literals == 15 && !get_length(literals)) return false;
+        if ((size_t)(iend - ip) < literals || (size_t)(oend - op) < literals) return false;
+        memcpy(op, ip, literals);
+        op += literals;
+        ip += literals;
+        if (ip == iend) break;  // 最后一个序列没有匹配
+
+        if (iend - ip < 2) return false;
+        size_t distance = ip[0] | ((size_t)ip[1] << 8);
+        ip += 2;
+        if (distance == 0 || distance > (size_t)(op - start)) return false;
+        size_t match_length = token & 15;
+        if (match_length == 15 && !get_length(match_length)) return false;
+        match_length += LZ_MIN_MATCH;
+        if ((size_t)(oend - op) < match_length) return false;
+        const unsigned char* ref = op - distance;
+        if (distance >= match_length) {
+            memcpy(op, ref, match_length);
+        } else {
+            // 与输出重叠 (如重复的短模式)，逐字节复制
+            for (size_t k = 0; k < match_length; k++) op[k] = ref[k];
+        }
+        op += match_length;
+    }
+    return op == oend;
+}
@@ -0,0 +1,14 @@
+#ifndef LZ_H
+#define LZ_H
+#include <cstddef>
+
+// LZ77 系列的块压缩 (格式与 LZ4 的块格式相同)，用于压缩簇，不依赖外部库
+// 每个序列为：标记字节 (高 4 位字面量长度，低 4 位匹配长度 - 4，为 15 时后跟 255 累加的扩展字节)、
+// 字面量、2 字节小端的匹配距离；最后一个序列只有字面量
+
+// 压缩 src 的 length 字节到 dst，返回压缩后的字节数；超过 capacity 时返回 0 (数据不可压缩)
+size_t lz_compress(const char* src, size_t length, char* dst, size_t capacity);
+
+// 解压到 dst，解压结果必须正好是 expected 字节；数据损坏时返回 false，不会越界读写
+bool lz_decompress(const char* src, size_t length, char* dst, size_t expected);
+#endif // LZ_H
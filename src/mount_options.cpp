@@ -0,0 +1,118 @@
+#include "myfs.h"
+#include <algorithm>
+#include <cstddef>
+
+// relatime 下访问时间最长多久强制更新一次 (秒)
+const time_t RELATIME_INTERVAL = 24 * 60 * 60;
+// lazytime 下缓存的访问时间超过这个数量就写回
+const size_t LAZYTIME_MAX_PENDING = 4096;
+
+bool parse_mount_options(std::string_view text, MountOptions& options) {
+    std::vector<std::string_view> names;
+    split(text, ",", names);
+    for (std::string_view name : names) {
+        if (name == "strictatime") {
+            options.atime = ATIME_STRICT;
+        } else if (name == "noatime") {
+            options.atime = ATIME_NOATIME;
+        } else if (name == "relatime") {
+            options.atime = ATIME_RELATIME;
+        } else if (name == "lazytime") {
+            options.atime = ATIME_LAZYTIME;
+        } else if (name == "sync") {
+            options.sync = true;
+        } else if (name == "async") {
+            options.sync = false;
+        } else if (name == "direct") {
+            options.direct = true;
+        } else if (name == "buffered") {
+            options.direct = false;
+        } else if (name == "hugepages") {
+            options.huge_pages = true;
+        } else if (name == "nohugepages") {
+            options.huge_pages = false;
+        } else if (name == "compress") {
+            options.compress = true;
+        } else if (name == "nocompress") {
+            options.compress = false;
+        } else if (name == "dedup") {
+            options.dedup = true;
+        } else if (name == "nodedup") {
+            options.dedup = false;
+        } else {
+            std::cerr << "Unknown mount option: " << name << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+// 按挂载选项更新访问时间
+void MyFileSystem::touch_atime(unsigned int inode_number, Inode& inode) {
+    time_t now = time(nullptr);
+    switch (mount_options.atime) {
+    case ATIME_NOATIME:
+        return;
+    case ATIME_RELATIME:
+        // 自上次修改后已经记录过访问，且不到一天，不必再写
+        if (inode.accessed_time > inode.modified_time && now - inode.accessed_time < RELATIME_INTERVAL) {
+            return;
+        }
+        break;
+    case ATIME_LAZYTIME:
+        inode.accessed_time = now;
+        lazy_atimes[inode_number] = now;
+        if (lazy_atimes.size() >= LAZYTIME_MAX_PENDING) {
+            flush_atimes();
+        }
+        return;
+    case ATIME_STRICT:
+        break;
+    }
+    inode.accessed_time = now;
+    write_inode(inode_number, inode);
+}
+
+// 写回缓存的访问时间，按 inode 编号顺序写
+void MyFileSystem::flush_atimes() {
+    if (lazy_atimes.empty()) return;
+    std::vector<std::pair<unsigned int, time_t>> pending(lazy_atimes.begin(), lazy_atimes.end());
+    lazy_atimes.clear();
+    std::sort(pending.begin(), pending.end());
+    for (auto& [inode_number, accessed_time] : pending) {
+        // 写回队列中的 inode 会整个覆盖磁盘上的，直接修改队列中的内容
+        auto queued = writeback.inodes.find(inode_number);
+        if (queued != writeback.inodes.end()) {
+            queued->second.accessed_time = accessed_time;
+            set_inode_checksum(inode_number, queued->second);
+            continue;
+        }
+        // 没有校验和时只需改写 accessed_time 字段，否则整个 inode 连同校验和一起写
+        if (checksums.empty()) {
+            disk.seekp(superblock.free_inode_start + (uint64_t)inode_number * sizeof(Inode) + offsetof(Inode, accessed_time),
+                       std::ios::beg);
+            disk.write(reinterpret_cast<const char*>(&accessed_time), sizeof(accessed_time));
+            writeback.unflushed = true;
+            continue;
+        }
+        Inode inode = read_inode(inode_number);
+        inode.accessed_time = accessed_time;
+        queue_inodes(inode_number, 1, &inode);
+        set_inode_checksum(inode_number, inode);
+    }
+    flush_if_sync();
+}
+
+// 写回缓存的访问时间并落盘
+bool MyFileSystem::sync() {
+    TraceScope trace(trace_writer.get(), TRACE_SYNC);
+    wait_async();
+    if (!disk.is_open()) return true;
+    OperationScope operation(*this);
+    write_back_inodes();
+    flush_atimes();
+    // 之前的写回失败也在这里报告一次 (异步挂载时写回发生在别的调用中)
+    bool ok = flush_writeback() && !writeback.failed;
+    writeback.failed = false;
+    return ok;
+}
@@ -2,10 +2,44 @@
 #include <iomanip>
 #include <vector>
 // 初始化文件系统
-bool MyFileSystem::format(unsigned int disk_size, unsigned int inode_percentage) {
+bool MyFileSystem::format(uint64_t disk_size, unsigned int inode_percentage, unsigned int new_block_size,
+                          bool enable_checksums, const DeviceLayout& layout) {
+    // 重新格式化前让未完成的异步请求先落盘，停止回收旧镜像
+    wait_async();
+    stop_reclaim();
+    lazy_atimes.clear();
+    close_all_files(false);
+    cluster_cache.clear();
+    dedup_indexed.clear();
+    if (!is_supported_block_size(new_block_size)) {
+        std::cerr << "Unsupported block size " << new_block_size << "." << std::endl;
+        return false;
+    }
+    discard_writeback();
+    OperationScope operation(*this);
+    if (!layout.members.empty()) {
+        if (layout.stripe_size == 0 || layout.stripe_size % new_block_size != 0) {
+            std::cerr << "Stripe size must be a multiple of the block size." << std::endl;
+            return false;
+        }
+        // 成员镜像的路径要能放进 0 号数据块
+        size_t table_size = 0;
+        for (const std::string& path : layout.members) {
+            table_size += path.size() + 1;
+            if (path.empty() || path == disk_file_path) {
+                std::cerr << "Invalid device " << path << "." << std::endl;
+                return false;
+            }
+        }
+        if (table_size >= new_block_size) {
+            std::cerr << "Too many devices for block size " << new_block_size << "." << std::endl;
+            return false;
+        }
+    }
     if (disk.is_open()) {
         disk.close();
     }
+    close_devices();
 
     disk.open(disk_file_path, std::ios::in | std::ios::out | std::ios::trunc | std::ios::binary);
     if (!disk.is_open()) {
@@ -13,32 +47,58 @@ bool MyFileSystem::format(unsigned int disk_size, unsigned int inode_percentage)
         return false;
     }
 
+    superblock = Superblock();
+    checksums.clear();
+    checksum_dirty.clear();
+    superblock.block_size = new_block_size;
+    block_size = new_block_size;
     superblock.total_size = disk_size;
-    superblock.inode_count = (disk_size * inode_percentage) / (100 * INODE_SIZE);
-
-    // 计算位图大小和块数
-    unsigned int bitmap_size = calculate_bitmap_size();
-    unsigned int bitmap_blocks = (bitmap_size + BLOCK_SIZE - 1) / BLOCK_SIZE;
-
-    // 预留位图空间
-    superblock.free_inode_start = SUPERBLOCK_SIZE + bitmap_blocks * BLOCK_SIZE;
-    superblock.data_block_count = (disk_size - superblock.free_inode_start - superblock.inode_count * INODE_SIZE) / BLOCK_SIZE;
+    // inode 编号在目录项中是 32 位的
+    uint64_t inode_count = (disk_size * inode_percentage) / (100 * INODE_SIZE);
+    superblock.inode_count = inode_count > INT32_MAX ? INT32_MAX : inode_count;
+
+    // 位图位于数据区中 (见 bitmap_start_block)，inode 表紧跟在超级块之后
+    superblock.free_inode_start = SUPERBLOCK_SIZE;
+    // 数据区的起点按 DIRECT_IO_ALIGNMENT 对齐，直接 I/O 时主镜像上的块偏移才满足对齐要求
+    uint64_t inode_table_end = superblock.free_inode_start + (uint64_t)superblock.inode_count * INODE_SIZE;
+    superblock.free_data_block_start = (inode_table_end + DIRECT_IO_ALIGNMENT - 1) / DIRECT_IO_ALIGNMENT * DIRECT_IO_ALIGNMENT;
+    superblock.data_block_count = (disk_size - superblock.free_data_block_start) / block_size;
+    // 校验和表紧跟在位图之后
+    uint64_t metadata_end = bitmap_start_block() + calculate_bitmap_blocks();
+    if (enable_checksums) {
+        superblock.checksum_start = metadata_end;
+        metadata_end += checksum_table_blocks();
+    }
+    if (metadata_end >= superblock.data_block_count) {
+        std::cerr << "Disk too small for block size " << block_size << "." << std::endl;
+        disk.close();
+        return false;
+    }
     superblock.free_inode_count = superblock.inode_count;
     superblock.free_data_block_count = superblock.data_block_count;
-    superblock.free_data_block_start = superblock.free_inode_start + superblock.inode_count * INODE_SIZE;
+    if (!layout.members.empty()) {
+        superblock.device_count = 1 + layout.members.size();
+        superblock.stripe_blocks = layout.stripe_size / block_size;
+        superblock.stripe_start = layout.metadata_on_primary ? metadata_end : 0;
+    }
 
+    if (!create_devices(layout, disk_size)) {
+        disk.close();
+        return false;
+    }
     write_superblock();
 
-    // 初始化位图 (所有块标记为空闲)
-    char empty_block[BLOCK_SIZE] = {0};
-    for (unsigned int i = 0; i < bitmap_blocks; i++) {
-        write_data_block(i - superblock.inode_count * INODE_SIZE / BLOCK_SIZE, empty_block);
-    }
-    // 初始化 inode 
-    Inode empty_inode;
-    for (unsigned int i = 1; i < superblock.inode_count; i++) {
-        write_inode(i, empty_inode);
+    // 初始化 inode，成批写入
+    const unsigned int INODE_BATCH = 1024;
+    std::vector<Inode> empty_inodes(INODE_BATCH);
+    for (unsigned int i = 1; i < superblock.inode_count; i += INODE_BATCH) {
+        unsigned int count = std::min<uint64_t>(INODE_BATCH, superblock.inode_count - i);
+        disk.seekp(superblock.free_inode_start + (uint64_t)i * INODE_SIZE, std::ios::beg);
+        disk.write(reinterpret_cast<const char*>(empty_inodes.data()), (uint64_t)count * INODE_SIZE);
     }
+    flush_devices();
+    // 镜像刚扩展出来的区域全为 0，校验和表也就是全部"未记录"
+    load_checksums();
     // 初始化根目录
     Inode root_inode;
     root_inode.type = DIRECTORY;
@@ -49,24 +109,53 @@ bool MyFileSystem::format(unsigned int disk_size, unsigned int inode_percentage)
     write_inode(0, root_inode);
     superblock.free_inode_count--;
 
-    for (unsigned int i = 0; i < superblock.data_block_count; i++) {
-        write_data_block(i + superblock.free_data_block_start / BLOCK_SIZE, empty_block);
+    // 0 号块表示"未分配"，位图自身也位于数据区中，二者都不能分配给文件
+    update_bitmap_range(0, 1, true);
+    update_bitmap_range(bitmap_start_block(), calculate_bitmap_blocks(), true);
+    superblock.free_data_block_count -= 1 + calculate_bitmap_blocks();
+    if (superblock.checksum_start != 0) {
+        update_bitmap_range(superblock.checksum_start, checksum_table_blocks(), true);
+        superblock.free_data_block_count -= checksum_table_blocks();
     }
+    superblock.refcount_start = 0;
 
     write_superblock();
+    load_allocator();
+    load_refcounts();
+    load_dedup_index();
+    inode_hint = 1;
 
     std::cout << "File system formatted successfully." << std::endl;
     std::cout << "Total size: " << superblock.total_size << " bytes" << std::endl;
     std::cout << "Inode count: " << superblock.inode_count << std::endl;
     std::cout << "Data block count: " << superblock.data_block_count << std::endl;
+    std::cout << "Block size: " << block_size << " bytes" << std::endl;
+    if (superblock.device_count > 1) {
+        std::cout << "Devices: " << superblock.device_count << ", stripe " << superblock.stripe_blocks * block_size
+                  << " bytes" << std::endl;
+    }
 
     return true;
 }
 // 加载文件系统
 bool MyFileSystem::mount() {
+    return mount(mount_options);
+}
+
+bool MyFileSystem::mount(const MountOptions& options) {
+    wait_async();
+    stop_reclaim();
+    close_all_files(true);
     if (disk.is_open()) {
+        flush_atimes();
+        flush_writeback();
         disk.close();
+        close_devices();
     }
+    mount_options = options;
+    writeback.failed = false;
+    cluster_cache.clear();
+    dedup_indexed.clear();
     disk.open(disk_file_path, std::ios::in | std::ios::out | std::ios::binary);
     if (!disk.is_open()) {
         std::cerr << "Unable to open disk file." << std::endl;
@@ -82,94 +171,337 @@ bool MyFileSystem::mount() {
         disk.close();
         return false;
     }
+    // 验证格式版本
+    if (superblock.version < FS_MIN_VERSION || superblock.version > FS_VERSION) {
+        std::cerr << "Unsupported file system version, the image needs to be upgraded." << std::endl;
+        disk.close();
+        return false;
+    }
+    if (superblock.version >= 3 && superblock.checksum != superblock_checksum()) {
+        std::cerr << "Superblock checksum mismatch." << std::endl;
+        disk.close();
+        return false;
+    }
+    if (!is_supported_block_size(superblock.block_size)) {
+        std::cerr << "Unsupported block size " << superblock.block_size << "." << std::endl;
+        disk.close();
+        return false;
+    }
+    block_size = superblock.block_size;
+    if (mount_options.compress && superblock.version < 6) {
+        std::cerr << "Compression needs a version 6 image, mounting without it." << std::endl;
+        mount_options.compress = false;
+    }
+    if (mount_options.dedup && superblock.version < 7) {
+        std::cerr << "Deduplication needs a version 7 image, mounting without it." << std::endl;
+        mount_options.dedup = false;
+    }
+    if (!open_devices()) {
+        disk.close();
+        return false;
+    }
+    buffer_pool.init(BUFFER_POOL_SLOTS, mount_options.huge_pages);
+    open_direct();
+    load_checksums();
+    // 去重按校验和查找重复的块
+    if (mount_options.dedup && checksums.empty()) {
+        std::cerr << "Deduplication needs block checksums, mounting without it." << std::endl;
+        mount_options.dedup = false;
+    }
+
+    // 由位图构建空闲区间
+    load_allocator();
+    load_refcounts();
+    load_dedup_index();
+    inode_hint = 1;
 
     std::cout << "File system mounted successfully." << std::endl;
+    if (superblock.reclaim_count > 0) {
+        resume_reclaim();
+    }
     return true;
 }
 
 // 卸载文件系统
 bool MyFileSystem::unmount() {
+    wait_async();
+    stop_reclaim();
+    close_all_files(true);
+    bool ok = true;
     if (disk.is_open()) {
+        flush_atimes();
+        // 这次或之前的写回没能落盘时仍然卸载，但要告诉调用者
+        ok = flush_writeback() && !writeback.failed;
+        writeback.failed = false;
         disk.close();
+        close_devices();
         std::cout << "File system unmounted successfully." << std::endl;
     }
-    return true;
+    return ok;
 }
 
 // 从磁盘读取超级块
 void MyFileSystem::read_superblock() {
     disk.seekg(0, std::ios::beg);
-    disk.read(reinterpret_cast<char*>(&superblock), sizeof(Superblock));
+    superblock = Superblock();
+    disk.read(reinterpret_cast<char*>(&superblock), SUPERBLOCK_V2_SIZE);
+    // 旧版本的超级块之后紧接着 inode 表，不能多读，没有的字段保持默认值 (单设备)
+    if (superblock.version >= 3) {
+        disk.read(reinterpret_cast<char*>(&superblock) + SUPERBLOCK_V2_SIZE, SUPERBLOCK_V3_SIZE - SUPERBLOCK_V2_SIZE);
+    }
+    if (superblock.version >= 4) {
+        disk.read(reinterpret_cast<char*>(&superblock) + SUPERBLOCK_V3_SIZE, SUPERBLOCK_V6_SIZE - SUPERBLOCK_V3_SIZE);
+    }
+    if (superblock.version >= 7) {
+        disk.read(reinterpret_cast<char*>(&superblock) + SUPERBLOCK_V6_SIZE, SUPERBLOCK_SIZE - SUPERBLOCK_V6_SIZE);
+    }
+    // 版本 4 的 reclaim_count 位置是填充，内容不确定
+    if (superblock.version < 5) {
+        superblock.reclaim_count = 0;
+    }
 }
 
-// 将超级块写入磁盘
+// 将超级块写入磁盘，写回时写的是那时内存中的超级块
 void MyFileSystem::write_superblock() {
-    disk.seekp(0, std::ios::beg);
-    disk.write(reinterpret_cast<const char*>(&superblock), sizeof(Superblock));
-    disk.flush();
+    writeback.superblock = true;
+    flush_if_sync();
 }
 
 // 读取 inode
 Inode MyFileSystem::read_inode(unsigned int inode_number) {
     Inode inode;
-    disk.seekg(superblock.free_inode_start + inode_number * sizeof(Inode), std::ios::beg);
-    disk.read(reinterpret_cast<char*>(&inode), sizeof(Inode));
+    // 打开的文件直接使用内存中的 inode
+    auto cached = inode_cache.empty() ? inode_cache.end() : inode_cache.find(inode_number);
+    auto queued = writeback.inodes.empty() ? writeback.inodes.end() : writeback.inodes.find(inode_number);
+    if (cached != inode_cache.end()) {
+        inode = cached->second.inode;
+    } else if (queued != writeback.inodes.end()) {
+        inode = queued->second;
+    } else {
+        disk.seekg(superblock.free_inode_start + (uint64_t)inode_number * sizeof(Inode), std::ios::beg);
+        disk.read(reinterpret_cast<char*>(&inode), sizeof(Inode));
+        verify_inode_checksum(inode_number, inode);
+    }
+    // lazytime 下内存中的访问时间比磁盘上的新
+    if (!lazy_atimes.empty()) {
+        auto it = lazy_atimes.find(inode_number);
+        if (it != lazy_atimes.end()) inode.accessed_time = it->second;
+    }
     return inode;
 }
 
 // 写入 inode
 void MyFileSystem::write_inode(unsigned int inode_number, const Inode& inode) {
-    disk.seekp(superblock.free_inode_start + inode_number * sizeof(Inode), std::ios::beg);
-    disk.write(reinterpret_cast<const char*>(&inode), sizeof(Inode));
-    disk.flush();
+    // 整个 inode 写回时顺带写回缓存的访问时间
+    if (!lazy_atimes.empty()) {
+        auto it = lazy_atimes.find(inode_number);
+        if (it != lazy_atimes.end()) {
+            time_t accessed_time = it->second;
+            lazy_atimes.erase(it);
+            if ((inode.used || inode_number == 0) && accessed_time > inode.accessed_time) {
+                Inode updated = inode;
+                updated.accessed_time = accessed_time;
+                write_inode(inode_number, updated);
+                return;
+            }
+        }
+    }
+    // 打开的文件只更新内存中的 inode，关闭文件或 sync 时再写回；文件被删除时直接写盘
+    if (!inode_cache.empty()) {
+        auto it = inode_cache.find(inode_number);
+        if (it != inode_cache.end()) {
+            if (inode.used) {
+                update_cached_inode(it->second, inode);
+                return;
+            }
+            drop_cached_inode(inode_number);
+        }
+    }
+    store_inode(inode_number, inode);
+}
+
+// 把 inode 写到磁盘上 (经写回队列)
+void MyFileSystem::store_inode(unsigned int inode_number, const Inode& inode) {
+    queue_inodes(inode_number, 1, &inode);
+    set_inode_checksum(inode_number, inode);
+    flush_if_sync();
+}
+
+// 通过另一个文件句柄读取 inode
+Inode MyFileSystem::read_inode(unsigned int inode_number, ImageReader& image) {
+    Inode inode;
+    image.primary().seekg(superblock.free_inode_start + (uint64_t)inode_number * sizeof(Inode), std::ios::beg);
+    image.primary().read(reinterpret_cast<char*>(&inode), sizeof(Inode));
+    verify_inode_checksum(inode_number, inode);
+    return inode;
+}
+
+// 批量读取 inode
+void MyFileSystem::read_inodes(unsigned int first, unsigned int count, Inode* inodes) {
+    disk.seekg(superblock.free_inode_start + (uint64_t)first * sizeof(Inode), std::ios::beg);
+    disk.read(reinterpret_cast<char*>(inodes), (uint64_t)count * sizeof(Inode));
+    // 校验之前先换上写回队列中的新内容，校验和表记录的已是新内容的
+    for (auto it = writeback.inodes.lower_bound(first); it != writeback.inodes.end() && it->first - first < count; ++it) {
+        inodes[it->first - first] = it->second;
+    }
+    for (unsigned int i = 0; i < count && !checksums.empty(); i++) {
+        verify_inode_checksum(first + i, inodes[i]);
+    }
+    // 打开的文件以内存中的 inode 为准
+    for (auto& [inode_number, cached] : inode_cache) {
+        if (inode_number >= first && inode_number - first < count) {
+            inodes[inode_number - first] = cached.inode;
+        }
+    }
+}
+
+// 批量写入 inode
+void MyFileSystem::write_inodes(unsigned int first, unsigned int count, const Inode* inodes) {
+    queue_inodes(first, count, inodes);
+    for (unsigned int i = 0; i < count && !checksums.empty(); i++) {
+        set_inode_checksum(first + i, inodes[i]);
+    }
+    flush_if_sync();
+    // 打开的文件的 inode 已经写下 (进入写回队列)，缓存改为新内容；被删除的文件使其句柄失效
+    for (unsigned int i = 0; i < count && !inode_cache.empty(); i++) {
+        auto it = inode_cache.find(first + i);
+        if (it == inode_cache.end()) continue;
+        if (inodes[i].used) {
+            it->second.inode = inodes[i];
+            it->second.dirty = false;
+            data_generation++;
+        } else {
+            drop_cached_inode(first + i);
+        }
+    }
+    // 被覆盖的 inode 不再需要写回缓存的访问时间
+    for (unsigned int i = 0; i < count && !lazy_atimes.empty(); i++) {
+        lazy_atimes.erase(first + i);
+    }
 }
 
 // 读取数据块
-void MyFileSystem::read_data_block(unsigned int block_number, char* buffer) {
-    disk.seekg(superblock.free_data_block_start + block_number * BLOCK_SIZE, std::ios::beg);
-    disk.read(buffer, BLOCK_SIZE);
+bool MyFileSystem::read_data_block(uint64_t block_number, char* buffer) {
+    read_raw_blocks(block_number, 1, buffer);
+    return verify_block_checksums(block_number, 1, buffer);
+}
+
+// 通过另一个文件句柄读取数据块
+bool MyFileSystem::read_data_block(uint64_t block_number, char* buffer, ImageReader& image) {
+    image.read_blocks(block_number, 1, buffer);
+    return verify_block_checksums(block_number, 1, buffer);
 }
 
 // 写入数据块
-void MyFileSystem::write_data_block(unsigned int block_number, const char* buffer) {
-    disk.seekp(superblock.free_data_block_start + block_number * BLOCK_SIZE, std::ios::beg);
-    disk.write(buffer, BLOCK_SIZE);
-    disk.flush();
+void MyFileSystem::write_data_block(uint64_t block_number, const char* buffer) {
+    write_raw_blocks(block_number, 1, buffer);
+    set_block_checksums(block_number, 1, buffer);
+    data_generation++;
+    flush_if_sync();
+}
+
+// 读取连续的数据块
+bool MyFileSystem::read_data_blocks(uint64_t start, uint64_t count, char* buffer) {
+    read_raw_blocks(start, count, buffer);
+    return verify_block_checksums(start, count, buffer);
+}
+
+// 写入连续的数据块
+void MyFileSystem::write_data_blocks(uint64_t start, uint64_t count, const char* buffer) {
+    write_raw_blocks(start, count, buffer);
+    set_block_checksums(start, count, buffer);
+    data_generation++;
+    flush_if_sync();
 }
+
+// 将连续的数据块清零，按缓冲区池中缓冲区的大小分段写入 (不小于写回队列的直写阈值，不占用队列)
+void MyFileSystem::zero_data_blocks(uint64_t start, uint64_t count) {
+    PooledBuffer zeros(buffer_pool);
+    uint64_t per_write = PooledBuffer::size() / block_size;
+    memset(zeros.data(), 0, per_write * block_size);
+    while (count > 0) {
+        uint64_t n = count < per_write ? count : per_write;
+        write_data_blocks(start, n, zeros.data());
+        start += n;
+        count -= n;
+    }
+}
+
 // 分配一个 inode
 unsigned int MyFileSystem::allocate_inode(FileType type) {
-    if (superblock.free_inode_count == 0) {
+    // 没有空闲 inode 时先把待回收的删除做完
+    if (superblock.free_inode_count == 0 && !finish_reclaim()) {
         std::cerr << "No free inode available." << std::endl;
         return -1;
     }
 
-    for (unsigned int i = 1; i < superblock.inode_count; i++) {
-        Inode inode = read_inode(i);
-        if (inode.type == REGULAR_FILE and inode.size == 0 and !inode.used) { // 未使用的 inode
-            superblock.free_inode_count--;
-            inode.type = type;
-            write_inode(i, inode);
-            write_superblock();
-            return i;
+    // 从上次分配的位置开始成批扫描 inode 表，扫到末尾后从头再找一遍
+    const unsigned int INODE_BATCH = 256;
+    std::vector<Inode> inodes(INODE_BATCH);
+    for (int pass = 0; pass < 2; pass++) {
+        unsigned int first = pass == 0 ? inode_hint : 1;
+        unsigned int last = pass == 0 ? superblock.inode_count : inode_hint;
+        for (unsigned int i = first; i < last; i += INODE_BATCH) {
+            unsigned int count = std::min(INODE_BATCH, last - i);
+            read_inodes(i, count, inodes.data());
+            for (unsigned int k = 0; k < count; k++) {
+                Inode& inode = inodes[k];
+                if (inode.type == REGULAR_FILE and inode.size == 0 and !inode.used) { // 未使用的 inode
+                    superblock.free_inode_count--;
+                    inode.type = type;
+                    write_inode(i + k, inode);
+                    write_superblock();
+                    inode_hint = i + k + 1;
+                    return i + k;
+                }
+            }
         }
     }
     std::cerr<<"Unable to allocate inode."<<std::endl;
     return -1;
 }
+
+// 查找 count 个空闲 inode
+bool MyFileSystem::find_free_inodes(unsigned int count, std::vector<unsigned int>& inode_numbers) {
+    inode_numbers.clear();
+    // 空闲 inode 不够时先把待回收的删除做完
+    if (count > superblock.free_inode_count) {
+        finish_reclaim();
+    }
+    if (count > superblock.free_inode_count) {
+        std::cerr << "No free inode available." << std::endl;
+        return false;
+    }
+    const unsigned int INODE_BATCH = 256;
+    std::vector<Inode> inodes(INODE_BATCH);
+    for (int pass = 0; pass < 2 && inode_numbers.size() < count; pass++) {
+        unsigned int first = pass == 0 ? inode_hint : 1;
+        unsigned int last = pass == 0 ? superblock.inode_count : inode_hint;
+        for (unsigned int i = first; i < last && inode_numbers.size() < count; i += INODE_BATCH) {
+            unsigned int batch = std::min(INODE_BATCH, last - i);
+            read_inodes(i, batch, inodes.data());
+            for (unsigned int k = 0; k < batch && inode_numbers.size() < count; k++) {
+                if (inodes[k].type == REGULAR_FILE and inodes[k].size == 0 and !inodes[k].used) {
+                    inode_numbers.push_back(i + k);
+                }
+            }
+        }
+    }
+    if (inode_numbers.size() < count) {
+        std::cerr << "Unable to allocate inode." << std::endl;
+        return false;
+    }
+    return true;
+}
 // 释放一个 inode
 void MyFileSystem::free_inode(unsigned int inode_number) {
     Inode inode = read_inode(inode_number);
     
-    // 释放数据块
-    for (int i = 0; i < 10; i++) {
-        if (inode.direct_blocks[i] != 0) {
-            free_data_block(inode.direct_blocks[i]);
-            inode.direct_blocks[i] = 0;
-        }
-    }
-    if (inode.indirect_block != 0) {
-        // todo 处理间接块... 
-    }
+    // 释放数据块 (包括间接块)
+    BlockMap block_map;
+    load_block_map(inode, block_map);
+    release_blocks(block_map, 0);
+    store_block_map(inode, block_map);
 
     // 将 inode 标记为空闲
     inode.type = REGULAR_FILE;
@@ -180,180 +512,351 @@ void MyFileSystem::free_inode(unsigned int inode_number) {
 
     superblock.free_inode_count++;
     write_superblock();
+    if (inode_number < inode_hint) {
+        inode_hint = inode_number;
+    }
 }
 // 分配一个数据块
-unsigned int MyFileSystem::allocate_data_block() {
-    if (superblock.free_data_block_count == 0) {
-        std::cerr << "No free data blocks available." << std::endl;
+uint64_t MyFileSystem::allocate_data_block() {
+    uint64_t block_number;
+    if (allocate_data_blocks(1, 0, block_number) == 0) {
         return -1;
     }
+    return block_number;
+}
 
-    unsigned int bitmap_size = calculate_bitmap_size();
-    char bitmap_block[BLOCK_SIZE];
+// 分配最多 count 个连续数据块
+uint64_t MyFileSystem::allocate_data_blocks(uint64_t count, uint64_t hint, uint64_t& start) {
+    // 空间不足时先把后台还没回收完的删除做完
+    if ((superblock.free_data_block_count == 0 || allocator.free_blocks() == 0) && !finish_reclaim()) {
+        std::cerr << "No free data blocks available." << std::endl;
+        return 0;
+    }
 
-    for (unsigned int i = 0; i < superblock.data_block_count; i++) {
-        // 逐块读取位图
-        if (i % (BLOCK_SIZE * 8) == 0) {
-            read_data_block(i / (BLOCK_SIZE * 8) + 1 + superblock.inode_count * INODE_SIZE / BLOCK_SIZE, bitmap_block);
-        }
+    uint64_t allocated = allocator.allocate_partial(count, hint, start);
+    if (allocated == 0) {
+        std::cerr << "Unable to allocate data block." << std::endl;
+        return 0;
+    }
+    update_bitmap_range(start, allocated, true);
+    superblock.free_data_block_count -= allocated;
+    write_superblock();
+    return allocated;
+}
 
-        unsigned int bit_index = i % (BLOCK_SIZE * 8);
-        unsigned int byte_index = bit_index / 8;
-        unsigned int bit_offset = bit_index % 8;
+// 释放一个数据块
+void MyFileSystem::free_data_block(uint64_t block_number) {
+    free_data_blocks(block_number, 1);
+}
 
-        if (!(bitmap_block[byte_index] & (1 << bit_offset))) { // 找到一个空闲的数据块
-            update_bitmap(i, true); // 更新位图
-            superblock.free_data_block_count--;
-            write_superblock();
-            return i;
-        }
+// 释放一段连续的数据块，共享块只减少引用计数
+void MyFileSystem::free_data_blocks(uint64_t start, uint64_t count) {
+    if (block_refcount.empty()) {
+        release_data_run(start, count);
+        return;
     }
 
-    std::cerr << "Unable to allocate data block." << std::endl;
-    return -1;
+    uint64_t run_start = start;
+    bool refs_changed = false;
+    for (uint64_t i = start; i < start + count; i++) {
+        if (block_refcount[i] > 0) {
+            release_data_run(run_start, i - run_start);
+            block_refcount[i]--;
+            refs_changed = true;
+            run_start = i + 1;
+        }
+    }
+    release_data_run(run_start, start + count - run_start);
+    if (refs_changed) {
+        write_refcounts(start, count);
+    }
 }
 
-// 释放一个数据块
-void MyFileSystem::free_data_block(unsigned int block_number) {
-    update_bitmap(block_number, false);
-    superblock.free_data_block_count++;
+// 将一段连续块归还给分配器
+void MyFileSystem::release_data_run(uint64_t start, uint64_t count) {
+    if (count == 0) {
+        return;
+    }
+    if (!allocator.release(start, count)) {
+        std::cerr << "Data block " << start << " is already free." << std::endl;
+        return;
+    }
+    update_bitmap_range(start, count, false);
+    superblock.free_data_block_count += count;
     write_superblock();
+    if (!cluster_cache.empty()) {
+        drop_cached_clusters(start, count);
+    }
+    if (!dedup_indexed.empty()) {
+        forget_dedup_blocks(start, count);
+    }
 }
-// 更新位图
-void MyFileSystem::update_bitmap(unsigned int block_number, bool allocated) {
-    unsigned int bitmap_block_number = block_number / (BLOCK_SIZE * 8) + 1 + superblock.inode_count * INODE_SIZE/BLOCK_SIZE;
-    unsigned int bit_index = block_number % (BLOCK_SIZE * 8);
-    unsigned int byte_index = bit_index / 8;
-    unsigned int bit_offset = bit_index % 8;
 
-    char block[BLOCK_SIZE];
-    read_data_block(bitmap_block_number, block);
+// 根据位图重建空闲区间分配器
+void MyFileSystem::load_allocator() {
+    dispatch_block_size(block_size, [&](auto geometry) {
+        scan_bitmap<decltype(geometry)::SIZE>();
+    });
+}
 
-    if (allocated) {
-        block[byte_index] |= (1 << bit_offset);
-    } else {
-        block[byte_index] &= ~(1 << bit_offset);
+// 扫描位图，把空闲的块登记到分配器中
+template <unsigned int Size>
+void MyFileSystem::scan_bitmap() {
+    using Geometry = BlockGeometry<Size>;
+    allocator.reset();
+    uint64_t reserved_start = bitmap_start_block();
+    uint64_t reserved_end = reserved_start + calculate_bitmap_blocks();
+    // 每次读取一个池缓冲区能容纳的位图块，全 0 或全 1 的字节整体处理
+    const uint64_t BITMAP_BATCH = PooledBuffer::size() / Size;
+    PooledBuffer batch_buffer(buffer_pool);
+    const unsigned char* bitmap = reinterpret_cast<const unsigned char*>(batch_buffer.data());
+    uint64_t run_start = 0;
+    uint64_t run_length = 0;
+
+    auto add_bits = [&](uint64_t first, uint64_t count, bool used) {
+        if (!used) {
+            if (run_length == 0) run_start = first;
+            run_length += count;
+        } else if (run_length > 0) {
+            allocator.add_free(run_start, run_length);
+            run_length = 0;
+        }
+    };
+
+    uint64_t total = superblock.data_block_count;
+    for (uint64_t batch = 0; batch * Geometry::BITMAP_BITS < total; batch += BITMAP_BATCH) {
+        uint64_t blocks = std::min(BITMAP_BATCH, calculate_bitmap_blocks() - batch);
+        read_data_blocks(reserved_start + batch, blocks, batch_buffer.data());
+        uint64_t base = batch * Geometry::BITMAP_BITS;
+        for (uint64_t byte = 0; byte < blocks * Size && base + byte * 8 < total; byte++) {
+            uint64_t first = base + byte * 8;
+            unsigned char bits = bitmap[byte];
+            // 0 号块和位图块即使在旧镜像中未被标记也视为已占用
+            bool special = first == 0 || (first + 8 > reserved_start && first < reserved_end);
+            if (!special && first + 8 <= total && (bits == 0 || bits == 0xFF)) {
+                add_bits(first, 8, bits == 0xFF);
+                continue;
+            }
+            for (uint64_t i = first; i < first + 8 && i < total; i++) {
+                bool used = bits & (1 << (i - first));
+                if (i == 0 || (i >= reserved_start && i < reserved_end)) {
+                    used = true;
+                }
+                add_bits(i, 1, used);
+            }
+        }
     }
+    if (run_length > 0) {
+        allocator.add_free(run_start, run_length);
+    }
+}
+// 更新位图
+void MyFileSystem::update_bitmap(uint64_t block_number, bool allocated) {
+    update_bitmap_range(block_number, 1, allocated);
+}
+// 批量更新位图
+void MyFileSystem::update_bitmap_range(uint64_t start, uint64_t count, bool allocated) {
+    dispatch_block_size(block_size, [&](auto geometry) {
+        update_bitmap_blocks<decltype(geometry)::SIZE>(start, count, allocated);
+    });
+}
 
-    write_data_block(bitmap_block_number, block);
+template <unsigned int Size>
+void MyFileSystem::update_bitmap_blocks(uint64_t start, uint64_t count, bool allocated) {
+    using Geometry = BlockGeometry<Size>;
+    PooledBuffer block_buffer(buffer_pool);
+    char* block = block_buffer.data();
+    uint64_t i = start;
+    uint64_t end = start + count;
+
+    while (i < end) {
+        uint64_t bitmap_block_number = i / Geometry::BITMAP_BITS + bitmap_start_block();
+        // 本位图块覆盖的最后一个块号 (不含)
+        uint64_t block_end = (i / Geometry::BITMAP_BITS + 1) * Geometry::BITMAP_BITS;
+        if (block_end > end) block_end = end;
+
+        read_data_block(bitmap_block_number, block);
+        for (; i < block_end; i++) {
+            unsigned int bit_index = i % Geometry::BITMAP_BITS;
+            unsigned int byte_index = bit_index / 8;
+            unsigned int bit_offset = bit_index % 8;
+            if (allocated) {
+                block[byte_index] |= (1 << bit_offset);
+            } else {
+                block[byte_index] &= ~(1 << bit_offset);
+            }
+        }
+        write_data_block(bitmap_block_number, block);
+    }
 }
 void MyFileSystem::print_bitmap(){
+    OperationScope operation(*this);
     std::cout << "Bitmap status:" << std::endl;
     for (unsigned int i = 0; i < 10; i++) {
         std::cout << check_bitmap(i);
-        if ((i + 1) % (BLOCK_SIZE * 8) == 0) {
+        if ((i + 1) % ((uint64_t)block_size * 8) == 0) {
             std::cout << std::endl;
         }
     }
     std::cout << std::endl;
 }
-bool MyFileSystem::check_bitmap(unsigned int block_number){
-        unsigned int bitmap_block_number = block_number / (BLOCK_SIZE * 8) + 1 + superblock.inode_count * INODE_SIZE / BLOCK_SIZE;
-        unsigned int bit_index = block_number % (BLOCK_SIZE * 8);
+bool MyFileSystem::check_bitmap(uint64_t block_number){
+        uint64_t bitmap_block_number = block_number / ((uint64_t)block_size * 8) + bitmap_start_block();
+        unsigned int bit_index = block_number % ((uint64_t)block_size * 8);
         unsigned int byte_index = bit_index / 8;
         unsigned int bit_offset = bit_index % 8;
 
-        char block[BLOCK_SIZE];
-        read_data_block(bitmap_block_number, block);
+        PooledBuffer block(buffer_pool);
+        read_data_block(bitmap_block_number, block.data());
 
-        return (block[byte_index] & (1 << bit_offset)) != 0;
+        return (block.data()[byte_index] & (1 << bit_offset)) != 0;
     }
+// 目录项的文件名是否等于 name (原地比较，不构造临时字符串)
+static bool entry_name_equals(const DirectoryEntry* entry, std::string_view name) {
+    return name.size() <= MAX_FILE_NAME_LENGTH && memcmp(entry->filename, name.data(), name.size()) == 0 &&
+           entry->filename[name.size()] == '\0';
+}
+
 // 根据路径查找 inode 编号
-int MyFileSystem::path_to_inode(const std::string& path) {
-    if (path == "/") {
-        return 0; // 根目录的 inode 编号为 0
-    }
-
-    std::string current_path = "/";
-    int current_inode_number = 0;
-    std::string delimiter = "/";
-    size_t pos = 0;
-    std::string token;
-    // std::string path_copy{path};
-    size_t start = 1;
-    size_t end = path.find(delimiter, start);
-    // 分割路径
-    while (end != std::string::npos) {
-        token = path.substr(start, end - start);
+int MyFileSystem::path_to_inode(std::string_view path) {
+    int current_inode_number = 0; // 根目录的 inode 编号为 0
+    PooledBuffer block_buffer(buffer_pool);
+    // 逐个取出路径分量，连续的 '/' 视为一个
+    size_t start = path.find_first_not_of('/');
+    while (start != std::string_view::npos) {
+        size_t end = path.find('/', start);
+        std::string_view token = path.substr(start, end == std::string_view::npos ? end : end - start);
 
         // 查找当前目录下的目录项
         Inode current_inode = read_inode(current_inode_number);
         if (current_inode.type != DIRECTORY) {
-            std::cerr << "" << current_path << " is not a directory." << std::endl;
+            std::cerr << path.substr(0, start) << " is not a directory." << std::endl;
             return -1;
         }
         bool found = false;
-        for (int i = 0; i < 10; i++) {
-            if(current_inode.direct_blocks[i] == 0) continue;
-            char block_buffer[BLOCK_SIZE];
-            read_data_block(current_inode.direct_blocks[i], block_buffer);
-            for (int j = 0; j < BLOCK_SIZE / DIRECTORY_ENTRY_SIZE; j++) {
-                DirectoryEntry* entry = reinterpret_cast<DirectoryEntry*>(block_buffer + j * DIRECTORY_ENTRY_SIZE);
-                if (entry->inode_number != 0 && entry->filename == token) {
+        BlockMap block_map;
+        load_block_map(current_inode, block_map);
+        for (uint64_t i = 0; i < block_map.size() && !found; i++) {
+            if (block_map.get(i) == 0) continue;
+            read_data_block(block_map.get(i), block_buffer.data());
+            for (unsigned int j = 0; j < block_size / DIRECTORY_ENTRY_SIZE; j++) {
+                const DirectoryEntry* entry = reinterpret_cast<const DirectoryEntry*>(block_buffer.data() + j * DIRECTORY_ENTRY_SIZE);
+                if (entry->inode_number != 0 && entry_name_equals(entry, token)) {
                     current_inode_number = entry->inode_number;
-                    current_path += token + "/";
                     found = true;
                     break;
                 }
             }
-            if (found) break;
         }
         // 没找到对应的目录项
         if (!found) {
-            std::cerr << "" << token << " not found in " << current_path << std::endl;
+            std::cerr << token << " not found in " << path.substr(0, start) << std::endl;
             return -1;
         }
-        start = end + 1;
-        end = path.find(delimiter, start);
+        start = end == std::string_view::npos ? end : path.find_first_not_of('/', end);
     }
-
-    // 查找最后一个目录项
-    token = path.substr(start);
-    if (!token.empty()) {
-        Inode current_inode = read_inode(current_inode_number);
-        if (current_inode.type != DIRECTORY) {
-            std::cerr << "" << current_path << " is not a directory." << std::endl;
-            return -1;
-        }
-        bool found = false;
-        for (int i = 0; i < 10; i++) {
-            if(current_inode.direct_blocks[i] == 0) continue;
-            char block_buffer[BLOCK_SIZE];
-            read_data_block(current_inode.direct_blocks[i], block_buffer);
-            for (int j = 0; j < BLOCK_SIZE / DIRECTORY_ENTRY_SIZE; j++) {
-                DirectoryEntry* entry = reinterpret_cast<DirectoryEntry*>(block_buffer + j * DIRECTORY_ENTRY_SIZE);
-                if (entry->inode_number != 0 && entry->filename == token) {
-                    current_inode_number = entry->inode_number;
-                    found = true;
-                    break;
-                }
-            }
-             if (found) break;
-        }
-        if (!found) {
-            std::cerr << "" << token << " not found in " << current_path << std::endl;
-            return -1;
-        }
-    }
-
     return current_inode_number;
 }
 
 // 获取父目录的 inode 编号
-int MyFileSystem::get_parent_inode(const std::string& path) {
+int MyFileSystem::get_parent_inode(std::string_view path) {
     size_t last_slash_pos = path.find_last_of('/');
-    if (last_slash_pos == std::string::npos) {
+    if (last_slash_pos == std::string_view::npos) {
         return -1; // 无效路径
     }
     if (last_slash_pos == 0) {
         return 0; // 父目录是根目录
     }
-    std::string parent_path = path.substr(0, last_slash_pos);
-    return path_to_inode(parent_path);
+    return path_to_inode(path.substr(0, last_slash_pos));
+}
+
+// 在目录中添加一项：先找已有目录块中的空位，都满了再在第一个未分配的位置分配新块，
+// 直接块用完后和文件一样使用间接块
+bool MyFileSystem::add_directory_entry(unsigned int parent, Inode& parent_inode, const std::string& name,
+                                       unsigned int inode_number) {
+    const unsigned int entries_per_block = block_size / DIRECTORY_ENTRY_SIZE;
+    BlockMap block_map;
+    load_block_map(parent_inode, block_map);
+    PooledBuffer block_buffer(buffer_pool);
+    uint64_t index = block_map.size();
+    uint64_t hole = block_map.size();
+    unsigned int slot = entries_per_block;
+    for (uint64_t i = 0; i < block_map.size() && slot == entries_per_block; i++) {
+        if (block_map.get(i) == 0) {
+            hole = std::min(hole, i);
+            continue;
+        }
+        read_data_block(block_map.get(i), block_buffer.data());
+        for (unsigned int j = 0; j < entries_per_block; j++) {
+            const DirectoryEntry* entry = reinterpret_cast<const DirectoryEntry*>(block_buffer.data() + j * DIRECTORY_ENTRY_SIZE);
+            if (entry->inode_number == 0) {
+                index = i;
+                slot = j;
+                break;
+            }
+        }
+    }
+
+    if (slot == entries_per_block) {
+        index = hole;
+        if (index >= max_file_blocks()) {
+            std::cerr << "Parent directory is full." << std::endl;
+            return false;
+        }
+        // 分配一个新的数据块给父目录，新块可能残留旧数据，从全 0 开始填写
+        uint64_t new_block = allocate_data_block();
+        if (new_block == (uint64_t)-1) {
+            return false;
+        }
+        block_map[index] = new_block;
+        if (!store_block_map(parent_inode, block_map)) {
+            free_data_block(new_block);
+            return false;
+        }
+        memset(block_buffer.data(), 0, block_size);
+        slot = 0;
+    }
+
+    DirectoryEntry* entry = reinterpret_cast<DirectoryEntry*>(block_buffer.data() + slot * DIRECTORY_ENTRY_SIZE);
+    memset(entry->filename, 0, sizeof(entry->filename));
+    strcpy(entry->filename, name.c_str());
+    entry->inode_number = inode_number;
+    write_data_block(block_map.get(index), block_buffer.data());
+    parent_inode.size += DIRECTORY_ENTRY_SIZE;
+    parent_inode.modified_time = time(nullptr);
+    write_inode(parent, parent_inode);
+    return true;
+}
+
+// 从目录中删除指向 inode_number 的项，目录块保留
+bool MyFileSystem::remove_directory_entry(unsigned int parent, Inode& parent_inode, unsigned int inode_number) {
+    BlockMap block_map;
+    load_block_map(parent_inode, block_map);
+    PooledBuffer block_buffer(buffer_pool);
+    for (uint64_t i = 0; i < block_map.size(); i++) {
+        if (block_map.get(i) == 0) continue;
+        read_data_block(block_map.get(i), block_buffer.data());
+        for (unsigned int j = 0; j < block_size / DIRECTORY_ENTRY_SIZE; j++) {
+            DirectoryEntry* entry = reinterpret_cast<DirectoryEntry*>(block_buffer.data() + j * DIRECTORY_ENTRY_SIZE);
+            if (entry->inode_number == inode_number) {
+                entry->inode_number = 0; // 将 inode 编号设置为 0 表示该目录项为空闲
+                memset(entry->filename, 0, sizeof(entry->filename));
+                write_data_block(block_map.get(i), block_buffer.data());
+                parent_inode.size -= DIRECTORY_ENTRY_SIZE;
+                parent_inode.modified_time = time(nullptr);
+                write_inode(parent, parent_inode);
+                return true;
+            }
+        }
+    }
+    std::cerr << "Failed to remove directory entry from parent." << std::endl;
+    return false;
 }
 
 // 创建目录
 bool MyFileSystem::mkdir(const std::string& path) {
+    TraceScope trace(trace_writer.get(), TRACE_MKDIR, -1, 0, 0, path);
+    OperationScope operation(*this);
     // 检查目录是否已存在
     if (path_to_inode(path) != -1) {
         std::cerr << "Directory already exists." << std::endl;
@@ -373,56 +876,14 @@ bool MyFileSystem::mkdir(const std::string& path) {
         return false;
     }
     // 在父目录中添加新的目录项
-    Inode parent_inode = read_inode(parent_inode_number);
-
-    // 如果是根目录下的第一个目录项，需要为根目录分配数据块
-    if (parent_inode_number == 0 && parent_inode.size == 0) {
-        unsigned int new_block = allocate_data_block();
-        if (new_block == -1) {
-            free_inode(new_inode_number);
-            return false;
-        }
-        parent_inode.direct_blocks[0] = new_block;
-    }
-
-    bool entry_added = false;
-    for (int i = 0; i < 10; i++) {
-        if (parent_inode.direct_blocks[i] == 0) {
-             // 分配一个新的数据块给父目录
-            unsigned int new_block = allocate_data_block();
-            if (new_block == -1) {
-                free_inode(new_inode_number);
-                return false;
-            }
-            parent_inode.direct_blocks[i] = new_block;
-        }
-        char block_buffer[BLOCK_SIZE];
-        read_data_block(parent_inode.direct_blocks[i], block_buffer);
-       
-        for (int j = 0; j < BLOCK_SIZE / DIRECTORY_ENTRY_SIZE; j++) {
-            DirectoryEntry* entry = reinterpret_cast<DirectoryEntry*>(block_buffer + j * DIRECTORY_ENTRY_SIZE);
-            if (entry->inode_number == 0) {
-                std::string filename = path.substr(path.find_last_of('/') + 1);
-                if (filename.length() > MAX_FILE_NAME_LENGTH) {
-                    std::cerr << "Filename too long." << std::endl;
-                    free_inode(new_inode_number);
-                    return false;
-                }
-                strcpy(entry->filename, filename.c_str());
-                entry->inode_number = new_inode_number;
-                write_data_block(parent_inode.direct_blocks[i], block_buffer);
-                parent_inode.size += DIRECTORY_ENTRY_SIZE;
-                parent_inode.modified_time = time(nullptr);
-                write_inode(parent_inode_number, parent_inode);
-                entry_added = true;
-                break;
-            }
-        }
-        if (entry_added) break;
+    std::string filename = path.substr(path.find_last_of('/') + 1);
+    if (filename.length() > MAX_FILE_NAME_LENGTH) {
+        std::cerr << "Filename too long." << std::endl;
+        free_inode(new_inode_number);
+        return false;
     }
-
-    if (!entry_added) {
-        std::cerr << "Parent directory is full." << std::endl;
+    Inode parent_inode = read_inode(parent_inode_number);
+    if (!add_directory_entry(parent_inode_number, parent_inode, filename, new_inode_number)) {
         free_inode(new_inode_number);
         return false;
     }
@@ -442,6 +903,8 @@ bool MyFileSystem::mkdir(const std::string& path) {
 
 // 删除目录
 bool MyFileSystem::rmdir(const std::string& path) {
+    TraceScope trace(trace_writer.get(), TRACE_RMDIR, -1, 0, 0, path);
+    OperationScope operation(*this);
     // 检查目录是否存在
     int inode_number = path_to_inode(path);
     if (inode_number == -1) {
@@ -459,12 +922,14 @@ bool MyFileSystem::rmdir(const std::string& path) {
     // 检查目录是否为空
     if (inode.size > 0) {
         // 遍历目录项，检查是否有文件或子目录
-        for(int i=0; i < 10; i++){
-            if(inode.direct_blocks[i] == 0) continue;
-            char block_buffer[BLOCK_SIZE];
-            read_data_block(inode.direct_blocks[i], block_buffer);
-            for (int j = 0; j < BLOCK_SIZE / DIRECTORY_ENTRY_SIZE; j++) {
-                DirectoryEntry* entry = reinterpret_cast<DirectoryEntry*>(block_buffer + j * DIRECTORY_ENTRY_SIZE);
+        BlockMap block_map;
+        load_block_map(inode, block_map);
+        PooledBuffer block_buffer(buffer_pool);
+        for (uint64_t i = 0; i < block_map.size(); i++) {
+            if (block_map.get(i) == 0) continue;
+            read_data_block(block_map.get(i), block_buffer.data());
+            for (unsigned int j = 0; j < block_size / DIRECTORY_ENTRY_SIZE; j++) {
+                DirectoryEntry* entry = reinterpret_cast<DirectoryEntry*>(block_buffer.data() + j * DIRECTORY_ENTRY_SIZE);
                 if (entry->inode_number != 0) {
                     std::cerr << "Directory is not empty." << std::endl;
                     return false;
@@ -482,29 +947,7 @@ bool MyFileSystem::rmdir(const std::string& path) {
 
     // 从父目录中删除目录项
     Inode parent_inode = read_inode(parent_inode_number);
-    bool entry_removed = false;
-    for(int i = 0; i < 10; i++){
-        if(parent_inode.direct_blocks[i] == 0) continue;
-        char block_buffer[BLOCK_SIZE];
-        read_data_block(parent_inode.direct_blocks[i], block_buffer);
-        for (int j = 0; j < BLOCK_SIZE / DIRECTORY_ENTRY_SIZE; j++) {
-            DirectoryEntry* entry = reinterpret_cast<DirectoryEntry*>(block_buffer + j * DIRECTORY_ENTRY_SIZE);
-            if (entry->inode_number == inode_number) {
-                entry->inode_number = 0; // 将 inode 编号设置为 0 表示该目录项为空闲
-                memset(entry->filename, 0, sizeof(entry->filename));
-                write_data_block(parent_inode.direct_blocks[i], block_buffer);
-                parent_inode.size -= DIRECTORY_ENTRY_SIZE;
-                parent_inode.modified_time = time(nullptr);
-                write_inode(parent_inode_number, parent_inode);
-                entry_removed = true;
-                break;
-            }
-        }
-        if (entry_removed) break;
-    }
-
-    if (!entry_removed) {
-        std::cerr << "Failed to remove directory entry from parent." << std::endl;
+    if (!remove_directory_entry(parent_inode_number, parent_inode, inode_number)) {
         return false;
     }
 
@@ -515,16 +958,20 @@ bool MyFileSystem::rmdir(const std::string& path) {
     return true;
 }
 //改变目录
-bool MyFileSystem::change_dir(std::string&cur,std::string& des){
+bool MyFileSystem::change_dir(std::string& cur, std::string_view des){
+    TraceScope trace(trace_writer.get(), TRACE_CHANGE_DIR, -1, 0, 0, cur, des);
+    OperationScope operation(*this);
+    if (des.empty()) return false;
     if (des==".."){
         if (cur=="/") return false;
-        cur=cur.substr(0,cur.size()-1);
-        cur=cur.substr(0,cur.find_last_of('/'));
-        if (cur=="") cur="/";
+        // cur 总是以 '/' 结尾，去掉最后一级目录后仍保留结尾的 '/'
+        cur.pop_back();
+        cur.resize(cur.find_last_of('/') + 1);
         return true;
     }
-    if (des[0]!='/') des=cur+des;
-    int inode_number = path_to_inode(des);
+    while (des.size() > 1 && des.back() == '/') des.remove_suffix(1);
+    std::string path = des[0] == '/' ? std::string(des) : cur + std::string(des);
+    int inode_number = path_to_inode(path);
     if (inode_number == -1) {
         std::cerr << "Directory does not exist." << std::endl;
         return false;
@@ -535,12 +982,14 @@ bool MyFileSystem::change_dir(std::string&cur,std::string& des){
         std::cerr << "Not a directory." << std::endl;
         return false;
     }
-    cur=des+"/";
+    cur = path == "/" ? path : path + "/";
     return true;
 }
 
 // 创建文件
 bool MyFileSystem::create(const std::string& path) {
+    TraceScope trace(trace_writer.get(), TRACE_CREATE, -1, 0, 0, path);
+    OperationScope operation(*this);
     // 检查文件是否已存在
     if (path_to_inode(path) != -1) {
         std::cerr << "File already exists." << std::endl;
@@ -561,55 +1010,14 @@ bool MyFileSystem::create(const std::string& path) {
     }
 
     // 在父目录中添加新的目录项
-    Inode parent_inode = read_inode(parent_inode_number);
-
-    // 如果是根目录下的第一个文件项，需要为根目录分配数据块
-    if (parent_inode_number == 0 && parent_inode.size == 0) {
-        unsigned int new_block = allocate_data_block();
-        if (new_block == -1) {
-            free_inode(new_inode_number);
-            return false;
-        }
-        parent_inode.direct_blocks[0] = new_block;
-    }
-    
-    bool entry_added = false;
-    for (int i = 0; i < 10; i++) {
-        if (parent_inode.direct_blocks[i] == 0) {
-             // 分配一个新的数据块给父目录
-            unsigned int new_block = allocate_data_block();
-            if (new_block == -1) {
-                free_inode(new_inode_number);
-                return false;
-            }
-            parent_inode.direct_blocks[i] = new_block;
-        }
-        char block_buffer[BLOCK_SIZE];
-        read_data_block(parent_inode.direct_blocks[i], block_buffer);
-        for (int j = 0; j < BLOCK_SIZE / DIRECTORY_ENTRY_SIZE; j++) {
-            DirectoryEntry* entry = reinterpret_cast<DirectoryEntry*>(block_buffer + j * DIRECTORY_ENTRY_SIZE);
-            if (entry->inode_number == 0) {
-                std::string filename = path.substr(path.find_last_of('/') + 1);
-                if (filename.length() > MAX_FILE_NAME_LENGTH) {
-                    std::cerr << "Filename too long." << std::endl;
-                    free_inode(new_inode_number);
-                    return false;
-                }
-                strcpy(entry->filename, filename.c_str());
-                entry->inode_number = new_inode_number;
-                write_data_block(parent_inode.direct_blocks[i], block_buffer);
-                parent_inode.size += DIRECTORY_ENTRY_SIZE;
-                parent_inode.modified_time = time(nullptr);
-                write_inode(parent_inode_number, parent_inode);
-                entry_added = true;
-                break;
-            }
-        }
-        if (entry_added) break;
+    std::string filename = path.substr(path.find_last_of('/') + 1);
+    if (filename.length() > MAX_FILE_NAME_LENGTH) {
+        std::cerr << "Filename too long." << std::endl;
+        free_inode(new_inode_number);
+        return false;
     }
-
-    if (!entry_added) {
-        std::cerr << "Parent directory is full." << std::endl;
+    Inode parent_inode = read_inode(parent_inode_number);
+    if (!add_directory_entry(parent_inode_number, parent_inode, filename, new_inode_number)) {
         free_inode(new_inode_number);
         return false;
     }
@@ -629,6 +1037,8 @@ bool MyFileSystem::create(const std::string& path) {
 
 // 删除文件
 bool MyFileSystem::remove(const std::string& path) {
+    TraceScope trace(trace_writer.get(), TRACE_REMOVE, -1, 0, 0, path);
+    OperationScope operation(*this);
     // 检查文件是否存在
     int inode_number = path_to_inode(path);
     if (inode_number == -1) {
@@ -652,62 +1062,31 @@ bool MyFileSystem::remove(const std::string& path) {
 
     // 从父目录中删除目录项
     Inode parent_inode = read_inode(parent_inode_number);
-    bool entry_removed = false;
-    for(int i = 0; i < 10; i++){
-        if(parent_inode.direct_blocks[i] == 0) continue;
-        char block_buffer[BLOCK_SIZE];
-        read_data_block(parent_inode.direct_blocks[i], block_buffer);
-        for (int j = 0; j < BLOCK_SIZE / DIRECTORY_ENTRY_SIZE; j++) {
-            DirectoryEntry* entry = reinterpret_cast<DirectoryEntry*>(block_buffer + j * DIRECTORY_ENTRY_SIZE);
-            if (entry->inode_number == inode_number) {
-                entry->inode_number = 0; // 将 inode 编号设置为 0 表示该目录项为空闲
-                memset(entry->filename, 0, sizeof(entry->filename));
-                write_data_block(parent_inode.direct_blocks[i], block_buffer);
-                parent_inode.size -= DIRECTORY_ENTRY_SIZE;
-                parent_inode.modified_time = time(nullptr);
-                write_inode(parent_inode_number, parent_inode);
-                entry_removed = true;
-                break;
-            }
-        }
-        if(entry_removed) break;
-    }
-
-    if (!entry_removed) {
-        std::cerr << "Failed to remove directory entry from parent." << std::endl;
+    if (!remove_directory_entry(parent_inode_number, parent_inode, inode_number)) {
         return false;
     }
 
-    // 释放 inode (包括释放数据块)
-    free_inode(inode_number);
+    // 释放 inode (包括释放数据块)，新格式的镜像交给后台线程回收
+    if (superblock.version >= 5) {
+        reclaim_inodes({(unsigned int)inode_number});
+    } else {
+        free_inode(inode_number);
+    }
 
     std::cout << "File removed: " << path << std::endl;
     return true;
 }
 
-// 打开文件 (简化版，仅返回 inode 编号)
-int MyFileSystem::open(const std::string& path) {
-    int inode_number = path_to_inode(path);
-    if (inode_number == -1) {
-        std::cerr << "File does not exist." << std::endl;
-        return -1;
-    }
-
-    Inode inode = read_inode(inode_number);
-    if (inode.type != REGULAR_FILE) {
-        std::cerr << "Not a regular file." << std::endl;
-        return -1;
-    }
-    
-    //更新访问时间
-    inode.accessed_time = time(nullptr);
-    write_inode(inode_number, inode);
-
-    return inode_number;
+// 按 inode 编号读取文件
+bool MyFileSystem::read_file(int inode_number, uint64_t offset, unsigned int length, char* buffer) {
+    return dispatch_block_size(block_size, [&](auto geometry) {
+        return read_blocks<decltype(geometry)::SIZE>(inode_number, offset, length, buffer);
+    });
 }
 
-// 读取文件
-bool MyFileSystem::read(int inode_number, unsigned int offset, unsigned int length, char* buffer) {
+template <unsigned int Size>
+bool MyFileSystem::read_blocks(int inode_number, uint64_t offset, unsigned int length, char* buffer) {
+    using Geometry = BlockGeometry<Size>;
     Inode inode = read_inode(inode_number);
 
     // 检查偏移量是否越界
@@ -722,88 +1101,160 @@ bool MyFileSystem::read(int inode_number, unsigned int offset, unsigned int leng
         bytes_to_read = inode.size - offset;
     }
 
-    unsigned int start_block = offset / BLOCK_SIZE;
-    unsigned int end_block = (offset + bytes_to_read - 1) / BLOCK_SIZE;
-    unsigned int block_offset = offset % BLOCK_SIZE;
+    uint64_t start_block = offset >> Geometry::SHIFT;
+    uint64_t end_block = (offset + bytes_to_read - 1) >> Geometry::SHIFT;
+    unsigned int block_offset = offset & Geometry::MASK;
     unsigned int buffer_offset = 0;
 
-    for (unsigned int i = start_block; i <= end_block; i++) {
-        unsigned int block_number;
-        if (i < 10) {
-            block_number = inode.direct_blocks[i];
-        } else {
-            // todo 需要读取一级间接块
-            
-        }
-
-        if (block_number == 0) {
-            std::cerr << "Data block not allocated." << std::endl;
-            return false;
-        }
+    BlockMap local_map;
+    const BlockMap& block_map = file_block_map(inode_number, inode, local_map);
 
-        char block_buffer[BLOCK_SIZE];
-        read_data_block(block_number, block_buffer);
+    for (uint64_t i = start_block; i <= end_block;) {
+        uint64_t block_number = block_map.get(i);
+        uint64_t run = 1;
 
-        unsigned int bytes_in_block = BLOCK_SIZE - block_offset;
+        unsigned int bytes_in_block = Size - block_offset;
         if (bytes_in_block > bytes_to_read - buffer_offset) {
             bytes_in_block = bytes_to_read - buffer_offset;
         }
 
-        memcpy(buffer + buffer_offset, block_buffer + block_offset, bytes_in_block);
+        if (in_compressed_cluster(block_map, i)) {
+            // 压缩簇经簇缓存解压，小的随机读不必每次都解压整簇
+            const char* cluster = read_cluster(block_map, i / COMPRESS_CLUSTER_BLOCKS);
+            if (!cluster) {
+                return false;
+            }
+            memcpy(buffer + buffer_offset, cluster + (i % COMPRESS_CLUSTER_BLOCKS) * Size + block_offset, bytes_in_block);
+        } else if (block_number == 0) {
+            // 空洞 (truncate 扩大或跳跃写入产生) 读出为 0
+            memset(buffer + buffer_offset, 0, bytes_in_block);
+        } else if (bytes_in_block == Size) {
+            // 整块读取直接读入调用者的缓冲区，物理上连续的整块合并为一次读取
+            while (i + run <= end_block && block_map.get(i + run) == block_number + run &&
+                   buffer_offset + (run + 1) * Size <= bytes_to_read) {
+                run++;
+            }
+            if (!read_data_blocks(block_number, run, buffer + buffer_offset)) {
+                return false;
+            }
+            bytes_in_block = run * Size;
+        } else {
+            PooledBuffer block_buffer(buffer_pool);
+            if (!read_data_block(block_number, block_buffer.data())) {
+                return false;
+            }
+            memcpy(buffer + buffer_offset, block_buffer.data() + block_offset, bytes_in_block);
+        }
         buffer_offset += bytes_in_block;
         block_offset = 0; // 后续的块都是从头开始读取
+        i += run;
     }
     
     //更新访问时间
-    inode.accessed_time = time(nullptr);
-    write_inode(inode_number, inode);
+    touch_atime(inode_number, inode);
     
     return true;
 }
 
-// 写入文件
-bool MyFileSystem::write(int inode_number, unsigned int offset, unsigned int length, const char* buffer) {
+// 按 inode 编号写入文件
+bool MyFileSystem::write_file(int inode_number, uint64_t offset, unsigned int length, const char* buffer) {
+    return dispatch_block_size(block_size, [&](auto geometry) {
+        return write_blocks<decltype(geometry)::SIZE>(inode_number, offset, length, buffer);
+    });
+}
+
+template <unsigned int Size>
+bool MyFileSystem::write_blocks(int inode_number, uint64_t offset, unsigned int length, const char* buffer) {
+    using Geometry = BlockGeometry<Size>;
     Inode inode = read_inode(inode_number);
+    if (length == 0) {
+        return true;
+    }
 
-    unsigned int end_offset = offset + length;
-    unsigned int start_block = offset / BLOCK_SIZE;
-    unsigned int end_block = (end_offset - 1) / BLOCK_SIZE;
-    unsigned int block_offset = offset % BLOCK_SIZE;
+    uint64_t end_offset = offset + length;
+    uint64_t start_block = offset >> Geometry::SHIFT;
+    uint64_t end_block = (end_offset - 1) >> Geometry::SHIFT;
+    unsigned int block_offset = offset & Geometry::MASK;
     unsigned int buffer_offset = 0;
 
-    for (unsigned int i = start_block; i <= end_block; i++) {
-        unsigned int block_number;
-        if (i < 10) {
-            if (inode.direct_blocks[i] == 0) {
-                // 分配一个新的数据块
-                unsigned int new_block = allocate_data_block();
-                if (new_block == -1) {
-                    return false;
-                }
-                inode.direct_blocks[i] = new_block;
+    if (end_block >= max_file_blocks()) {
+        std::cerr << "File too large." << std::endl;
+        return false;
+    }
+
+    // 打开的文件直接修改缓存的块映射表，失败时使其作废
+    BlockMap local_map;
+    BlockMap& block_map = file_block_map(inode_number, inode, local_map);
+    if (mount_options.compress || mount_options.dedup) {
+        // 压缩挂载时按簇读改写，每簇写完后重新压缩；去重挂载时逐块查找内容相同的已有块；
+        // 失败时已写完的部分仍然有效
+        bool ok = mount_options.compress ? write_clusters(inode, block_map, offset, length, buffer)
+                                         : write_dedup(inode, block_map, offset, length, buffer);
+        if (!ok) {
+            write_inode(inode_number, inode);
+            data_generation++;
+            return false;
+        }
+    } else {
+        // 写入范围内的压缩簇先解压为普通块，再一次性为未分配的块分配连续空间，fallocate 预留过的块不会再调用分配器
+        bool map_changed = false;
+        bool expanded = expand_clusters(block_map, start_block, end_block, map_changed);
+        // 首尾块原来是空洞 (扩大文件或去重留下的) 时，新分配的块中是旧数据，不能读出来合并
+        bool head_hole = block_map.get(start_block) == 0;
+        bool tail_hole = block_map.get(end_block) == 0;
+        if (!expanded || !reserve_blocks(block_map, start_block, end_block, map_changed)) {
+            // 已解压的簇换了位置，映射表仍要写回
+            if (map_changed && store_block_map(inode, block_map)) {
+                write_inode(inode_number, inode);
             }
-            block_number = inode.direct_blocks[i];
-        } else {
-            // todo 需要使用一级间接块
-            
+            data_generation++;
+            return false;
         }
-        
-        char block_buffer[BLOCK_SIZE];
-        // 如果不是从块的起始位置开始写入，需要先读取原来的数据
-        if (block_offset > 0 || (block_offset + (length-buffer_offset) < BLOCK_SIZE)) {
-            read_data_block(block_number, block_buffer);
+        // 与克隆文件共享的块先复制一份再写
+        if (!unshare_blocks(block_map, start_block, end_block, block_offset, ((end_offset - 1) & Geometry::MASK) + 1, map_changed)) {
+            data_generation++;
+            return false;
         }
-
-        unsigned int bytes_in_block = BLOCK_SIZE - block_offset;
-        if (bytes_in_block > length - buffer_offset) {
-            bytes_in_block = length - buffer_offset;
+        if (map_changed && !store_block_map(inode, block_map)) {
+            data_generation++;
+            return false;
         }
 
-        memcpy(block_buffer + block_offset, buffer + buffer_offset, bytes_in_block);
-        write_data_block(block_number, block_buffer);
+        for (uint64_t i = start_block; i <= end_block;) {
+            uint64_t block_number = block_map.get(i);
+            uint64_t run = 1;
 
-        buffer_offset += bytes_in_block;
-        block_offset = 0; // 后续的块都是从头开始写入
+            unsigned int bytes_in_block = Size - block_offset;
+            if (bytes_in_block > length - buffer_offset) {
+                bytes_in_block = length - buffer_offset;
+            }
+
+            if (bytes_in_block == Size) {
+                // 整块写入直接使用调用者的缓冲区，物理上连续的整块合并为一次写入
+                while (i + run <= end_block && block_map.get(i + run) == block_number + run &&
+                       buffer_offset + (run + 1) * Size <= length) {
+                    run++;
+                }
+                write_data_blocks(block_number, run, buffer + buffer_offset);
+                bytes_in_block = run * Size;
+            } else {
+                // 不是整块写入时需要先读取原来的数据，文件末尾之后和原来是空洞的块内容视为 0
+                PooledBuffer block_buffer(buffer_pool);
+                if ((i << Geometry::SHIFT) >= inode.size || (i == start_block ? head_hole : tail_hole)) {
+                    memset(block_buffer.data(), 0, Size);
+                } else if (!read_data_block(block_number, block_buffer.data())) {
+                    // 原有数据已损坏，不能在其基础上写入
+                    data_generation++;
+                    return false;
+                }
+                memcpy(block_buffer.data() + block_offset, buffer + buffer_offset, bytes_in_block);
+                write_data_block(block_number, block_buffer.data());
+            }
+
+            buffer_offset += bytes_in_block;
+            block_offset = 0; // 后续的块都是从头开始写入
+            i += run;
+        }
     }
 
     // 更新 inode 的大小和修改时间
@@ -812,74 +1263,382 @@ bool MyFileSystem::write(int inode_number, unsigned int offset, unsigned int len
     }
     inode.modified_time = time(nullptr);
     write_inode(inode_number, inode);
+    keep_block_map(inode_number);
 
     return inode_number;
 }
 
-// 列出目录内容
-bool MyFileSystem::list(const std::string& path) {
-    int inode_number = path_to_inode(path);
-    if (inode_number == -1) {
-        std::cerr << "Directory does not exist." << std::endl;
+// 按 inode 编号修改文件大小
+bool MyFileSystem::truncate_file(int inode_number, uint64_t size) {
+    Inode inode = read_inode(inode_number);
+    if (inode.type != REGULAR_FILE) {
+        std::cerr << "Not a regular file." << std::endl;
+        return false;
+    }
+    if ((size + block_size - 1) / block_size > max_file_blocks()) {
+        std::cerr << "File too large." << std::endl;
         return false;
     }
 
-    Inode inode = read_inode(inode_number);
-    if (inode.type != DIRECTORY) {
-        std::cerr << "Not a directory." << std::endl;
+    BlockMap block_map;
+    load_block_map(inode, block_map);
+    uint64_t keep_blocks = (size + block_size - 1) / block_size;
+
+    bool map_changed = false;
+    if (size <= inode.size) {
+        // 截断点所在的压缩簇先解压为普通块，再释放新文件末尾之后的块 (包括 fallocate 预留的块)
+        if (size % ((uint64_t)COMPRESS_CLUSTER_BLOCKS * block_size) != 0 &&
+            !expand_clusters(block_map, size / block_size, size / block_size, map_changed)) {
+            return false;
+        }
+        release_blocks(block_map, keep_blocks);
+        map_changed = true;
+    }
+
+    // 将最后一个块中文件末尾之后的部分清零，保证之后扩大文件时读出为 0 (压缩簇中文件末尾之后本来就是 0)
+    unsigned int tail = (size < inode.size ? size : inode.size) % block_size;
+    uint64_t tail_block = (size < inode.size ? size : inode.size) / block_size;
+    bool zero_tail = tail != 0 && block_map.get(tail_block) != 0 && !in_compressed_cluster(block_map, tail_block);
+    if (zero_tail && !unshare_blocks(block_map, tail_block, tail_block, 0, tail, map_changed)) {
+        return false;
+    }
+    if (map_changed && !store_block_map(inode, block_map)) {
         return false;
     }
+    if (zero_tail) {
+        PooledBuffer block_buffer(buffer_pool);
+        read_data_block(block_map.get(tail_block), block_buffer.data());
+        memset(block_buffer.data() + tail, 0, block_size - tail);
+        write_data_block(block_map.get(tail_block), block_buffer.data());
+    }
 
-    inode.accessed_time = time(nullptr);
+    inode.size = size;
+    inode.modified_time = time(nullptr);
     write_inode(inode_number, inode);
+    return true;
+}
 
-    std::cout << "Listing directory: " << path << std::endl;
-    // 存储目录项信息的 vector
-    std::vector<std::vector<std::string>> rows;
-
-    // 获取表头
-    rows.push_back({"Type", "Permissions", "Size", "Created Time", "Name"});
-
-    // 遍历目录项并收集信息
-    for (int i = 0; i < 10; i++) {
-        if (inode.direct_blocks[i] == 0) continue;
-        char block_buffer[BLOCK_SIZE];
-        read_data_block(inode.direct_blocks[i], block_buffer);
-
-        for (int j = 0; j < BLOCK_SIZE / DIRECTORY_ENTRY_SIZE; j++) {
-            DirectoryEntry* entry = reinterpret_cast<DirectoryEntry*>(block_buffer + j * DIRECTORY_ENTRY_SIZE);
-            if (entry->inode_number != 0) {
-                Inode entry_inode = read_inode(entry->inode_number);
-                rows.push_back({
-                    (entry_inode.type == DIRECTORY ? "d" : "-"),
-                    std::to_string(entry_inode.permissions),
-                    std::to_string(entry_inode.size),
-                    std::asctime(std::localtime(&entry_inode.created_time)),
-                    entry->filename
-                });
+// 按 inode 编号预留数据块
+bool MyFileSystem::fallocate_file(int inode_number, uint64_t offset, uint64_t length) {
+    Inode inode = read_inode(inode_number);
+    if (inode.type != REGULAR_FILE) {
+        std::cerr << "Not a regular file." << std::endl;
+        return false;
+    }
+    if (length == 0) {
+        return true;
+    }
+    uint64_t first = offset / block_size;
+    uint64_t last = (offset + length - 1) / block_size;
+    if (last >= max_file_blocks()) {
+        std::cerr << "File too large." << std::endl;
+        return false;
+    }
+
+    BlockMap block_map;
+    load_block_map(inode, block_map);
+    bool map_changed = false;
+    // 压缩簇中没有用到的映射项不能用来预留，先解压为普通块；预留的块清零，之后读出、扩大文件或部分写入时都是 0
+    if (!expand_clusters(block_map, first, last, map_changed) ||
+        !reserve_blocks(block_map, first, last, map_changed, true)) {
+        if (map_changed && store_block_map(inode, block_map)) {
+            write_inode(inode_number, inode);
+        }
+        return false;
+    }
+    if (map_changed) {
+        if (!store_block_map(inode, block_map)) {
+            return false;
+        }
+        write_inode(inode_number, inode);
+    }
+    return true;
+}
+
+// 读取块映射表，只读取实际存在的间接块
+void MyFileSystem::load_block_map(const Inode& inode, BlockMap& block_map) {
+    load_block_map(inode, block_map, nullptr);
+}
+
+void MyFileSystem::load_block_map(const Inode& inode, BlockMap& block_map, ImageReader* image) {
+    auto read_table = [&](uint64_t block_number, void* buffer) {
+        if (image) {
+            read_data_block(block_number, static_cast<char*>(buffer), *image);
+        } else {
+            read_data_block(block_number, static_cast<char*>(buffer));
+        }
+    };
+    block_map.blocks.assign(inode.direct_blocks, inode.direct_blocks + DIRECT_BLOCK_COUNT);
+    block_map.level1.clear();
+    if (inode.indirect_block != 0 || inode.double_indirect_block != 0) {
+        block_map.blocks.resize(DIRECT_BLOCK_COUNT + indirect_entries(), 0);
+    }
+    if (inode.indirect_block != 0) {
+        read_table(inode.indirect_block, block_map.blocks.data() + DIRECT_BLOCK_COUNT);
+    }
+    if (inode.double_indirect_block != 0) {
+        block_map.level1.resize(indirect_entries());
+        read_table(inode.double_indirect_block, block_map.level1.data());
+        // 只加载到最后一个存在的一级表为止
+        int last = indirect_entries() - 1;
+        while (last >= 0 && block_map.level1[last] == 0) last--;
+        uint64_t base = DIRECT_BLOCK_COUNT + indirect_entries();
+        block_map.blocks.resize(base + (uint64_t)(last + 1) * indirect_entries(), 0);
+        for (int j = 0; j <= last; j++) {
+            if (block_map.level1[j] == 0) continue;
+            read_table(block_map.level1[j], block_map.blocks.data() + base + (uint64_t)j * indirect_entries());
+        }
+    }
+    block_map.loaded = block_map.blocks;
+}
+
+// 写回块映射表
+bool MyFileSystem::store_block_map(Inode& inode, BlockMap& block_map) {
+    for (int i = 0; i < DIRECT_BLOCK_COUNT; i++) {
+        inode.direct_blocks[i] = block_map.get(i);
+    }
+
+    // 按间接块的粒度补齐映射表，便于逐块比较
+    uint64_t base = DIRECT_BLOCK_COUNT + indirect_entries();
+    uint64_t tables = block_map.size() > base ? (block_map.size() - base + indirect_entries() - 1) / indirect_entries() : 0;
+    uint64_t padded = base + tables * indirect_entries();
+    block_map.blocks.resize(padded, 0);
+    block_map.loaded.resize(padded, 0);
+
+    // 一级间接块
+    uint64_t block_number = store_indirect_block(inode.indirect_block,
+                                                 block_map.blocks.data() + DIRECT_BLOCK_COUNT,
+                                                 block_map.loaded.data() + DIRECT_BLOCK_COUNT);
+    if (block_number == (uint64_t)-1) {
+        return false;
+    }
+    inode.indirect_block = block_number;
+
+    // 二级间接块：逐个写回发生变化的一级表，再写回二级表本身
+    std::vector<uint64_t> level1(block_map.level1);
+    level1.resize(indirect_entries(), 0);
+    bool level1_changed = false;
+    for (uint64_t j = 0; j < tables; j++) {
+        uint64_t table = store_indirect_block(level1[j],
+                                              block_map.blocks.data() + base + j * indirect_entries(),
+                                              block_map.loaded.data() + base + j * indirect_entries());
+        if (table == (uint64_t)-1) {
+            return false;
+        }
+        if (table != level1[j]) {
+            level1[j] = table;
+            level1_changed = true;
+        }
+    }
+    std::vector<uint64_t> empty_level1(indirect_entries(), 0);
+    std::vector<uint64_t> loaded_level1(block_map.level1);
+    loaded_level1.resize(indirect_entries(), 0);
+    if (level1_changed || inode.double_indirect_block == 0) {
+        block_number = store_indirect_block(inode.double_indirect_block, level1.data(),
+                                            level1_changed ? empty_level1.data() : loaded_level1.data());
+        if (block_number == (uint64_t)-1) {
+            return false;
+        }
+        inode.double_indirect_block = block_number;
+    }
+    block_map.level1 = inode.double_indirect_block != 0 ? level1 : std::vector<uint64_t>();
+
+    // 去掉末尾未分配的部分
+    while (block_map.blocks.size() > DIRECT_BLOCK_COUNT && block_map.blocks.back() == 0) {
+        block_map.blocks.pop_back();
+    }
+    block_map.loaded = block_map.blocks;
+    return true;
+}
+
+// 写回一个间接块
+uint64_t MyFileSystem::store_indirect_block(uint64_t block_number, const uint64_t* entries, const uint64_t* loaded_entries) {
+    bool empty = true;
+    bool changed = false;
+    for (unsigned int i = 0; i < indirect_entries(); i++) {
+        if (entries[i] != 0) empty = false;
+        if (entries[i] != loaded_entries[i]) changed = true;
+    }
+
+    if (empty) {
+        // 不再需要间接块，将其释放
+        if (block_number != 0) {
+            free_data_block(block_number);
+        }
+        return 0;
+    }
+    if (block_number == 0) {
+        block_number = allocate_data_block();
+        if (block_number == (uint64_t)-1) {
+            return -1;
+        }
+        changed = true;
+    }
+    if (changed) {
+        write_data_block(block_number, reinterpret_cast<const char*>(entries));
+    }
+    return block_number;
+}
+
+// 为未分配的逻辑块分配数据块
+bool MyFileSystem::reserve_blocks(BlockMap& block_map, uint64_t first, uint64_t last, bool& changed, bool zero) {
+    uint64_t needed = 0;
+    for (uint64_t i = first; i <= last; i++) {
+        if (block_map.get(i) == 0) needed++;
+    }
+    if (needed == 0) {
+        return true;
+    }
+
+    // 尽量紧接在前一个逻辑块之后分配
+    uint64_t hint = (first > 0 && block_map.get(first - 1) != 0) ? block_map.get(first - 1) + 1 : 0;
+    std::vector<std::pair<uint64_t, uint64_t>> runs;
+    uint64_t i = first;
+    while (needed > 0) {
+        uint64_t start;
+        uint64_t allocated = allocate_data_blocks(needed, hint, start);
+        if (allocated == 0) {
+            // 分配失败，回滚本次已分配的块
+            for (auto& run : runs) {
+                free_data_blocks(run.first, run.second);
+            }
+            for (uint64_t j = first; j <= last; j++) {
+                for (auto& run : runs) {
+                    if (block_map.get(j) >= run.first && block_map.get(j) < run.first + run.second) {
+                        block_map[j] = 0;
+                    }
+                }
             }
+            return false;
         }
+        runs.push_back({start, allocated});
+        for (uint64_t k = 0; k < allocated; k++) {
+            while (block_map.get(i) != 0) i++;
+            block_map[i] = start + k;
+        }
+        needed -= allocated;
+        hint = start + allocated;
+    }
+    if (zero) {
+        for (auto& run : runs) {
+            zero_data_blocks(run.first, run.second);
+        }
+    }
+    changed = true;
+    return true;
+}
+
+// 写时复制
+bool MyFileSystem::unshare_blocks(BlockMap& block_map, uint64_t first, uint64_t last,
+                                  unsigned int head_offset, unsigned int tail_end, bool& changed) {
+    if (block_refcount.empty()) {
+        return true;
     }
 
-    // 计算每列的最大宽度
-    std::vector<size_t> widths(rows[0].size(), 0);
-    for (const auto& row : rows) {
-        for (size_t i = 0; i < row.size(); ++i) {
-            widths[i] = std::max(widths[i], row[i].size());
+    // 先把共享块从映射中摘下，再统一分配一段连续的新块
+    std::vector<std::pair<uint64_t, uint64_t>> shared;  // (逻辑块号, 原数据块号)
+    for (uint64_t i = first; i <= last; i++) {
+        if (block_map.get(i) != 0 && is_shared(block_map.get(i))) {
+            shared.push_back({i, block_map.get(i)});
+            block_map[i] = 0;
         }
     }
+    if (shared.empty()) {
+        return true;
+    }
+    if (!reserve_blocks(block_map, first, last, changed)) {
+        for (auto& entry : shared) {
+            block_map[entry.first] = entry.second;
+        }
+        return false;
+    }
 
-    // 打印表格
-    for (const auto& row : rows) {
-        for (size_t i = 0; i < row.size(); ++i) {
-             // 移除多余的换行符
-            std::string cell = row[i];
-            cell.erase(std::remove(cell.begin(), cell.end(), '\n'), cell.end());
+    for (auto& entry : shared) {
+        bool partial = (entry.first == first && head_offset > 0) || (entry.first == last && tail_end < block_size);
+        if (partial) {
+            PooledBuffer block_buffer(buffer_pool);
+            read_data_block(entry.second, block_buffer.data());
+            write_data_block(block_map.get(entry.first), block_buffer.data());
+        }
+        // 原块的引用计数减一
+        free_data_block(entry.second);
+    }
+    changed = true;
+    return true;
+}
 
-            std::cout << std::left << std::setw(widths[i] + 2) << cell;
+// 释放从 first 开始的所有逻辑块，物理上连续的块合并释放
+void MyFileSystem::release_blocks(BlockMap& block_map, uint64_t first) {
+    uint64_t run_start = 0;
+    uint64_t run_length = 0;
+    for (uint64_t i = first; i < block_map.size(); i++) {
+        if (block_map.get(i) == 0) continue;
+        if (block_map.get(i) == COMPRESSED_CLUSTER) {
+            block_map[i] = 0;
+            continue;
         }
-        std::cout << std::endl;
+        if (run_length > 0 && block_map.get(i) == run_start + run_length) {
+            run_length++;
+        } else {
+            if (run_length > 0) free_data_blocks(run_start, run_length);
+            run_start = block_map.get(i);
+            run_length = 1;
+        }
+        block_map[i] = 0;
     }
+    if (run_length > 0) free_data_blocks(run_start, run_length);
+}
 
+// 列出目录内容
+bool MyFileSystem::list(const std::string& path) {
+    TraceScope trace(trace_writer.get(), TRACE_LIST, -1, 0, 0, path);
+    OperationScope operation(*this);
+    std::vector<DirEntryPlus> entries;
+    uint64_t cursor = 0;
+    if (!readdir_plus(path, entries, cursor)) {
+        return false;
+    }
+
+    std::cout << "Listing directory: " << path << std::endl;
+    // 时间格式同 asctime，相邻的项多半是同一时刻创建的，重复时沿用上一次的结果
+    std::vector<std::string> times(entries.size());
+    for (size_t k = 0; k < entries.size(); k++) {
+        if (k > 0 && entries[k].created_time == entries[k - 1].created_time) {
+            times[k] = times[k - 1];
+            continue;
+        }
+        char text[64];
+        std::tm tm{};
+        localtime_r(&entries[k].created_time, &tm);
+        times[k].assign(text, std::strftime(text, sizeof(text), "%a %b %e %H:%M:%S %Y", &tm));
+    }
+
+    // 计算每列的最大宽度
+    const char* headers[] = {"Type", "Permissions", "Size", "Created Time", "Name"};
+    size_t widths[5];
+    for (int i = 0; i < 5; i++) {
+        widths[i] = strlen(headers[i]);
+    }
+    for (size_t k = 0; k < entries.size(); k++) {
+        widths[1] = std::max(widths[1], std::to_string(entries[k].permissions).size());
+        widths[2] = std::max(widths[2], std::to_string(entries[k].size).size());
+        widths[3] = std::max(widths[3], times[k].size());
+        widths[4] = std::max(widths[4], entries[k].name.size());
+    }
+
+    // 打印表格
+    std::cout << std::left;
+    for (int i = 0; i < 5; i++) {
+        std::cout << std::setw(widths[i] + 2) << headers[i];
+    }
+    std::cout << std::endl;
+    for (size_t k = 0; k < entries.size(); k++) {
+        std::cout << std::setw(widths[0] + 2) << (entries[k].type == DIRECTORY ? "d" : "-")
+                  << std::setw(widths[1] + 2) << entries[k].permissions
+                  << std::setw(widths[2] + 2) << entries[k].size
+                  << std::setw(widths[3] + 2) << times[k]
+                  << std::setw(widths[4] + 2) << entries[k].name << std::endl;
+    }
+    std::cout << std::right;
     return true;
 }
\ No newline at end of file
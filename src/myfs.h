@@ -5,34 +5,79 @@
 #include <cstring>
 #include <ctime>
 #include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <future>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
 #include "util.h"
-const int BLOCK_SIZE = 4096;  // 数据块大小
+#include "allocator.h"
+#include "block_size.h"
+#include "trace.h"
+#include "stripe.h"
+#include "buffer_pool.h"
+class AsyncQueue;
+class ReclaimQueue;
+class ThreadPool;
 const int MAX_FILE_NAME_LENGTH = 255;
+const int DIRECT_BLOCK_COUNT = 10;  // 直接块指针数量
 
 // 魔数，用于标识文件系统
 const unsigned int MAGIC_NUMBER = 0xDEADBEEF;
+// 磁盘格式版本：1 为 32 位地址的旧格式，2 起超级块、块指针和偏移量均为 64 位，3 起带 CRC32C 校验和，
+// 4 起数据块可以条带分布到多个镜像文件上，5 起删除的文件由后台线程回收，超级块记录待回收的 inode 数，
+// 6 起块映射表中可以有压缩簇，7 起超级块记录去重索引的位置
+const unsigned int FS_VERSION = 7;
+// 仍可挂载的最早版本 (版本 2 的镜像挂载后不做校验)
+const unsigned int FS_MIN_VERSION = 2;
 
 // 文件类型
 enum FileType {
     DIRECTORY,
-    REGULAR_FILE
+    REGULAR_FILE,
+    RECLAIMING      // 已从目录中删除、数据块还在等待后台回收的文件或目录
 };
 
 // 超级块
+// version 紧跟在魔数之后，旧格式在同一位置存放的是 total_size，不会与版本号相同
 struct Superblock {
     unsigned int magic_number;
-    unsigned int total_size;
+    unsigned int version;
     unsigned int block_size;
     unsigned int inode_count;
-    unsigned int data_block_count;
-    unsigned int free_inode_start;
-    unsigned int free_data_block_start;
-    unsigned int free_inode_count;
-    unsigned int free_data_block_count;
-
-    Superblock() : magic_number(MAGIC_NUMBER), total_size(0), block_size(BLOCK_SIZE), inode_count(0),
-                     data_block_count(0), free_inode_start(0), free_data_block_start(0), free_inode_count(0),
-                     free_data_block_count(0) {}
+    uint64_t total_size;
+    uint64_t data_block_count;
+    uint64_t free_inode_start;
+    uint64_t free_data_block_start;
+    uint64_t free_inode_count;
+    uint64_t free_data_block_count;
+    uint64_t refcount_start;  // 块引用计数表的起始数据块号 (0 表示尚未创建)
+    // 以下字段从版本 3 开始才有，版本 2 的超级块到 refcount_start 为止
+    uint64_t checksum_start;  // 校验和表的起始数据块号 (0 表示不校验)
+    unsigned int checksum;    // 超级块中除此字段以外部分的 CRC32C
+    // 以下字段从版本 4 开始才有
+    unsigned int device_count;  // 镜像文件数，大于 1 时成员镜像的路径记在 0 号数据块中
+    uint64_t stripe_start;      // 在此之前的数据块 (位图、校验和表) 只放在主镜像上
+    unsigned int stripe_blocks; // 条带宽度 (块)
+    // 以下字段从版本 5 开始才有 (占用版本 4 结构体末尾的填充)
+    unsigned int reclaim_count; // 类型为 RECLAIMING 的 inode 数，不为 0 时挂载后继续回收
+    // 以下字段从版本 7 开始才有
+    uint64_t dedup_start;       // 去重索引的起始数据块号 (0 表示尚未创建)
+    uint64_t dedup_buckets;     // 去重索引的桶数，每个桶占一个数据块
+
+    Superblock() : magic_number(MAGIC_NUMBER), version(FS_VERSION), block_size(DEFAULT_BLOCK_SIZE), inode_count(0),
+                     total_size(0), data_block_count(0), free_inode_start(0), free_data_block_start(0),
+                     free_inode_count(0), free_data_block_count(0), refcount_start(0), checksum_start(0), checksum(0),
+                     device_count(1), stripe_start(0), stripe_blocks(1), reclaim_count(0),
+                     dedup_start(0), dedup_buckets(0) {}
 };
 
 // 目录项
@@ -48,46 +93,320 @@ struct DirectoryEntry {
 // 索引节点
 struct Inode {
     FileType type;
-    unsigned int size;
     unsigned int permissions;
+    uint64_t size;
     time_t created_time;
     time_t modified_time;
     time_t accessed_time;
-    unsigned int direct_blocks[10]; // 直接块指针
-    unsigned int indirect_block;   // 一级间接块指针 (可以扩展为多级)
+    uint64_t direct_blocks[DIRECT_BLOCK_COUNT]; // 直接块指针
+    uint64_t indirect_block;          // 一级间接块指针
+    uint64_t double_indirect_block;   // 二级间接块指针
     char path[255]; //文件路径
     bool used;
 
-    Inode() : type(REGULAR_FILE), size(0), permissions(0644), created_time(0), modified_time(0),
-                accessed_time(0), indirect_block(0),path(""),used(false) {
-        for (int i = 0; i < 10; i++) {
+    Inode() : type(REGULAR_FILE), permissions(0644), size(0), created_time(0), modified_time(0),
+                accessed_time(0), indirect_block(0), double_indirect_block(0), path(""), used(false) {
+        for (int i = 0; i < DIRECT_BLOCK_COUNT; i++) {
             direct_blocks[i] = 0;
         }
     }
 };
+// 文件的块映射表 (逻辑块号 -> 数据块号，0 表示未分配)
+// 只加载实际存在的间接块，写回时只写内容发生变化的间接块
+struct BlockMap {
+    std::vector<uint64_t> blocks;     // 映射表，超出范围的逻辑块视为未分配
+    std::vector<uint64_t> loaded;     // 从磁盘加载时的内容
+    std::vector<uint64_t> level1;     // 二级间接块中的指针 (指向各个一级表)
+
+    // 读取逻辑块对应的数据块号
+    uint64_t get(uint64_t index) const { return index < blocks.size() ? blocks[index] : 0; }
+    // 获取可修改的引用，必要时扩大映射表
+    uint64_t& operator[](uint64_t index) {
+        if (index >= blocks.size()) blocks.resize(index + 1, 0);
+        return blocks[index];
+    }
+    uint64_t size() const { return blocks.size(); }
+    std::vector<uint64_t>::const_iterator begin() const { return blocks.begin(); }
+    std::vector<uint64_t>::const_iterator end() const { return blocks.end(); }
+};
+
+// 目录树遍历得到的节点
+struct TreeNode {
+    unsigned int inode_number;
+    TreeNode* parent;             // 起点为 nullptr
+    std::string name;
+    std::string path;
+    Inode inode;
+    BlockMap block_map;           // 遍历时要求加载才有内容
+    uint64_t allocated_blocks;    // 占用的数据块数 (包括间接块)
+    std::vector<TreeNode*> children;
+
+    TreeNode() : inode_number(0), parent(nullptr), allocated_blocks(0) {}
+};
+
+// 打开的文件在内存中的 inode 和块映射表，同一文件的所有句柄共用，最后一个句柄关闭时写回
+struct CachedInode {
+    Inode inode;
+    BlockMap block_map;
+    uint64_t map_generation;  // 加载块映射表时的 data_generation，不相等时需要重新加载
+    unsigned int handles;     // 引用它的句柄数
+    bool dirty;               // inode 有未写回磁盘的修改
+
+    CachedInode() : map_generation(0), handles(0), dirty(false) {}
+};
+
+// 文件句柄 (打开文件表的表项)
+struct FileHandle {
+    int inode_number;              // -1 表示空闲的表项
+    bool removed;                  // 文件已被删除，句柄只能关闭
+    uint64_t position;             // 不带偏移量的读写从这里开始
+    uint64_t next_offset;          // 上一次读取的结束位置，下一次从这里读视为顺序读
+    uint64_t readahead_blocks;     // 预读窗口的块数，顺序读时逐次加倍
+    uint64_t readahead_start;      // 预读缓冲区第一个块的逻辑块号
+    uint64_t readahead_generation; // 预读时的 data_generation，不相等时缓冲区作废
+    AlignedBuffer readahead;       // 预读的数据 (对齐，直接 I/O 时可以直接读入)
+
+    FileHandle() : inode_number(-1), removed(false), position(0), next_offset(0), readahead_blocks(0),
+                   readahead_start(0), readahead_generation(0) {}
+};
+
+// 写回队列：写盘操作先把脏数据块、脏 inode 和超级块收集在这里，写回时按磁盘偏移排序，
+// 相邻的合并为一次大的写入，整批写完只落盘一次
+struct WritebackQueue {
+    std::map<uint64_t, AlignedBuffer> blocks;  // 数据块号 -> 待写入的内容
+    std::map<unsigned int, Inode> inodes;      // inode 编号 -> 待写入的内容
+    bool superblock;                           // 超级块有未写回的修改
+    bool unflushed;                            // 有绕过队列直接写下的数据，还没有落盘
+    bool failed;                               // 上次 sync 之后有写回没能写下或落盘
+    unsigned int depth;                        // 嵌套的 OperationScope 层数
+
+    WritebackQueue() : superblock(false), unflushed(false), failed(false), depth(0) {}
+};
+
+// 写回统计，用于观察每批的大小和合并的效果
+struct WritebackStats {
+    uint64_t batches;          // 写回的批数
+    uint64_t largest_batch;    // 最大一批写回的项数 (数据块、inode 和超级块)
+    uint64_t blocks;           // 写回的数据块数
+    uint64_t block_writes;     // 合并后写数据块的次数
+    uint64_t inodes;           // 写回的 inode 数
+    uint64_t inode_writes;     // 合并后写 inode 表的次数
+    uint64_t superblocks;      // 写超级块的次数
+    uint64_t absorbed;         // 写回前被再次修改、省掉的写入次数
+    uint64_t bypassed_blocks;  // 大块写入不经过队列直接写盘的块数
+    uint64_t syncs;            // 对所有设备 fdatasync 的次数
+
+    WritebackStats() : batches(0), largest_batch(0), blocks(0), block_writes(0), inodes(0), inode_writes(0),
+                       superblocks(0), absorbed(0), bypassed_blocks(0), syncs(0) {}
+};
+
+// 访问时间的更新策略
+enum AtimeMode {
+    ATIME_STRICT,    // 每次访问都写回 inode
+    ATIME_NOATIME,   // 不更新访问时间
+    ATIME_RELATIME,  // 访问时间早于修改时间或超过一天时才更新
+    ATIME_LAZYTIME   // 只在内存中更新，卸载、sync 或积累过多时才写回
+};
+
+// 挂载选项
+struct MountOptions {
+    AtimeMode atime;
+    bool sync;       // true 时每次调用返回前就把这次调用的写入写回并 fdatasync 到每个设备；false 时写回队列积累到一定量、sync 或 unmount 时才写回
+    bool direct;     // 数据区用 O_DIRECT 读写，绕过流缓冲和页缓存 (块大小须为 DIRECT_IO_ALIGNMENT 的整数倍)
+    bool huge_pages; // 缓冲区池尽量使用大页
+    bool compress;   // 写入时按簇压缩，能省下块的簇压缩存放 (须为版本 6 起的镜像)
+    bool dedup;      // 写入时按内容去重，与已有块相同的块改为共享 (须为版本 7 起带校验和的镜像，与 compress 同时指定时只压缩)
+
+    MountOptions() : atime(ATIME_STRICT), sync(true), direct(false), huge_pages(false), compress(false), dedup(false) {}
+};
+
+// 解析逗号分隔的挂载选项，如 "noatime,async"
+bool parse_mount_options(std::string_view text, MountOptions& options);
+
+// 多设备布局 (格式化时指定)：数据块按条带 (RAID-0) 轮流分布到主镜像和成员镜像上，大块读写在各设备上并行
+struct DeviceLayout {
+    std::vector<std::string> members;  // 主镜像之外的成员镜像文件，为空时只用主镜像
+    unsigned int stripe_size;          // 条带宽度 (字节)，须为块大小的整数倍
+    bool metadata_on_primary;          // true 时位图和校验和表只放在主镜像上，否则与数据块一起条带分布
+
+    DeviceLayout() : stripe_size(64 * 1024), metadata_on_primary(true) {}
+};
+
+// 碎片统计
+struct FragStats {
+    uint64_t files;               // 统计的文件数
+    uint64_t blocks;              // 已分配的数据块数
+    uint64_t extents;             // 物理上连续的区段数
+    uint64_t total_gap;           // 相邻区段之间间隔的块数之和
+    uint64_t gaps;                // 相邻区段的对数
+
+    FragStats() : files(0), blocks(0), extents(0), total_gap(0), gaps(0) {}
+};
+
+// 目录项及其属性 (readdir_plus 的结果)
+struct DirEntryPlus {
+    unsigned int inode_number;
+    FileType type;
+    unsigned int permissions;
+    uint64_t size;
+    time_t created_time;
+    time_t modified_time;
+    time_t accessed_time;
+    std::string name;
+
+    DirEntryPlus() : inode_number(0), type(REGULAR_FILE), permissions(0), size(0), created_time(0),
+                     modified_time(0), accessed_time(0) {}
+};
+
+// readdir_plus 的游标：已读到目录末尾
+const uint64_t READDIR_END = UINT64_MAX;
+
+// 压缩簇：每 COMPRESS_CLUSTER_BLOCKS 个逻辑块为一簇，压缩后能省下块时压缩存放，
+// 簇的第一个映射项为 COMPRESSED_CLUSTER，其后依次是存放压缩数据的数据块，余下的映射项为 0
+const unsigned int COMPRESS_CLUSTER_BLOCKS = 4;
+const uint64_t COMPRESSED_CLUSTER = UINT64_MAX;
+
+// 块映射项是否指向数据块 (不是空洞，也不是压缩簇的标记)
+inline bool maps_data_block(uint64_t entry) {
+    return entry != 0 && entry != COMPRESSED_CLUSTER;
+}
+
+// 压缩统计 (跨挂载累计)
+struct CompressionStats {
+    uint64_t compressed_clusters;   // 压缩存放的簇数 (每写一次计一次)
+    uint64_t raw_clusters;          // 压缩后省不下块、按普通块存放的簇数
+    uint64_t input_blocks;          // 压缩存放的簇不压缩时需要的块数
+    uint64_t stored_blocks;         // 压缩存放的簇实际占用的块数
+    uint64_t compress_bytes;        // 交给压缩的字节数
+    uint64_t compress_ns;           // 压缩耗时 (包括省不下块的簇)
+    uint64_t decompress_ns;         // 解压耗时
+    uint64_t decompressed_clusters; // 解压的簇数 (簇缓存未命中)
+    uint64_t cache_hits;            // 簇缓存命中次数
+
+    CompressionStats() : compressed_clusters(0), raw_clusters(0), input_blocks(0), stored_blocks(0), compress_bytes(0),
+                         compress_ns(0), decompress_ns(0), decompressed_clusters(0), cache_hits(0) {}
+};
+
+// 去重索引的一项：索引是按块内容的校验和 (与校验和表中记录的 CRC32C 相同) 分桶的散列表，
+// 每个桶占一个数据块，桶满时覆盖最早登记的项；数据块被改写或释放时从索引中删去
+struct DedupEntry {
+    uint64_t block_number;  // 0 表示空项
+    uint32_t hash;          // 块内容的校验和
+    uint32_t sequence;      // 登记时的序号 (桶内递增)
+};
+
+// 去重统计 (跨挂载累计)
+struct DedupStats {
+    uint64_t written_blocks;    // 经过去重写入路径的块数
+    uint64_t duplicate_blocks;  // 与已有块内容相同、改为共享的块数 (包括同一次写入中重复的块)
+    uint64_t zero_blocks;       // 全为 0、不分配的块数
+    uint64_t unchanged_blocks;  // 与原来的内容相同、不必写的块数
+    uint64_t hash_mismatches;   // 校验和相同但内容不同的候选块数
+    uint64_t hash_ns;           // 计算校验和的耗时
+    uint64_t lookup_ns;         // 查找索引和比较候选块内容的耗时
+    uint64_t bucket_reads;      // 从磁盘读入索引桶的次数 (桶缓存未命中)
+    uint64_t cache_hits;        // 桶缓存命中次数
+    uint64_t evictions;         // 桶满时被覆盖的项数
+
+    DedupStats() : written_blocks(0), duplicate_blocks(0), zero_blocks(0), unchanged_blocks(0), hash_mismatches(0),
+                   hash_ns(0), lookup_ns(0), bucket_reads(0), cache_hits(0), evictions(0) {}
+};
 // 定义常量
 
 const int INODE_SIZE = sizeof(Inode);
 const int SUPERBLOCK_SIZE = sizeof(Superblock);
+const int SUPERBLOCK_V2_SIZE = offsetof(Superblock, checksum_start);
+const int SUPERBLOCK_V3_SIZE = offsetof(Superblock, device_count);
+const int SUPERBLOCK_V4_SIZE = offsetof(Superblock, reclaim_count);
+const int SUPERBLOCK_V6_SIZE = offsetof(Superblock, dedup_start);
+// 各版本的超级块写入磁盘的字节数
+inline int superblock_disk_size(unsigned int version) {
+    return version >= 7 ? SUPERBLOCK_SIZE
+         : version >= 4 ? SUPERBLOCK_V6_SIZE
+         : version >= 3 ? SUPERBLOCK_V3_SIZE
+                        : SUPERBLOCK_V2_SIZE;
+}
 const int DIRECTORY_ENTRY_SIZE = sizeof(DirectoryEntry);
+// 块缓冲区池中的缓冲区个数，同时使用的块缓冲区超过这个数时临时分配
+const size_t BUFFER_POOL_SLOTS = 16;
+// 写回队列中的数据块超过这个字节数或 inode 超过这个数时立即写回，限制队列占用的内存
+const uint64_t WRITEBACK_MAX_BYTES = 16 * 1024 * 1024;
+const size_t WRITEBACK_MAX_INODES = 4096;
+// 不小于这个字节数的连续写入直接写盘，不进入写回队列
+const uint64_t WRITEBACK_BYPASS_SIZE = 256 * 1024;
+// 后台回收每一步最多释放的数据块数，每一步结束时把进度写入 inode，期间前台调用需要等待
+const uint64_t RECLAIM_STEP_BLOCKS = 8192;
+// 簇缓存保留的解压后的簇数
+const size_t CLUSTER_CACHE_SLOTS = 16;
+// 去重索引的桶缓存保留的桶数
+const size_t DEDUP_CACHE_SLOTS = 64;
 class MyFileSystem {
 private:
     std::fstream disk;      // 磁盘文件
     std::string disk_file_path; // 磁盘文件路径
+    std::vector<std::unique_ptr<std::fstream>> member_disks; // 成员镜像 (设备 1 起)
+    std::vector<std::string> device_paths; // 所有设备的路径，0 号是主镜像
+    StripeLayout stripe;    // 数据块在各设备上的分布
+    std::unique_ptr<ThreadPool> stripe_pool; // 大块读写时并行访问成员镜像，多设备时才有
+    std::vector<int> direct_fds; // 直接 I/O 时每个设备以 O_DIRECT 打开的文件描述符，-1 表示该设备仍用文件流
+    std::vector<int> sync_fds;   // 每个设备另外打开的文件描述符，用于 fdatasync (文件流不提供描述符)
+    BufferPool buffer_pool; // 块缓冲区池
     Superblock superblock;  // 超级块
+    ExtentAllocator allocator; // 空闲区间分配器 (由位图构建)
+    std::vector<unsigned short> block_refcount; // 每个数据块的额外引用数 (克隆共享)，空表示没有共享块
+    unsigned int inode_hint = 1; // 下一次查找空闲 inode 的起点
+    unsigned int block_size = DEFAULT_BLOCK_SIZE; // 数据块大小 (格式化时写入超级块，挂载时读出)
+    std::unique_ptr<AsyncQueue> async_io; // 异步读写的请求队列，第一次使用时创建
+    std::mutex io_mutex;    // 异步请求执行时持有，同一时刻只有一个请求访问磁盘
+    MountOptions mount_options; // 挂载选项
+    std::unordered_map<unsigned int, time_t> lazy_atimes; // lazytime 下尚未写回的访问时间
+    std::vector<uint32_t> checksums; // 校验和表：先是每个数据块的，再是每个 inode 的，0 表示未记录；空表示不校验
+    std::vector<char> checksum_dirty; // 校验和表中每个块是否有未写回的修改
+    std::vector<FileHandle> open_files; // 打开文件表，文件句柄是其下标
+    std::unordered_map<unsigned int, CachedInode> inode_cache; // 被打开的文件的 inode
+    uint64_t data_generation = 1; // 文件内容或块映射可能变化时加一，使缓存的块映射表和预读数据作废
+    std::unique_ptr<TraceWriter> trace_writer; // 正在记录调用时不为空
+    WritebackQueue writeback; // 等待写回的元数据和数据块
+    WritebackStats writeback_stats; // 写回统计 (跨挂载累计)
+    std::recursive_mutex operation_mutex; // 公开调用执行期间持有 (OperationScope)，与后台回收线程互斥；需要时先取 io_mutex
+    std::unique_ptr<ReclaimQueue> reclaimer; // 后台回收线程，第一次有文件删除时创建
+    std::list<std::pair<uint64_t, AlignedBuffer>> cluster_cache; // 解压后的压缩簇，按簇的第一个数据块号查找，最近用过的在前
+    CompressionStats compression_stats; // 压缩统计 (跨挂载累计)
+    std::vector<char> dedup_indexed; // 每个数据块是否登记在去重索引中 (挂载时由索引建立)，空表示没有索引
+    std::list<std::pair<uint64_t, AlignedBuffer>> dedup_cache; // 最近用过的去重索引桶 (桶号 -> 内容)，最近用过的在前
+    DedupStats dedup_stats; // 去重统计 (跨挂载累计)
+
+    friend class OperationScope;
 
 public:
-    MyFileSystem(const std::string& disk_path) : disk_file_path(disk_path) {}
-
-    // 初始化文件系统
-    bool format(unsigned int disk_size, unsigned int inode_percentage);
-
-    // 加载文件系统
+    MyFileSystem(const std::string& disk_path);
+    // 停止后台回收，等待未完成的异步请求，写回缓存的访问时间，结束调用记录
+    ~MyFileSystem();
+
+    // 初始化文件系统，new_block_size 为 1K 到 64K 之间的 2 的幂
+    // enable_checksums 为 false 时不建校验和表 (用于对比校验的开销)；数据在页缓存中时，
+    // 开启校验和的顺序读写吞吐量约为关闭时的 75%~80% (见 bench_checksum)，数据要从磁盘读写时差别可以忽略
+    // layout 指定成员镜像时 disk_size 为所有镜像的总大小，数据块按条带分布
+    bool format(uint64_t disk_size, unsigned int inode_percentage, unsigned int new_block_size = DEFAULT_BLOCK_SIZE,
+                bool enable_checksums = true, const DeviceLayout& layout = DeviceLayout());
+
+    // 加载文件系统，不带参数时沿用上一次的挂载选项
     bool mount();
+    bool mount(const MountOptions& options);
+
+    // 写回打开文件的 inode 和 lazytime 缓存的访问时间，并把缓冲的写入落盘
+    // 返回 false 表示这次或上次 sync 之后的某次写回没能写下或落盘
+    bool sync();
 
     // 卸载文件系统
     bool unmount();
 
+    // 读取镜像的格式版本 (0 表示不是本文件系统的镜像)
+    static unsigned int image_version(const std::string& disk_path);
+
+    // 将旧格式 (版本 1) 的镜像升级到当前格式，结果写入本文件系统的镜像文件
+    bool upgrade(const std::string& old_disk_path);
+
     // 创建目录
     bool mkdir(const std::string& path);
 
@@ -96,25 +415,130 @@ public:
 
     // 创建文件
     bool create(const std::string& path);
-    bool change_dir(std::string&cur,std::string& des);
+    bool change_dir(std::string& cur, std::string_view des);
     // 删除文件
     bool remove(const std::string& path);
 
-    // 打开文件 (简化版，仅返回 inode 编号)
+    // 打开文件，返回文件句柄 (-1 表示失败)
+    // 文件的 inode 和块映射表缓存在内存中，读写不再逐次读写 inode，关闭或 sync 时写回
     int open(const std::string& path);
 
-    // 读取文件
-    bool read(int inode_number, unsigned int offset, unsigned int length, char* buffer);
-    bool read(int inode_number, char* buffer);
+    // 关闭文件句柄
+    bool close(int fd);
+
+    // 读取文件，从上次读取结束处接着读时按逐渐增大的窗口预读
+    bool read(int fd, uint64_t offset, unsigned int length, char* buffer);
+    // 从句柄的当前位置读取并后移位置，bytes_read 为实际读到的字节数 (到文件末尾时为 0)
+    bool read(int fd, unsigned int length, char* buffer, unsigned int& bytes_read);
     // 写入文件
-    bool write(int inode_number, unsigned int offset, unsigned int length, const char* buffer);
+    bool write(int fd, uint64_t offset, unsigned int length, const char* buffer);
+    // 从句柄的当前位置写入并后移位置
+    bool write(int fd, unsigned int length, const char* buffer);
+
+    // 设置句柄的当前位置
+    bool seek(int fd, uint64_t position);
+
+    // 异步读写，立即返回 future，buffer 在 future 就绪前必须保持有效，句柄不能关闭
+    // 同一文件的请求按提交顺序执行；有未完成的异步请求时不要调用其他同步接口，先调用 wait_async()
+    std::future<bool> read_async(int fd, uint64_t offset, unsigned int length, char* buffer);
+    std::future<bool> write_async(int fd, uint64_t offset, unsigned int length, const char* buffer);
+
+    // 等待所有已提交的异步请求完成
+    void wait_async();
+
+    // 等待后台回收线程释放完所有已删除文件的数据块
+    void wait_reclaim();
+
+    // 修改文件大小，缩小时释放多余的数据块，扩大时不分配数据块 (空洞读出为 0)
+    bool truncate(int fd, uint64_t size);
+
+    // 为 [offset, offset + length) 预留数据块，尽量分配为一段连续空间，不改变文件大小；新预留的块读出为 0
+    bool fallocate(int fd, uint64_t offset, uint64_t length);
     // 列出目录内容
     bool list(const std::string& path);
 
+    // 读取目录项及其属性，从 cursor 处开始最多返回 max_entries 项 (0 表示不限)
+    // cursor 第一次为 0，返回时指向下一页的起点，读完时为 READDIR_END；属性按 inode 编号排序后成批读取
+    bool readdir_plus(const std::string& path, std::vector<DirEntryPlus>& entries, uint64_t& cursor,
+                      size_t max_entries = 0);
+
+    // 克隆文件 (写时复制)，目标文件与源文件共享数据块
+    bool clone(const std::string& src_path, const std::string& dst_path);
+
+    // 输出碎片报告 (每个文件的区段数和平均块间隔)，path 为空时统计整个镜像
+    bool frag_report(const std::string& path);
+
+    // 在线碎片整理，把文件的块搬到一段连续空间中，path 为空时整理所有文件
+    bool defrag(const std::string& path);
+
     //输出位图
     void print_bitmap();
 
+    // 把之后的公开调用连同参数、开始时间和耗时记录到 trace_path，供 replay 回放
+    bool start_trace(const std::string& trace_path);
+
+    // 停止记录并写出缓冲的记录
+    void stop_trace();
+
+    // 当前镜像的块大小
+    unsigned int get_block_size() const { return block_size; }
+
+    // 输出写回统计：批数、每批大小和相邻写入的合并比例
+    void writeback_report();
+    // 写回统计 (跨挂载累计)，基准测试用来比较写入次数
+    const WritebackStats& get_writeback_stats() const { return writeback_stats; }
+
+    // 输出压缩统计：压缩省下的空间、压缩和解压的耗时、簇缓存的命中率，以及镜像中现有的压缩簇
+    void compression_report();
+
+    // 输出去重统计：重复的块和省下的空间、计算校验和与查找索引的开销、桶缓存命中率，以及镜像中数据块的共享情况
+    void dedup_report();
+
+    // 一致性检查 (多线程扫描 inode 表)，repair 为 true 时修复发现的问题，返回发现的错误数
+    unsigned int fsck(bool repair, unsigned int thread_count = 0);
+
+    // 挂载前直接读取并检查镜像的超级块 (挂载会拒绝有问题的超级块)，repair 为 true 时修复或重建，
+    // 发现的错误数加到 errors 上，返回之后能否挂载
+    bool check_superblock(bool repair, unsigned int& errors);
+
+    // 统计目录树占用的空间，输出每个目录的用量
+    bool du(const std::string& path, unsigned int thread_count = 0);
+
+    // 在目录树中查找文件名匹配 pattern (支持 * 和 ?) 的文件和目录
+    bool find(const std::string& path, const std::string& pattern, unsigned int thread_count = 0);
+
+    // 递归删除目录树 (rm -r)
+    bool remove_tree(const std::string& path, unsigned int thread_count = 0);
+
+    // 在镜像内递归复制目录树 (cp -r)，dst_path 不能已存在
+    bool copy_tree(const std::string& src_path, const std::string& dst_path, unsigned int thread_count = 0);
+
+    // 把主机目录 host_dir 导入为镜像中的 image_path (不能已存在)，多线程读取主机文件，大文件预留连续空间；
+    // 任一主机目录超过 max_directory_entries() 项时整个不导入
+    bool import_tree(const std::string& host_dir, const std::string& image_path, unsigned int thread_count = 0);
+
+    // 把镜像中的 image_path 导出到主机目录 host_dir，多线程并行读取
+    bool export_tree(const std::string& image_path, const std::string& host_dir, unsigned int thread_count = 0);
+
+    // 一个目录最多容纳的目录项数：目录块和文件一样经过直接块、一级和二级间接块映射，4K 块时约 394 万项
+    uint64_t max_directory_entries() const {
+        return max_file_blocks() * (block_size / DIRECTORY_ENTRY_SIZE);
+    }
+
+    // 在 parent_path 目录下批量创建文件，每个目录块、父目录 inode 和超级块只写一次
+    // 目录中已有的项加上 names 超过 max_directory_entries() 时整批拒绝，不创建任何一项
+    bool create_many(const std::string& parent_path, const std::vector<std::string>& names);
+
+    // 在 parent_path 目录下批量创建目录，数量限制同 create_many
+    bool mkdir_many(const std::string& parent_path, const std::vector<std::string>& names);
+
+    // 批量删除 parent_path 目录下的文件，任一名字无效时不做任何修改
+    bool remove_many(const std::string& parent_path, const std::vector<std::string>& names);
+
 private:
+    // 取得异步请求队列，第一次使用时创建
+    AsyncQueue& async_queue();
+
     // 从磁盘读取超级块
     void read_superblock();
 
@@ -124,14 +548,175 @@ private:
     // 读取 inode
     Inode read_inode(unsigned int inode_number);
 
-    // 写入 inode
+    // 写入 inode，打开的文件只更新内存中的 inode
     void write_inode(unsigned int inode_number, const Inode& inode);
 
-    // 读取数据块
-    void read_data_block(unsigned int block_number, char* buffer);
+    // 把 inode 写到磁盘上
+    void store_inode(unsigned int inode_number, const Inode& inode);
+
+    // 按 inode 编号读写文件内容 (不经过文件句柄，供内部使用)
+    bool read_file(int inode_number, uint64_t offset, unsigned int length, char* buffer);
+    bool write_file(int inode_number, uint64_t offset, unsigned int length, const char* buffer);
+    bool truncate_file(int inode_number, uint64_t size);
+    bool fallocate_file(int inode_number, uint64_t offset, uint64_t length);
+
+    // 取得有效的文件句柄，无效时输出错误并返回 nullptr
+    FileHandle* file_handle(int fd);
+
+    // 用 inode 的新内容更新缓存，块指针或大小变化时使缓存的块映射表作废
+    void update_cached_inode(CachedInode& cached, const Inode& inode);
+
+    // 文件被删除：缓存作废，引用它的句柄标记为已删除
+    void drop_cached_inode(unsigned int inode_number);
+
+    // 取得文件的块映射表：打开的文件使用缓存 (必要时重新加载)，否则读入 local
+    BlockMap& file_block_map(unsigned int inode_number, const Inode& inode, BlockMap& local);
+
+    // 写入后缓存的块映射表与磁盘一致，重新标记为有效
+    void keep_block_map(unsigned int inode_number);
+
+    // 把打开文件修改过的 inode 写回磁盘
+    void write_back_inodes();
+
+    // 关闭所有文件句柄，write_back 为 false 时不写回 (镜像即将被覆盖)
+    void close_all_files(bool write_back);
+
+    // 从第 first 个逻辑块开始预读 count 个块到句柄的预读缓冲区
+    bool fill_readahead(FileHandle& handle, const Inode& inode, uint64_t first, uint64_t count);
+
+    // 一次写盘操作结束时调用：同步挂载时在批次 (OperationScope) 结束后写回并对每个设备 fdatasync，
+    // 异步挂载时等队列积累到一定量；队列过大时不论是否在批次中都立即写回
+    void flush_if_sync() {
+        if (writeback_full() || (writeback.depth == 0 && mount_options.sync)) {
+            flush_writeback();
+        }
+    }
+
+    // 写回队列是否已达到上限
+    bool writeback_full() const {
+        return writeback.blocks.size() * block_size >= WRITEBACK_MAX_BYTES || writeback.inodes.size() >= WRITEBACK_MAX_INODES;
+    }
+
+    // 把校验和表和写回队列按磁盘偏移排序、相邻的合并后写盘，最后对每个设备 fdatasync 一次
+    // 失败时输出错误、记入 writeback.failed 并返回 false
+    bool flush_writeback();
+
+    // 丢弃写回队列 (镜像即将被覆盖)
+    void discard_writeback();
+
+    // 把 count 个连续的 inode 放入写回队列
+    void queue_inodes(unsigned int first, unsigned int count, const Inode* inodes);
+
+    // 超级块的 CRC32C (按版本覆盖的字段不同)
+    uint32_t superblock_checksum() const;
+
+    // 按超级块打开成员镜像并建立条带布局，失败时输出错误
+    bool open_devices();
+
+    // 关闭成员镜像 (主镜像由调用者关闭)
+    void close_devices();
+
+    // 把所有设备的缓冲写入交给操作系统，再逐个 fdatasync，任一设备失败时返回 false
+    bool flush_devices();
+
+    // 为落盘打开各设备的文件描述符
+    bool open_sync_fds();
+
+    // 第 index 个设备的文件流
+    std::fstream& device(unsigned int index) { return index == 0 ? disk : *member_disks[index - 1]; }
+
+    // 读写 count 个连续的数据块，不做校验；读出的内容以写回队列为准，小的写入先进入写回队列
+    bool read_raw_blocks(uint64_t start, uint64_t count, char* buffer);
+    bool write_raw_blocks(uint64_t start, uint64_t count, const char* buffer);
+    // 按条带布局直接读写设备，跨多个设备的大块读写并行执行
+    bool stripe_io(uint64_t start, uint64_t count, char* buffer, bool write);
+
+    // 读写一个设备上的一段数据，设备以直接 I/O 打开时绕过文件流
+    bool device_io(unsigned int index, uint64_t offset, char* buffer, uint64_t length, bool write);
+
+    // 按挂载选项以 O_DIRECT 打开各设备，不满足对齐要求或不支持的设备继续使用文件流
+    void open_direct();
+
+    // 关闭 O_DIRECT 文件描述符
+    void close_direct();
+
+    // 通过 O_DIRECT 文件描述符读写，调用者的缓冲区没有对齐时经缓冲区池中转
+    bool direct_io(int fd, uint64_t offset, char* buffer, uint64_t length, bool write);
+
+    // 格式化时创建成员镜像、写入设备表并把各镜像扩展到所需大小
+    bool create_devices(const DeviceLayout& layout, uint64_t disk_size);
+
+    // 打开一组独立的只读句柄，供多线程遍历使用
+    std::unique_ptr<ImageReader> open_image_reader() { return std::make_unique<ImageReader>(device_paths, stripe); }
+
+    // 校验和表占用的块数
+    uint64_t checksum_table_blocks() const {
+        return ((superblock.data_block_count + superblock.inode_count) * sizeof(uint32_t) + block_size - 1) / block_size;
+    }
+
+    // 挂载时读入校验和表
+    void load_checksums();
+
+    // 把校验和表中修改过的块写回磁盘
+    void flush_checksums();
+
+    // 记录刚写入的 count 个连续数据块的校验和
+    void set_block_checksums(uint64_t start, uint64_t count, const char* buffer);
+
+    // 一个数据块内容的校验和 (与写入后校验和表中记录的值相同)
+    uint32_t block_checksum(const char* buffer) const;
+
+    // 校验刚读出的 count 个连续数据块，不一致时输出错误并返回 false
+    bool verify_block_checksums(uint64_t start, uint64_t count, const char* buffer) const;
+
+    // 记录刚写入的 inode 的校验和
+    void set_inode_checksum(unsigned int inode_number, const Inode& inode);
+
+    // 校验刚读出的 inode
+    bool verify_inode_checksum(unsigned int inode_number, const Inode& inode) const;
+
+    // 不输出信息的校验，供 fsck 汇总使用
+    bool block_checksum_matches(uint64_t block_number, const char* buffer) const;
+    bool inode_checksum_matches(unsigned int inode_number, const Inode& inode) const;
+
+    // 按挂载选项更新访问时间，inode 为调用者刚读出的内容
+    void touch_atime(unsigned int inode_number, Inode& inode);
+
+    // 写回 lazytime 缓存的访问时间
+    void flush_atimes();
+
+    // 通过另一个文件句柄读取 inode (供多线程遍历使用)
+    Inode read_inode(unsigned int inode_number, ImageReader& image);
+
+    // 批量读取连续的 inode
+    void read_inodes(unsigned int first, unsigned int count, Inode* inodes);
+
+    // 读取一组编号任意的 inode，结果与 inode_numbers 一一对应；按编号排序后把相近的合并为一次读取
+    void gather_inodes(const std::vector<unsigned int>& inode_numbers, std::vector<Inode>& inodes);
+
+    // 批量写入连续的 inode
+    void write_inodes(unsigned int first, unsigned int count, const Inode* inodes);
+
+    // 读取数据块，校验和不一致时返回 false
+    bool read_data_block(uint64_t block_number, char* buffer);
+
+    // 通过另一个文件句柄读取数据块
+    bool read_data_block(uint64_t block_number, char* buffer, ImageReader& image);
 
     // 写入数据块
-    void write_data_block(unsigned int block_number, const char* buffer);
+    void write_data_block(uint64_t block_number, const char* buffer);
+
+    // 读取 count 个连续的数据块，校验和不一致时返回 false
+    bool read_data_blocks(uint64_t start, uint64_t count, char* buffer);
+
+    // 通过另一个文件句柄读取 count 个连续的数据块
+    bool read_data_blocks(uint64_t start, uint64_t count, char* buffer, ImageReader& image);
+
+    // 写入 count 个连续的数据块 (合并为一次 I/O)
+    void write_data_blocks(uint64_t start, uint64_t count, const char* buffer);
+
+    // 将 count 个连续的数据块清零
+    void zero_data_blocks(uint64_t start, uint64_t count);
 
     // 分配一个 inode
     unsigned int allocate_inode(FileType type);
@@ -139,27 +724,236 @@ private:
     // 释放一个 inode
     void free_inode(unsigned int inode_number);
 
+    // 取得后台回收队列，第一次使用时创建
+    ReclaimQueue& reclaim_queue();
+
+    // 把已从目录中删除的 inode 标记为 RECLAIMING 并交给后台线程，数据块由后台线程分步释放
+    void reclaim_inodes(const std::vector<unsigned int>& inode_numbers);
+
+    // 后台回收的一步：从文件末尾释放最多 RECLAIM_STEP_BLOCKS 个数据块，全部释放后归还 inode，返回是否已回收完
+    bool reclaim_step(unsigned int inode_number);
+
+    // 空间不足时在前台做完所有待回收的删除，返回是否回收了 inode
+    bool finish_reclaim();
+
+    // 挂载时扫描 inode 表，把上次没有回收完的 inode 重新交给后台线程
+    void resume_reclaim();
+
+    // 停止后台回收线程，没有回收完的 inode 留在磁盘上，下次挂载时继续
+    void stop_reclaim();
+
+    // 查找 count 个空闲 inode (不写盘，由调用者初始化)
+    bool find_free_inodes(unsigned int count, std::vector<unsigned int>& inode_numbers);
+
     // 分配一个数据块
-    unsigned int allocate_data_block();
+    uint64_t allocate_data_block();
 
     // 释放一个数据块
-    void free_data_block(unsigned int block_number);
+    void free_data_block(uint64_t block_number);
+
+    // 分配最多 count 个连续数据块，返回实际分配的块数 (0 表示失败)
+    uint64_t allocate_data_blocks(uint64_t count, uint64_t hint, uint64_t& start);
+
+    // 释放一段连续的数据块
+    void free_data_blocks(uint64_t start, uint64_t count);
+
+    // 读取文件的块映射表
+    void load_block_map(const Inode& inode, BlockMap& block_map);
+    // image 为空时读挂载的镜像
+    void load_block_map(const Inode& inode, BlockMap& block_map, ImageReader* image);
+
+    // 将块映射表写回 inode 及其间接块
+    bool store_block_map(Inode& inode, BlockMap& block_map);
+
+    // 写回一个间接块，内容为空时释放，返回新的间接块号 (-1 表示分配失败)
+    uint64_t store_indirect_block(uint64_t block_number, const uint64_t* entries, const uint64_t* loaded_entries);
+
+    // 为 [first, last] 范围内未分配的逻辑块分配数据块，尽量连续
+    // zero 为 true 时把新分配的块清零 (其中是已释放的块留下的旧数据)，调用者不会马上写满这些块时使用
+    bool reserve_blocks(BlockMap& block_map, uint64_t first, uint64_t last, bool& changed, bool zero = false);
+
+    // 释放从 first 开始的所有逻辑块
+    void release_blocks(BlockMap& block_map, uint64_t first);
+
+    // 将一段连续块归还给分配器并更新位图 (不检查引用计数)
+    void release_data_run(uint64_t start, uint64_t count);
+
+    // 对 [first, last] 中被共享的块执行写时复制，只有未被完整覆盖的首尾块需要复制原内容
+    bool unshare_blocks(BlockMap& block_map, uint64_t first, uint64_t last,
+                        unsigned int head_offset, unsigned int tail_end, bool& changed);
+
+    // 判断数据块是否被多个文件共享
+    bool is_shared(uint64_t block_number) {
+        return !block_refcount.empty() && block_refcount[block_number] > 0;
+    }
+
+    // 读取块引用计数表
+    void load_refcounts();
+
+    // 创建块引用计数表
+    bool create_refcount_table();
+
+    // 将 [start, start + count) 对应的引用计数表块写回磁盘
+    void write_refcounts(uint64_t start, uint64_t count);
+
+    // 根据位图重建空闲区间分配器
+    void load_allocator();
+
+    // 统计块映射表的碎片情况
+    FragStats block_map_fragmentation(const BlockMap& block_map);
+
+    // 整理单个文件，返回是否搬移了数据块
+    bool defrag_file(unsigned int inode_number);
+
+    // 从 root 开始多线程遍历目录树，按目录项逐层展开，不再按路径查找
+    void walk_tree(unsigned int root, const std::string& root_path, bool load_maps,
+                   std::deque<TreeNode>& nodes, unsigned int thread_count);
+
+    // 在目录 parent 中批量添加目录项，一次分配所有 inode，每个目录块和父目录 inode 只写一次
+    bool add_entries(unsigned int parent, const std::string& parent_path,
+                     const std::vector<std::pair<std::string, FileType>>& entries,
+                     std::vector<unsigned int>& inode_numbers);
+
+    // create_many 和 mkdir_many 的公共部分
+    bool create_entries(const std::string& parent_path, const std::vector<std::string>& names, FileType type);
+
+    // 从目录 parent 中批量删除指向 inode_numbers 的目录项，每个目录块只写一次
+    bool remove_entries(unsigned int parent, const std::vector<unsigned int>& inode_numbers);
+
+    // 在目录 parent 中添加一项，需要时为目录分配新块 (以及映射它的间接块)，并写回 parent_inode
+    bool add_directory_entry(unsigned int parent, Inode& parent_inode, const std::string& name, unsigned int inode_number);
+
+    // 从目录 parent 中删除指向 inode_number 的项，并写回 parent_inode
+    bool remove_directory_entry(unsigned int parent, Inode& parent_inode, unsigned int inode_number);
+
+    // 释放遍历得到的所有节点的数据块和 inode，按块号排序后成段释放；版本 5 起交给后台线程回收
+    void release_nodes(const std::vector<const TreeNode*>& nodes);
+
+    // 把 src 的数据复制到新分配的块中，压缩簇原样复制
+    bool copy_file_blocks(const BlockMap& src, BlockMap& dst);
+
+    // 逻辑块是否位于压缩簇中
+    static bool in_compressed_cluster(const BlockMap& block_map, uint64_t index) {
+        return block_map.get(index - index % COMPRESS_CLUSTER_BLOCKS) == COMPRESSED_CLUSTER;
+    }
+
+    // 读出压缩簇并解压到 buffer (一簇大小)，image 为空时读挂载的镜像；不经过簇缓存，可供多线程使用
+    bool decompress_cluster(const BlockMap& block_map, uint64_t cluster, char* buffer, ImageReader* image);
+
+    // 取得解压后的压缩簇 (经簇缓存)，失败时返回 nullptr；内容在下一次访问簇缓存之前有效
+    const char* read_cluster(const BlockMap& block_map, uint64_t cluster);
+
+    // 在簇缓存中为以 first_block 开头的压缩簇占一个位置 (已有时沿用)，必要时淘汰最久没用的
+    char* cache_cluster(uint64_t first_block);
+
+    // 数据块被释放，簇缓存中以它们开头的压缩簇作废
+    void drop_cached_clusters(uint64_t start, uint64_t count);
+
+    // 读出一簇的内容 (压缩簇解压，空洞为 0)，文件末尾 size 之后的部分清零
+    bool load_cluster(const BlockMap& block_map, uint64_t cluster, uint64_t size, char* buffer);
+
+    // 写入一簇：compress 为 true 且能省下块时压缩存放，否则存为普通块，末尾全为 0 的块不分配；
+    // 原来的块数和存放方式都不变时原地改写，否则写到新分配的块中再释放原来的块
+    bool store_cluster(BlockMap& block_map, uint64_t cluster, const char* buffer, bool compress);
+
+    // 按簇读改写 [offset, offset + length)，压缩挂载时的写入路径
+    bool write_clusters(Inode& inode, BlockMap& block_map, uint64_t offset, unsigned int length, const char* buffer);
+
+    // 把 [first, last] 涉及的压缩簇解压为普通块，之后可以按块原地修改
+    bool expand_clusters(BlockMap& block_map, uint64_t first, uint64_t last, bool& changed);
+
+    // 去重索引每个桶的项数
+    unsigned int dedup_bucket_entries() const {
+        return block_size / sizeof(DedupEntry);
+    }
+
+    // 创建去重索引 (第一次去重写入时)，占用一段连续的数据块
+    bool create_dedup_index();
+
+    // 挂载时扫描去重索引，标记已登记的数据块
+    void load_dedup_index();
+
+    // 取得去重索引的一个桶 (经桶缓存)，内容在下一次访问桶缓存之前有效，修改后由 store_dedup_bucket 写回
+    DedupEntry* dedup_bucket(uint64_t bucket);
+    void store_dedup_bucket(uint64_t bucket, const DedupEntry* entries);
+
+    // 查找内容与 data 相同的已登记数据块，校验和相同时还要比较内容，找不到时返回 0
+    uint64_t dedup_lookup(uint32_t hash, const char* data);
+
+    // 把刚写入的数据块 (校验和, 块号) 登记到去重索引中，按桶分组，每个桶只写一次
+    void dedup_insert(std::vector<std::pair<uint32_t, uint64_t>>& blocks);
+
+    // 数据块即将被改写或释放，从去重索引中删去 (须在校验和表更新之前调用)
+    void forget_dedup_blocks(uint64_t start, uint64_t count);
+
+    // 按块去重写入 [offset, offset + length)，去重挂载时的写入路径：全为 0 的块不分配，
+    // 与已有块内容相同的块改为共享，其余的块原地写入或写到新分配的块中并登记到索引
+    bool write_dedup(Inode& inode, BlockMap& block_map, uint64_t offset, unsigned int length, const char* buffer);
 
     // 根据路径查找 inode 编号
-    int path_to_inode(const std::string& path);
+    int path_to_inode(std::string_view path);
 
     // 获取父目录的 inode 编号
-    int get_parent_inode(const std::string& path);
+    int get_parent_inode(std::string_view path);
 
     // 更新位图
-    void update_bitmap(unsigned int block_number, bool allocated);
+    void update_bitmap(uint64_t block_number, bool allocated);
+
+    // 批量更新一段连续块的位图，每个位图块只读写一次
+    void update_bitmap_range(uint64_t start, uint64_t count, bool allocated);
+
+    // 按块大小特化的读写和位图扫描
+    template <unsigned int Size>
+    bool read_blocks(int inode_number, uint64_t offset, unsigned int length, char* buffer);
+    template <unsigned int Size>
+    bool write_blocks(int inode_number, uint64_t offset, unsigned int length, const char* buffer);
+    template <unsigned int Size>
+    void update_bitmap_blocks(uint64_t start, uint64_t count, bool allocated);
+    template <unsigned int Size>
+    void scan_bitmap();
 
     // 检查位图
-    bool check_bitmap(unsigned int block_number);
+    bool check_bitmap(uint64_t block_number);
     //计算位图区大小
-    unsigned int calculate_bitmap_size() {
+    uint64_t calculate_bitmap_size() {
         return (superblock.data_block_count + 7) / 8; // 向上取整
     }
+    //位图区占用的块数
+    uint64_t calculate_bitmap_blocks() {
+        return (calculate_bitmap_size() + block_size - 1) / block_size;
+    }
+    //位图所在的起始数据块号
+    uint64_t bitmap_start_block() {
+        return 1 + (uint64_t)superblock.inode_count * INODE_SIZE / block_size;
+    }
+    //一个间接块可容纳的块指针数量
+    unsigned int indirect_entries() const {
+        return block_size / sizeof(uint64_t);
+    }
+    //每个引用计数表块可容纳的计数项数量
+    unsigned int refcounts_per_block() const {
+        return block_size / sizeof(unsigned short);
+    }
+    //单个文件最多占用的数据块数 (直接块 + 一级间接块 + 二级间接块)
+    uint64_t max_file_blocks() const {
+        return DIRECT_BLOCK_COUNT + indirect_entries() + (uint64_t)indirect_entries() * indirect_entries();
+    }
+};
+
+// 一次公开调用：持有 operation_mutex，使后台回收线程不会与之交错；
+// 作用域内的写入合并为一批，最外层的作用域结束时按挂载选项写回
+class OperationScope {
+public:
+    explicit OperationScope(MyFileSystem& fs) : fs(fs), lock(fs.operation_mutex) { fs.writeback.depth++; }
+    ~OperationScope() {
+        if (--fs.writeback.depth == 0) fs.flush_if_sync();
+    }
+    OperationScope(const OperationScope&) = delete;
+    OperationScope& operator=(const OperationScope&) = delete;
+
+private:
+    MyFileSystem& fs;
+    std::lock_guard<std::recursive_mutex> lock;
 };
 
 #endif // MYFS_H
\ No newline at end of file
@@ -0,0 +1,98 @@
+#include "myfs.h"
+#include <algorithm>
+
+// 编号相差不到这个数的 inode 合并为一次读取，夹在中间的无关 inode 一起读出来也比多一次读取便宜
+const unsigned int INODE_GATHER_SPAN = 64;
+
+// 读取目录项及其属性
+bool MyFileSystem::readdir_plus(const std::string& path, std::vector<DirEntryPlus>& entries, uint64_t& cursor,
+                                size_t max_entries) {
+    TraceScope trace(trace_writer.get(), TRACE_READDIR_PLUS, -1, cursor, max_entries, path);
+    OperationScope operation(*this);
+    entries.clear();
+    int inode_number = path_to_inode(path);
+    if (inode_number == -1) {
+        std::cerr << "Directory does not exist." << std::endl;
+        return false;
+    }
+    Inode inode = read_inode(inode_number);
+    if (inode.type != DIRECTORY) {
+        std::cerr << "Not a directory." << std::endl;
+        return false;
+    }
+    touch_atime(inode_number, inode);
+
+    // 游标是目录项槽位的序号 (逻辑块号 * 每块目录项数 + 块内序号)，删除目录项不移动其他项，游标始终有效
+    const uint64_t per_block = block_size / DIRECTORY_ENTRY_SIZE;
+    BlockMap block_map;
+    load_block_map(inode, block_map);
+    const uint64_t end = block_map.size() * per_block;
+    uint64_t slot = cursor;
+    uint64_t loaded = block_map.size();
+    PooledBuffer block_buffer(buffer_pool);
+    for (; slot < end && (max_entries == 0 || entries.size() < max_entries); slot++) {
+        uint64_t i = slot / per_block;
+        if (block_map.get(i) == 0) {
+            slot = (i + 1) * per_block - 1;
+            continue;
+        }
+        if (i != loaded) {
+            read_data_block(block_map.get(i), block_buffer.data());
+            loaded = i;
+        }
+        const DirectoryEntry* entry =
+            reinterpret_cast<const DirectoryEntry*>(block_buffer.data() + (slot % per_block) * DIRECTORY_ENTRY_SIZE);
+        if (entry->inode_number == 0) continue;
+        DirEntryPlus& result = entries.emplace_back();
+        result.inode_number = entry->inode_number;
+        result.name = entry->filename;
+    }
+    cursor = slot >= end ? READDIR_END : slot;
+
+    // 目录项的顺序与 inode 编号无关，收集齐后一并读取属性
+    std::vector<unsigned int> inode_numbers;
+    inode_numbers.reserve(entries.size());
+    for (const DirEntryPlus& entry : entries) {
+        inode_numbers.push_back(entry.inode_number);
+    }
+    std::vector<Inode> inodes;
+    gather_inodes(inode_numbers, inodes);
+    for (size_t k = 0; k < entries.size(); k++) {
+        entries[k].type = inodes[k].type;
+        entries[k].permissions = inodes[k].permissions;
+        entries[k].size = inodes[k].size;
+        entries[k].created_time = inodes[k].created_time;
+        entries[k].modified_time = inodes[k].modified_time;
+        entries[k].accessed_time = inodes[k].accessed_time;
+    }
+    return true;
+}
+
+// 读取一组任意编号的 inode
+void MyFileSystem::gather_inodes(const std::vector<unsigned int>& inode_numbers, std::vector<Inode>& inodes) {
+    std::vector<std::pair<unsigned int, size_t>> order;
+    order.reserve(inode_numbers.size());
+    for (size_t k = 0; k < inode_numbers.size(); k++) {
+        order.push_back({inode_numbers[k], k});
+    }
+    std::sort(order.begin(), order.end());
+
+    inodes.resize(inode_numbers.size());
+    std::vector<Inode> run;
+    for (size_t i = 0; i < order.size();) {
+        unsigned int first = order[i].first;
+        size_t end = i + 1;
+        while (end < order.size() && order[end].first - first < INODE_GATHER_SPAN) end++;
+        run.resize(order[end - 1].first - first + 1);
+        read_inodes(first, run.size(), run.data());
+        for (size_t k = i; k < end; k++) {
+            inodes[order[k].second] = run[order[k].first - first];
+        }
+        i = end;
+    }
+    // 与 read_inode 一致，lazytime 下以内存中的访问时间为准
+    for (size_t k = 0; k < inode_numbers.size() && !lazy_atimes.empty(); k++) {
+        auto it = lazy_atimes.find(inode_numbers[k]);
+        if (it != lazy_atimes.end()) inodes[k].accessed_time = it->second;
+    }
+}
@@ -0,0 +1,204 @@
+#include "reclaim.h"
+#include "myfs.h"
+#include <algorithm>
+
+ReclaimQueue::ReclaimQueue(std::function<bool(unsigned int)> step) : step(std::move(step)) {
+    worker = std::thread(&ReclaimQueue::worker_loop, this);
+}
+
+ReclaimQueue::~ReclaimQueue() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    work_ready.notify_all();
+    all_done.notify_all();
+    worker.join();
+}
+
+void ReclaimQueue::push(unsigned int inode_number) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        queue.push_back(inode_number);
+    }
+    work_ready.notify_one();
+}
+
+bool ReclaimQueue::front(unsigned int& inode_number) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (queue.empty()) {
+        return false;
+    }
+    inode_number = queue.front();
+    return true;
+}
+
+void ReclaimQueue::pop(unsigned int inode_number) {
+    std::lock_guard<std::mutex> lock(mutex);
+    // 前台可能已经先回收了这个 inode 并把它出队
+    auto it = std::find(queue.begin(), queue.end(), inode_number);
+    if (it != queue.end()) {
+        queue.erase(it);
+    }
+    if (queue.empty()) {
+        all_done.notify_all();
+    }
+}
+
+size_t ReclaimQueue::size() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return queue.size();
+}
+
+void ReclaimQueue::wait() {
+    std::unique_lock<std::mutex> lock(mutex);
+    all_done.wait(lock, [this] { return stopping || queue.empty(); });
+}
+
+void ReclaimQueue::worker_loop() {
+    while (true) {
+        unsigned int inode_number;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            work_ready.wait(lock, [this] { return stopping || !queue.empty(); });
+            if (stopping) {
+                return;
+            }
+            inode_number = queue.front();
+        }
+        if (step(inode_number)) {
+            pop(inode_number);
+        }
+        // 每一步之间让出处理器，等待中的前台调用先取得锁
+        std::this_thread::yield();
+    }
+}
+
+// 取得后台回收队列，第一次使用时创建
+ReclaimQueue& MyFileSystem::reclaim_queue() {
+    if (!reclaimer) {
+        reclaimer = std::make_unique<ReclaimQueue>([this](unsigned int inode_number) {
+            OperationScope operation(*this);
+            return reclaim_step(inode_number);
+        });
+    }
+    return *reclaimer;
+}
+
+// 删除的文件交给后台回收
+void MyFileSystem::reclaim_inodes(const std::vector<unsigned int>& inode_numbers) {
+    if (inode_numbers.empty()) {
+        return;
+    }
+    for (unsigned int inode_number : inode_numbers) {
+        Inode inode = read_inode(inode_number);
+        inode.type = RECLAIMING;
+        // 打开它的句柄随即失效，之后的 inode 直接写盘，不再经过缓存
+        drop_cached_inode(inode_number);
+        write_inode(inode_number, inode);
+    }
+    // 待回收数与 inode 一起写回，崩溃后挂载时据此继续回收
+    superblock.reclaim_count += inode_numbers.size();
+    write_superblock();
+    for (unsigned int inode_number : inode_numbers) {
+        reclaim_queue().push(inode_number);
+    }
+}
+
+// 回收一步
+bool MyFileSystem::reclaim_step(unsigned int inode_number) {
+    Inode inode = read_inode(inode_number);
+    if (!inode.used || inode.type != RECLAIMING) {
+        // 空间不足时已由前台回收
+        return true;
+    }
+    BlockMap block_map;
+    load_block_map(inode, block_map);
+
+    // 从末尾往前摘下最多 RECLAIM_STEP_BLOCKS 个块，剩下的总是文件的一个前缀
+    std::vector<uint64_t> blocks;
+    uint64_t first = block_map.size();
+    while (first > 0 && blocks.size() < RECLAIM_STEP_BLOCKS) {
+        first--;
+        if (block_map.get(first) != 0) {
+            if (block_map.get(first) != COMPRESSED_CLUSTER) blocks.push_back(block_map.get(first));
+            block_map[first] = 0;
+        }
+    }
+
+    // 按块号排序后成段释放，每段只更新一次位图
+    std::sort(blocks.begin(), blocks.end());
+    for (size_t i = 0; i < blocks.size();) {
+        size_t end = i + 1;
+        while (end < blocks.size() && blocks[end] == blocks[end - 1] + 1) end++;
+        free_data_blocks(blocks[i], end - i);
+        i = end;
+    }
+
+    // 缩短后的块映射表和大小写回 inode，作为回收的进度
+    store_block_map(inode, block_map);
+    inode.size = std::min<uint64_t>(inode.size, first * block_size);
+    write_inode(inode_number, inode);
+    if (first > 0) {
+        return false;
+    }
+
+    // 数据块已全部释放，归还 inode (间接块此时已随空的映射表释放)
+    free_inode(inode_number);
+    superblock.reclaim_count--;
+    write_superblock();
+    return true;
+}
+
+// 前台回收剩下的全部 inode
+bool MyFileSystem::finish_reclaim() {
+    bool reclaimed = false;
+    unsigned int inode_number;
+    while (reclaimer && reclaimer->front(inode_number)) {
+        while (!reclaim_step(inode_number)) {
+        }
+        reclaimer->pop(inode_number);
+        reclaimed = true;
+    }
+    return reclaimed;
+}
+
+// 挂载时继续上次的回收
+void MyFileSystem::resume_reclaim() {
+    OperationScope operation(*this);
+    const unsigned int INODE_BATCH = 256;
+    std::vector<Inode> inodes(INODE_BATCH);
+    std::vector<unsigned int> pending;
+    for (unsigned int i = 1; i < superblock.inode_count; i += INODE_BATCH) {
+        unsigned int count = std::min<uint64_t>(INODE_BATCH, superblock.inode_count - i);
+        read_inodes(i, count, inodes.data());
+        for (unsigned int k = 0; k < count; k++) {
+            if (inodes[k].used && inodes[k].type == RECLAIMING) {
+                pending.push_back(i + k);
+            }
+        }
+    }
+    if (pending.size() != superblock.reclaim_count) {
+        superblock.reclaim_count = pending.size();
+        write_superblock();
+    }
+    if (pending.empty()) {
+        return;
+    }
+    std::cout << "Resuming reclamation of " << pending.size() << " deleted files." << std::endl;
+    for (unsigned int inode_number : pending) {
+        reclaim_queue().push(inode_number);
+    }
+}
+
+// 停止后台回收线程
+void MyFileSystem::stop_reclaim() {
+    reclaimer.reset();
+}
+
+// 等待后台回收完成
+void MyFileSystem::wait_reclaim() {
+    if (reclaimer) {
+        reclaimer->wait();
+    }
+}
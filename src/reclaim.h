@@ -0,0 +1,47 @@
+#ifndef RECLAIM_H
+#define RECLAIM_H
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+// 后台回收队列
+// 删除文件时只摘下目录项，inode 交给这里排队，由一个后台线程对队首的 inode 反复调用 step 分步释放数据块，
+// step 返回 true 表示这个 inode 已回收完，随即出队
+class ReclaimQueue {
+public:
+    explicit ReclaimQueue(std::function<bool(unsigned int)> step);
+    // 做完正在执行的一步后退出，队列中剩下的 inode 不再处理
+    ~ReclaimQueue();
+
+    ReclaimQueue(const ReclaimQueue&) = delete;
+    ReclaimQueue& operator=(const ReclaimQueue&) = delete;
+
+    // 加入一个待回收的 inode
+    void push(unsigned int inode_number);
+
+    // 取队首的 inode，队列为空时返回 false
+    bool front(unsigned int& inode_number);
+
+    // inode 已回收完 (前台回收时由调用者出队)
+    void pop(unsigned int inode_number);
+
+    // 队列中的 inode 数
+    size_t size();
+
+    // 等待队列清空
+    void wait();
+
+private:
+    void worker_loop();
+
+    std::function<bool(unsigned int)> step;
+    std::mutex mutex;
+    std::condition_variable work_ready;
+    std::condition_variable all_done;
+    std::deque<unsigned int> queue;
+    bool stopping = false;
+    std::thread worker;  // 最后初始化，线程启动时其他成员已经就绪
+};
+#endif // RECLAIM_H
@@ -0,0 +1,256 @@
+#include "myfs.h"
+#include "thread_pool.h"
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+
+// 跨多个设备的读写达到这个大小时各设备并行执行，小的读写切换线程的开销比 I/O 本身还大
+const uint64_t STRIPE_PARALLEL_BYTES = 128 * 1024;
+
+// 同一设备上的一段连续块
+struct StripeRun {
+    uint64_t offset;  // 设备内的字节偏移
+    uint64_t index;   // 在缓冲区中的块序号
+    uint64_t count;
+};
+
+// 由超级块得到条带布局
+static StripeLayout stripe_layout(const Superblock& superblock) {
+    StripeLayout layout;
+    layout.block_size = superblock.block_size;
+    layout.primary_base = superblock.free_data_block_start;
+    layout.device_count = superblock.device_count;
+    layout.stripe_blocks = superblock.stripe_blocks;
+    layout.stripe_start = superblock.stripe_start;
+    return layout;
+}
+
+ImageReader::ImageReader(const std::vector<std::string>& paths, const StripeLayout& layout) : layout(layout) {
+    for (const std::string& path : paths) {
+        files.push_back(std::make_unique<std::ifstream>(path, std::ios::binary));
+    }
+}
+
+// 读取连续的数据块，按设备拆开逐段读
+bool ImageReader::read_blocks(uint64_t start, uint64_t count, char* buffer) {
+    for (uint64_t i = 0; i < count;) {
+        uint64_t offset;
+        std::ifstream& file = *files[layout.locate(start + i, offset)];
+        uint64_t run = layout.run_length(start + i, count - i);
+        file.seekg(offset, std::ios::beg);
+        file.read(buffer + i * layout.block_size, run * layout.block_size);
+        i += run;
+    }
+    return good();
+}
+
+bool ImageReader::good() const {
+    for (const auto& file : files) {
+        if (!*file) return false;
+    }
+    return true;
+}
+
+// 格式化时创建成员镜像
+bool MyFileSystem::create_devices(const DeviceLayout& layout, uint64_t disk_size) {
+    close_devices();
+    stripe = stripe_layout(superblock);
+    device_paths.assign(1, disk_file_path);
+    if (layout.members.empty()) {
+        // 直接把镜像扩展到目标大小，未写过的区域由操作系统保证读出为 0，不必逐块清零
+        disk.seekp(disk_size - 1, std::ios::beg);
+        disk.put(0);
+        return open_sync_fds();
+    }
+
+    for (const std::string& path : layout.members) {
+        auto file = std::make_unique<std::fstream>(path, std::ios::in | std::ios::out | std::ios::trunc | std::ios::binary);
+        if (!file->is_open()) {
+            std::cerr << "Unable to create device " << path << "." << std::endl;
+            close_devices();
+            return false;
+        }
+        member_disks.push_back(std::move(file));
+        device_paths.push_back(path);
+    }
+    // 每个镜像只扩展到自己存放的块数
+    for (unsigned int i = 0; i < stripe.device_count; i++) {
+        uint64_t blocks = stripe.device_blocks(i, superblock.data_block_count);
+        uint64_t size = (i == 0 ? stripe.primary_base : 0) + blocks * block_size;
+        if (size == 0) continue;
+        device(i).seekp(size - 1, std::ios::beg);
+        device(i).put(0);
+    }
+    // 0 号数据块 (总在主镜像上) 依次存放成员镜像的路径，以 '\0' 分隔
+    std::vector<char> table(block_size, 0);
+    size_t position = 0;
+    for (const std::string& path : layout.members) {
+        memcpy(table.data() + position, path.c_str(), path.size() + 1);
+        position += path.size() + 1;
+    }
+    disk.seekp(stripe.primary_base, std::ios::beg);
+    disk.write(table.data(), block_size);
+    stripe_pool = std::make_unique<ThreadPool>(stripe.device_count - 1);
+    return open_sync_fds();
+}
+
+// 挂载时打开成员镜像
+bool MyFileSystem::open_devices() {
+    close_devices();
+    stripe = stripe_layout(superblock);
+    device_paths.assign(1, disk_file_path);
+    if (stripe.device_count == 1) {
+        return open_sync_fds();
+    }
+    if (stripe.device_count == 0 || stripe.stripe_blocks == 0 || stripe.stripe_start > superblock.data_block_count) {
+        std::cerr << "Invalid device layout." << std::endl;
+        return false;
+    }
+
+    std::vector<char> table(block_size);
+    disk.seekg(stripe.primary_base, std::ios::beg);
+    disk.read(table.data(), block_size);
+    for (size_t position = 0; position < block_size && device_paths.size() < stripe.device_count;) {
+        size_t length = strnlen(table.data() + position, block_size - position);
+        if (length == 0 || position + length == block_size) break;
+        device_paths.emplace_back(table.data() + position, length);
+        position += length + 1;
+    }
+    if (device_paths.size() != stripe.device_count) {
+        std::cerr << "Device table is corrupted." << std::endl;
+        device_paths.resize(1);
+        return false;
+    }
+    for (size_t i = 1; i < device_paths.size(); i++) {
+        auto file = std::make_unique<std::fstream>(device_paths[i], std::ios::in | std::ios::out | std::ios::binary);
+        if (!file->is_open()) {
+            std::cerr << "Unable to open device " << device_paths[i] << "." << std::endl;
+            close_devices();
+            return false;
+        }
+        member_disks.push_back(std::move(file));
+    }
+    stripe_pool = std::make_unique<ThreadPool>(stripe.device_count - 1);
+    return open_sync_fds();
+}
+
+// 打开落盘用的文件描述符
+bool MyFileSystem::open_sync_fds() {
+    for (const std::string& path : device_paths) {
+        int fd = ::open(path.c_str(), O_RDWR);
+        if (fd == -1) {
+            std::cerr << "Unable to open device " << path << ": " << strerror(errno) << "." << std::endl;
+            close_devices();
+            return false;
+        }
+        sync_fds.push_back(fd);
+    }
+    return true;
+}
+
+// 关闭成员镜像
+void MyFileSystem::close_devices() {
+    close_direct();
+    for (int fd : sync_fds) {
+        ::close(fd);
+    }
+    sync_fds.clear();
+    stripe_pool.reset();
+    member_disks.clear();
+    device_paths.resize(std::min<size_t>(device_paths.size(), 1));
+}
+
+// 所有设备落盘：文件流和 O_DIRECT 写下的内容都要 fdatasync 之后才能在断电后保留
+bool MyFileSystem::flush_devices() {
+    bool ok = (bool)disk.flush();
+    for (auto& file : member_disks) {
+        ok = (bool)file->flush() && ok;
+    }
+    auto sync_fd = [&](int fd, size_t index) {
+        while (fdatasync(fd) != 0) {
+            if (errno == EINTR) continue;
+            std::cerr << "Unable to sync " << device_paths[index] << ": " << strerror(errno) << "." << std::endl;
+            return false;
+        }
+        return true;
+    };
+    for (size_t i = 0; i < sync_fds.size(); i++) {
+        ok = sync_fd(sync_fds[i], i) && ok;
+    }
+    for (size_t i = 0; i < direct_fds.size(); i++) {
+        if (direct_fds[i] != -1) {
+            ok = sync_fd(direct_fds[i], i) && ok;
+        }
+    }
+    writeback_stats.syncs++;
+    if (!ok) {
+        std::cerr << "Writes may not have reached the disk." << std::endl;
+    }
+    return ok;
+}
+
+// 在设备的 offset 处读写一段数据
+bool MyFileSystem::device_io(unsigned int index, uint64_t offset, char* buffer, uint64_t length, bool write) {
+    if (!direct_fds.empty() && direct_fds[index] != -1) {
+        return direct_io(direct_fds[index], offset, buffer, length, write);
+    }
+    std::fstream& file = device(index);
+    if (write) {
+        file.seekp(offset, std::ios::beg);
+        file.write(buffer, length);
+    } else {
+        file.seekg(offset, std::ios::beg);
+        file.read(buffer, length);
+    }
+    return (bool)file;
+}
+
+// 按条带布局读写，每个设备的各段由一个线程依次完成
+bool MyFileSystem::stripe_io(uint64_t start, uint64_t count, char* buffer, bool write) {
+    uint64_t first_offset;
+    unsigned int first_device = stripe.locate(start, first_offset);
+    if (stripe.run_length(start, count) == count) {
+        // 全部在一个设备上连续存放 (单设备时总是如此)
+        return device_io(first_device, first_offset, buffer, count * block_size, write);
+    }
+    std::vector<std::vector<StripeRun>> runs(stripe.device_count);
+    unsigned int devices = 0;
+    for (uint64_t i = 0; i < count;) {
+        uint64_t offset;
+        unsigned int index = stripe.locate(start + i, offset);
+        uint64_t run = stripe.run_length(start + i, count - i);
+        if (runs[index].empty()) devices++;
+        runs[index].push_back({offset, i, run});
+        i += run;
+    }
+    // 依次读写一个设备上的各段
+    auto transfer_runs = [&](unsigned int index) {
+        bool ok = true;
+        for (const StripeRun& run : runs[index]) {
+            ok = device_io(index, run.offset, buffer + run.index * block_size, run.count * block_size, write) && ok;
+        }
+        return ok;
+    };
+    std::vector<char> results(stripe.device_count, 1);
+    if (devices > 1 && count * block_size >= STRIPE_PARALLEL_BYTES) {
+        // 成员镜像交给线程池，主镜像在当前线程上读写
+        for (unsigned int i = 1; i < stripe.device_count; i++) {
+            if (runs[i].empty()) continue;
+            stripe_pool->submit([&, i] {
+                results[i] = transfer_runs(i);
+            });
+        }
+        if (!runs[0].empty()) {
+            results[0] = transfer_runs(0);
+        }
+        stripe_pool->wait();
+    } else {
+        for (unsigned int i = 0; i < stripe.device_count; i++) {
+            if (!runs[i].empty()) {
+                results[i] = transfer_runs(i);
+            }
+        }
+    }
+    return std::find(results.begin(), results.end(), 0) == results.end();
+}
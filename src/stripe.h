@@ -0,0 +1,72 @@
+#ifndef STRIPE_H
+#define STRIPE_H
+#include <algorithm>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+
+// 条带布局 (RAID-0)：把数据区的块号映射到设备和设备内的字节偏移
+// 设备 0 是主镜像，数据区从超级块和 inode 表之后开始；成员镜像从文件开头就是数据
+// stripe_start 之前的块只放在主镜像上，之后的块每 stripe_blocks 个一组轮流放到各个设备上
+struct StripeLayout {
+    unsigned int device_count;
+    unsigned int stripe_blocks;
+    uint64_t stripe_start;
+    uint64_t primary_base;     // 主镜像上数据区的起始偏移
+    unsigned int block_size;
+
+    StripeLayout() : device_count(1), stripe_blocks(1), stripe_start(0), primary_base(0), block_size(0) {}
+
+    // 块所在的设备，offset 为设备内的字节偏移
+    unsigned int locate(uint64_t block_number, uint64_t& offset) const {
+        if (device_count == 1 || block_number < stripe_start) {
+            offset = primary_base + block_number * block_size;
+            return 0;
+        }
+        uint64_t relative = block_number - stripe_start;
+        uint64_t stripe = relative / stripe_blocks;
+        unsigned int device = stripe % device_count;
+        uint64_t local = (stripe / device_count) * stripe_blocks + relative % stripe_blocks;
+        offset = device == 0 ? primary_base + (stripe_start + local) * block_size : local * block_size;
+        return device;
+    }
+
+    // 从 block_number 开始在同一设备上连续存放的块数 (不超过 count)
+    uint64_t run_length(uint64_t block_number, uint64_t count) const {
+        if (device_count == 1) return count;
+        if (block_number < stripe_start) return std::min(count, stripe_start - block_number);
+        return std::min<uint64_t>(count, stripe_blocks - (block_number - stripe_start) % stripe_blocks);
+    }
+
+    // 共 block_count 个数据块时设备上存放的块数 (主镜像包括 stripe_start 之前的块)
+    uint64_t device_blocks(unsigned int device, uint64_t block_count) const {
+        if (device_count == 1) return device == 0 ? block_count : 0;
+        uint64_t striped = block_count > stripe_start ? block_count - stripe_start : 0;
+        uint64_t stripes = striped / stripe_blocks;
+        uint64_t blocks = (stripes / device_count + (device < stripes % device_count ? 1 : 0)) * stripe_blocks;
+        if (device == stripes % device_count) blocks += striped % stripe_blocks;
+        return device == 0 ? blocks + block_count - striped : blocks;
+    }
+};
+
+// 一组镜像文件的只读句柄 (每个设备一个)，多线程遍历时每个线程各用一组，不经过挂载的文件流
+class ImageReader {
+public:
+    ImageReader(const std::vector<std::string>& paths, const StripeLayout& layout);
+
+    // 主镜像 (超级块和 inode 表)
+    std::istream& primary() { return *files[0]; }
+
+    // 读取 count 个连续的数据块，不做校验
+    bool read_blocks(uint64_t start, uint64_t count, char* buffer);
+
+    // 所有文件都打开且没有出错
+    bool good() const;
+
+private:
+    std::vector<std::unique_ptr<std::ifstream>> files;
+    StripeLayout layout;
+};
+#endif // STRIPE_H
@@ -0,0 +1,98 @@
+#include "thread_pool.h"
+
+namespace {
+// 当前线程所属的线程池及其编号
+thread_local ThreadPool* current_pool = nullptr;
+thread_local int current_index = -1;
+}
+
+ThreadPool::ThreadPool(unsigned int thread_count) {
+    if (thread_count == 0) {
+        thread_count = std::thread::hardware_concurrency();
+        if (thread_count == 0) thread_count = 1;
+    }
+    for (unsigned int i = 0; i < thread_count; i++) {
+        queues.push_back(std::make_unique<WorkerQueue>());
+    }
+    for (unsigned int i = 0; i < thread_count; i++) {
+        workers.emplace_back(&ThreadPool::worker_loop, this, i);
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    task_ready.notify_all();
+    for (auto& worker : workers) {
+        worker.join();
+    }
+}
+
+int ThreadPool::worker_index() {
+    return current_index;
+}
+
+void ThreadPool::submit(std::function<void()> task) {
+    unsigned int index;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        pending++;
+        queued++;
+        index = current_pool == this ? current_index : next_queue++ % queues.size();
+    }
+    {
+        std::lock_guard<std::mutex> lock(queues[index]->mutex);
+        queues[index]->tasks.push_back(std::move(task));
+    }
+    task_ready.notify_one();
+}
+
+void ThreadPool::wait() {
+    std::unique_lock<std::mutex> lock(mutex);
+    all_done.wait(lock, [this] { return pending == 0; });
+}
+
+bool ThreadPool::take_task(unsigned int index, std::function<void()>& task) {
+    for (unsigned int k = 0; k < queues.size(); k++) {
+        WorkerQueue& queue = *queues[(index + k) % queues.size()];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (queue.tasks.empty()) continue;
+        if (k == 0) {
+            task = std::move(queue.tasks.back());
+            queue.tasks.pop_back();
+        } else {
+            task = std::move(queue.tasks.front());
+            queue.tasks.pop_front();
+        }
+        return true;
+    }
+    return false;
+}
+
+void ThreadPool::worker_loop(unsigned int index) {
+    current_pool = this;
+    current_index = index;
+    while (true) {
+        std::function<void()> task;
+        if (!take_task(index, task)) {
+            std::unique_lock<std::mutex> lock(mutex);
+            task_ready.wait(lock, [this] { return stopping || queued > 0; });
+            if (stopping && queued == 0) return;
+            continue;
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            queued--;
+        }
+        task();
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            pending--;
+            if (pending == 0) {
+                all_done.notify_all();
+            }
+        }
+    }
+}
@@ -0,0 +1,54 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// 固定大小的工作窃取线程池
+// 每个工作线程有自己的任务队列，任务中提交的子任务放入本线程队列的尾部并优先执行 (深度优先)，
+// 空闲的线程从其他队列的头部窃取任务，适合目录树遍历这类任务会不断派生新任务的场景
+class ThreadPool {
+public:
+    // thread_count 为 0 时使用硬件线程数
+    explicit ThreadPool(unsigned int thread_count = 0);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    // 提交一个任务
+    void submit(std::function<void()> task);
+
+    // 等待所有已提交的任务完成 (包括任务执行过程中提交的任务)
+    void wait();
+
+    unsigned int size() const { return workers.size(); }
+
+    // 当前线程在所属线程池中的编号，不是线程池的工作线程时返回 -1
+    static int worker_index();
+
+private:
+    struct WorkerQueue {
+        std::mutex mutex;
+        std::deque<std::function<void()>> tasks;
+    };
+
+    void worker_loop(unsigned int index);
+    // 取一个任务：先取自己队列尾部的，再从其他队列头部窃取
+    bool take_task(unsigned int index, std::function<void()>& task);
+
+    std::vector<std::thread> workers;
+    std::vector<std::unique_ptr<WorkerQueue>> queues;
+    std::mutex mutex;
+    std::condition_variable task_ready;
+    std::condition_variable all_done;
+    unsigned int queued = 0;    // 已提交但还未被取走的任务数
+    unsigned int pending = 0;   // 已提交但还未执行完的任务数
+    unsigned int next_queue = 0; // 外部线程提交任务时轮流放入的队列
+    bool stopping = false;
+};
+#endif // THREAD_POOL_H
@@ -0,0 +1,183 @@
+#include "trace.h"
+#include "myfs.h"
+
+// 写缓冲区攒到这个大小再写文件
+const size_t TRACE_BUFFER_SIZE = 64 * 1024;
+
+// 当前线程正在记录的调用层数，只有最外层的调用写出记录
+static thread_local int trace_depth = 0;
+
+static const char* const TRACE_OP_NAMES[TRACE_OP_COUNT] = {
+    "mkdir", "rmdir", "create", "remove", "open", "close", "read", "read_at", "write", "write_at",
+    "seek", "truncate", "fallocate", "list", "clone", "sync", "du", "find", "remove_tree", "copy_tree",
+    "create_many", "mkdir_many", "remove_many", "defrag",
+    "readdir_plus", "change_dir", "frag_report", "fsck", "import_tree", "export_tree"
+};
+
+const char* trace_op_name(TraceOp op) {
+    return op < TRACE_OP_COUNT ? TRACE_OP_NAMES[op] : "unknown";
+}
+
+// 变长编码：每字节 7 位，最高位表示后面还有
+static void put_varint(std::vector<char>& out, uint64_t value) {
+    while (value >= 0x80) {
+        out.push_back(static_cast<char>((value & 0x7F) | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<char>(value));
+}
+
+static bool get_varint(std::istream& in, uint64_t& value) {
+    value = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        int c = in.get();
+        if (c == EOF) return false;
+        value |= (uint64_t)(c & 0x7F) << shift;
+        if ((c & 0x80) == 0) return true;
+    }
+    return false;
+}
+
+static void put_string(std::vector<char>& out, const std::string& text) {
+    put_varint(out, text.size());
+    out.insert(out.end(), text.begin(), text.end());
+}
+
+static bool get_string(std::istream& in, std::string& text) {
+    uint64_t length;
+    if (!get_varint(in, length) || length > 1024 * 1024) return false;
+    text.resize(length);
+    return (bool)in.read(text.data(), length);
+}
+
+std::string join_trace_names(const std::vector<std::string>& names) {
+    std::string joined;
+    for (size_t i = 0; i < names.size(); i++) {
+        if (i > 0) joined += '\n';
+        joined += names[i];
+    }
+    return joined;
+}
+
+// 打开记录文件并写文件头
+bool TraceWriter::open(const std::string& path, uint64_t total_size, uint32_t block_size) {
+    file.open(path, std::ios::binary | std::ios::trunc);
+    if (!file.is_open()) {
+        std::cerr << "Unable to create trace file " << path << "." << std::endl;
+        return false;
+    }
+    TraceHeader header{};
+    memcpy(header.magic, TRACE_MAGIC, sizeof(header.magic));
+    header.total_size = total_size;
+    header.block_size = block_size;
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    buffer.reserve(TRACE_BUFFER_SIZE + 1024);
+    begin = std::chrono::steady_clock::now();
+    return true;
+}
+
+// 追加一条记录
+void TraceWriter::write(const TraceRecord& record) {
+    std::lock_guard<std::mutex> lock(mutex);
+    buffer.push_back(static_cast<char>(record.op));
+    put_varint(buffer, record.start);
+    put_varint(buffer, record.duration);
+    put_varint(buffer, ((uint64_t)record.fd << 1) ^ (uint64_t)(record.fd >> 63));
+    put_varint(buffer, record.arg1);
+    put_varint(buffer, record.arg2);
+    put_string(buffer, record.path);
+    put_string(buffer, record.path2);
+    if (buffer.size() >= TRACE_BUFFER_SIZE) {
+        file.write(buffer.data(), buffer.size());
+        buffer.clear();
+    }
+}
+
+// 写出缓冲的记录并关闭文件
+void TraceWriter::close() {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!file.is_open()) return;
+    file.write(buffer.data(), buffer.size());
+    buffer.clear();
+    file.close();
+}
+
+// 打开记录文件并检查文件头
+bool TraceReader::open(const std::string& path) {
+    file.open(path, std::ios::binary);
+    if (!file.is_open()) {
+        std::cerr << "Unable to open trace file " << path << "." << std::endl;
+        return false;
+    }
+    if (!file.read(reinterpret_cast<char*>(&file_header), sizeof(file_header)) ||
+        memcmp(file_header.magic, TRACE_MAGIC, sizeof(TRACE_MAGIC)) != 0) {
+        std::cerr << path << " is not a trace file." << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// 读取下一条记录
+bool TraceReader::next(TraceRecord& record) {
+    int op = file.get();
+    if (op == EOF) return false;
+    if (op >= TRACE_OP_COUNT) {
+        std::cerr << "Corrupted trace record." << std::endl;
+        return false;
+    }
+    record.op = static_cast<TraceOp>(op);
+    uint64_t fd;
+    if (!get_varint(file, record.start) || !get_varint(file, record.duration) || !get_varint(file, fd) ||
+        !get_varint(file, record.arg1) || !get_varint(file, record.arg2) ||
+        !get_string(file, record.path) || !get_string(file, record.path2)) {
+        std::cerr << "Truncated trace record." << std::endl;
+        return false;
+    }
+    record.fd = (int64_t)(fd >> 1) ^ -(int64_t)(fd & 1);
+    return true;
+}
+
+TraceScope::TraceScope(TraceWriter* writer, TraceOp op, int64_t fd, uint64_t arg1, uint64_t arg2,
+                       std::string_view path, std::string_view path2)
+    : writer(nullptr), counted(writer != nullptr) {
+    if (!counted || trace_depth++ > 0) return;
+    this->writer = writer;
+    record.op = op;
+    record.fd = fd;
+    record.arg1 = arg1;
+    record.arg2 = arg2;
+    record.path = path;
+    record.path2 = path2;
+    start_time = std::chrono::steady_clock::now();
+}
+
+TraceScope::~TraceScope() {
+    if (!counted) return;
+    trace_depth--;
+    if (writer == nullptr) return;
+    auto end_time = std::chrono::steady_clock::now();
+    record.start = std::chrono::duration_cast<std::chrono::nanoseconds>(start_time - writer->begin_time()).count();
+    record.duration = std::chrono::duration_cast<std::chrono::nanoseconds>(end_time - start_time).count();
+    writer->write(record);
+}
+
+// 开始记录调用
+bool MyFileSystem::start_trace(const std::string& trace_path) {
+    wait_async();
+    stop_trace();
+    auto writer = std::make_unique<TraceWriter>();
+    if (!writer->open(trace_path, superblock.total_size, block_size)) {
+        return false;
+    }
+    trace_writer = std::move(writer);
+    return true;
+}
+
+// 停止记录
+void MyFileSystem::stop_trace() {
+    wait_async();
+    if (trace_writer) {
+        trace_writer->close();
+        trace_writer.reset();
+    }
+}
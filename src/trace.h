@@ -0,0 +1,129 @@
+#ifndef TRACE_H
+#define TRACE_H
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// 调用记录 (trace) 的文件格式：
+//   文件头 TraceHeader，之后是逐条记录
+//   每条记录：操作码 1 字节，然后依次是开始时间、耗时 (纳秒)、句柄、两个数字参数、两个字符串参数
+//   整数都用变长编码 (LEB128，句柄先做 zigzag 变换)，字符串为长度加内容，不记录读写的数据本身
+
+// 记录的操作，编号写在文件中，只能在末尾追加
+enum TraceOp : uint8_t {
+    TRACE_MKDIR,
+    TRACE_RMDIR,
+    TRACE_CREATE,
+    TRACE_REMOVE,
+    TRACE_OPEN,         // fd 为返回的句柄
+    TRACE_CLOSE,
+    TRACE_READ,         // arg1 偏移, arg2 长度
+    TRACE_READ_AT,      // 从当前位置读，arg2 长度
+    TRACE_WRITE,        // arg1 偏移, arg2 长度
+    TRACE_WRITE_AT,     // 从当前位置写，arg2 长度
+    TRACE_SEEK,         // arg1 位置
+    TRACE_TRUNCATE,     // arg1 大小
+    TRACE_FALLOCATE,    // arg1 偏移, arg2 长度
+    TRACE_LIST,
+    TRACE_CLONE,        // path 源, path2 目标
+    TRACE_SYNC,
+    TRACE_DU,
+    TRACE_FIND,         // path2 为模式
+    TRACE_REMOVE_TREE,
+    TRACE_COPY_TREE,    // path 源, path2 目标
+    TRACE_CREATE_MANY,  // path2 为换行分隔的名字
+    TRACE_MKDIR_MANY,
+    TRACE_REMOVE_MANY,
+    TRACE_DEFRAG,
+    TRACE_READDIR_PLUS, // arg1 游标, arg2 最多返回的项数
+    TRACE_CHANGE_DIR,   // path 调用前的当前目录, path2 目标
+    TRACE_FRAG_REPORT,
+    TRACE_FSCK,         // arg1 是否修复, arg2 线程数
+    TRACE_IMPORT_TREE,  // path 主机目录, path2 镜像中的路径, arg1 线程数
+    TRACE_EXPORT_TREE,  // path 镜像中的路径, path2 主机目录, arg1 线程数
+    TRACE_OP_COUNT
+};
+
+// 操作名，用于输出
+const char* trace_op_name(TraceOp op);
+
+const char TRACE_MAGIC[8] = {'M', 'Y', 'F', 'S', 'T', 'R', 'C', '1'};
+
+// 文件头，记录开始时镜像的参数，回放时据此格式化新镜像
+struct TraceHeader {
+    char magic[8];
+    uint64_t total_size;
+    uint32_t block_size;
+    uint32_t reserved;
+};
+
+// 一条调用记录
+struct TraceRecord {
+    TraceOp op;
+    uint64_t start;      // 距开始记录的纳秒数
+    uint64_t duration;   // 调用耗时 (纳秒)
+    int64_t fd;
+    uint64_t arg1;
+    uint64_t arg2;
+    std::string path;
+    std::string path2;
+
+    TraceRecord() : op(TRACE_SYNC), start(0), duration(0), fd(-1), arg1(0), arg2(0) {}
+};
+
+// 记录写入器，多个线程 (异步读写的工作线程) 可以同时写
+class TraceWriter {
+public:
+    bool open(const std::string& path, uint64_t total_size, uint32_t block_size);
+    void write(const TraceRecord& record);
+    void close();
+    // 开始记录的时刻
+    std::chrono::steady_clock::time_point begin_time() const { return begin; }
+
+private:
+    std::ofstream file;
+    std::mutex mutex;
+    std::vector<char> buffer;  // 攒够一批再写文件
+    std::chrono::steady_clock::time_point begin;
+};
+
+// 记录读取器
+class TraceReader {
+public:
+    bool open(const std::string& path);
+    const TraceHeader& header() const { return file_header; }
+    // 读取下一条记录，读完或格式错误时返回 false
+    bool next(TraceRecord& record);
+
+private:
+    std::ifstream file;
+    TraceHeader file_header;
+};
+
+// 在作用域内记录一次调用：构造时计时，析构时写出记录
+// 只记录最外层的调用，公开接口之间的相互调用不重复记录
+class TraceScope {
+public:
+    TraceScope(TraceWriter* writer, TraceOp op, int64_t fd = -1, uint64_t arg1 = 0, uint64_t arg2 = 0,
+               std::string_view path = {}, std::string_view path2 = {});
+    ~TraceScope();
+    TraceScope(const TraceScope&) = delete;
+    TraceScope& operator=(const TraceScope&) = delete;
+
+    // 记录 open 返回的句柄
+    void set_fd(int64_t fd) { record.fd = fd; }
+
+private:
+    TraceWriter* writer;   // 不记录或是内层调用时为 nullptr
+    bool counted;          // 计入了调用层数
+    TraceRecord record;
+    std::chrono::steady_clock::time_point start_time;
+};
+
+// 把名字列表拼成换行分隔的字符串 (批量操作的参数)
+std::string join_trace_names(const std::vector<std::string>& names);
+#endif // TRACE_H
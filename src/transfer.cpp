@@ -0,0 +1,327 @@
+#include "myfs.h"
+#include "thread_pool.h"
+#include <chrono>
+#include <condition_variable>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+
+// 导入导出时每次读写的数据量
+const unsigned int TRANSFER_CHUNK_SIZE = 4 * 1024 * 1024;
+// 流水线中最多缓存的数据段数，限制读线程领先写线程的内存占用
+const unsigned int TRANSFER_QUEUE_DEPTH = 16;
+// 不小于这个大小的文件导入前先整体预留连续空间
+const uint64_t CONTIGUOUS_THRESHOLD = 1024 * 1024;
+
+// 主机上的一个待导入项
+struct HostEntry {
+    std::filesystem::path host_path;
+    std::string name;
+    bool directory;
+    uint64_t size;
+    unsigned int inode_number;
+    std::vector<size_t> children;
+};
+
+// 读线程交给写线程的一段文件数据
+struct TransferChunk {
+    unsigned int inode_number;
+    uint64_t offset;
+    std::vector<char> data;
+};
+
+// 输出耗时和吞吐量
+static void report_throughput(const char* action, uint64_t files, uint64_t directories, uint64_t bytes,
+                              std::chrono::steady_clock::time_point begin_time) {
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin_time).count();
+    double elapsed = std::max(seconds, 1e-6);
+    std::cout << action << " " << files << " files, " << directories << " directories, " << bytes << " bytes in "
+              << (uint64_t)(seconds * 1000) << " ms (" << bytes / elapsed / (1024 * 1024) << " MB/s, "
+              << files / elapsed << " files/s)." << std::endl;
+}
+
+// 通过另一个文件句柄读取连续的数据块
+bool MyFileSystem::read_data_blocks(uint64_t start, uint64_t count, char* buffer, ImageReader& image) {
+    image.read_blocks(start, count, buffer);
+    return verify_block_checksums(start, count, buffer);
+}
+
+// 从主机目录导入
+bool MyFileSystem::import_tree(const std::string& host_dir, const std::string& image_path, unsigned int thread_count) {
+    namespace fs = std::filesystem;
+    TraceScope trace(trace_writer.get(), TRACE_IMPORT_TREE, -1, thread_count, 0, host_dir, image_path);
+    OperationScope operation(*this);
+    auto begin_time = std::chrono::steady_clock::now();
+    std::error_code error;
+    if (!fs::is_directory(host_dir, error)) {
+        std::cerr << host_dir << " is not a directory." << std::endl;
+        return false;
+    }
+    if (path_to_inode(image_path) != -1) {
+        std::cerr << "Destination already exists." << std::endl;
+        return false;
+    }
+    int parent = get_parent_inode(image_path);
+    if (parent == -1 || read_inode(parent).type != DIRECTORY) {
+        std::cerr << "Invalid path." << std::endl;
+        return false;
+    }
+
+    // 收集主机目录树，符号链接和特殊文件跳过
+    std::vector<HostEntry> entries;
+    size_t last_slash = image_path.find_last_of('/');
+    entries.push_back({host_dir, image_path.substr(last_slash + 1), true, 0, 0, {}});
+    uint64_t skipped = 0;
+    for (size_t i = 0; i < entries.size(); i++) {
+        if (!entries[i].directory) continue;
+        for (const auto& item : fs::directory_iterator(entries[i].host_path, error)) {
+            auto status = item.symlink_status(error);
+            HostEntry entry{item.path(), item.path().filename().string(), fs::is_directory(status), 0, 0, {}};
+            if (!entry.directory && !fs::is_regular_file(status)) {
+                skipped++;
+                continue;
+            }
+            if (!entry.directory) {
+                entry.size = item.file_size(error);
+            }
+            entries[i].children.push_back(entries.size());
+            entries.push_back(std::move(entry));
+        }
+        if (error) {
+            std::cerr << "Unable to read " << entries[i].host_path << ": " << error.message() << std::endl;
+            return false;
+        }
+    }
+
+    // 目录项数超过上限的目录在创建任何东西之前拒绝，不留下导入了一半的目录树
+    for (const auto& entry : entries) {
+        if (entry.directory && entry.children.size() > max_directory_entries()) {
+            std::cerr << entry.host_path << " has " << entry.children.size() << " entries, a directory can hold at most "
+                      << max_directory_entries() << "." << std::endl;
+            return false;
+        }
+    }
+
+    // 按目录批量创建 inode 和目录项 (entries 中父目录总在子项之前)
+    std::string parent_path = last_slash == 0 ? "/" : image_path.substr(0, last_slash);
+    std::vector<unsigned int> inode_numbers;
+    if (!add_entries(parent, parent_path, {{entries[0].name, DIRECTORY}}, inode_numbers)) {
+        return false;
+    }
+    entries[0].inode_number = inode_numbers[0];
+    std::vector<std::string> paths(entries.size());
+    paths[0] = image_path;
+    for (size_t i = 0; i < entries.size(); i++) {
+        if (!entries[i].directory || entries[i].children.empty()) continue;
+        std::vector<std::pair<std::string, FileType>> batch;
+        for (size_t child : entries[i].children) {
+            batch.push_back({entries[child].name, entries[child].directory ? DIRECTORY : REGULAR_FILE});
+        }
+        if (!add_entries(entries[i].inode_number, paths[i], batch, inode_numbers)) {
+            std::cerr << "Failed to create entries in " << paths[i] << "." << std::endl;
+            return false;
+        }
+        for (size_t k = 0; k < entries[i].children.size(); k++) {
+            size_t child = entries[i].children[k];
+            entries[child].inode_number = inode_numbers[k];
+            paths[child] = paths[i] + "/" + entries[child].name;
+        }
+    }
+
+    // 大文件先整体预留连续空间，写入时不再逐段分配 (压缩或去重挂载时写入按内容重新分配，不预留)
+    std::vector<const HostEntry*> files;
+    uint64_t directories = 0;
+    for (const auto& entry : entries) {
+        if (entry.directory) {
+            directories++;
+            continue;
+        }
+        if (!mount_options.compress && !mount_options.dedup && entry.size >= CONTIGUOUS_THRESHOLD &&
+            !fallocate_file(entry.inode_number, 0, entry.size)) {
+            std::cerr << "Unable to allocate space for " << entry.host_path << "." << std::endl;
+            return false;
+        }
+        files.push_back(&entry);
+    }
+
+    // 流水线：线程池中的读线程按块读取主机文件放入有界队列，当前线程取出后写入镜像
+    std::mutex queue_mutex;
+    std::condition_variable chunk_ready;
+    std::condition_variable slot_free;
+    std::deque<TransferChunk> queue;
+    size_t readers_left = files.size();
+    bool cancelled = false;
+    std::string read_error;
+    auto push_chunk = [&](TransferChunk&& chunk) {
+        std::unique_lock<std::mutex> lock(queue_mutex);
+        slot_free.wait(lock, [&] { return cancelled || queue.size() < TRANSFER_QUEUE_DEPTH; });
+        if (cancelled) return false;
+        queue.push_back(std::move(chunk));
+        chunk_ready.notify_one();
+        return true;
+    };
+
+    ThreadPool pool(thread_count);
+    for (const HostEntry* file : files) {
+        pool.submit([&, file] {
+            std::ifstream input(file->host_path, std::ios::binary);
+            for (uint64_t offset = 0; offset < file->size && input; offset += TRANSFER_CHUNK_SIZE) {
+                TransferChunk chunk{file->inode_number, offset, {}};
+                chunk.data.resize(std::min<uint64_t>(TRANSFER_CHUNK_SIZE, file->size - offset));
+                if (!input.read(chunk.data.data(), chunk.data.size())) {
+                    std::lock_guard<std::mutex> lock(queue_mutex);
+                    read_error = file->host_path.string();
+                    cancelled = true;
+                    slot_free.notify_all();
+                    break;
+                }
+                if (!push_chunk(std::move(chunk))) break;
+            }
+            std::lock_guard<std::mutex> lock(queue_mutex);
+            readers_left--;
+            chunk_ready.notify_one();
+        });
+    }
+
+    uint64_t bytes = 0;
+    bool ok = true;
+    while (true) {
+        TransferChunk chunk;
+        {
+            std::unique_lock<std::mutex> lock(queue_mutex);
+            chunk_ready.wait(lock, [&] { return !queue.empty() || readers_left == 0; });
+            if (queue.empty()) break;
+            chunk = std::move(queue.front());
+            queue.pop_front();
+            slot_free.notify_one();
+        }
+        if (ok && !write_file(chunk.inode_number, chunk.offset, chunk.data.size(), chunk.data.data())) {
+            // 写失败后通知读线程停止，剩下的数据丢弃
+            ok = false;
+            std::lock_guard<std::mutex> lock(queue_mutex);
+            cancelled = true;
+            slot_free.notify_all();
+        }
+        if (ok) {
+            bytes += chunk.data.size();
+        }
+    }
+    pool.wait();
+    if (!read_error.empty()) {
+        std::cerr << "Failed to read " << read_error << "." << std::endl;
+        return false;
+    }
+    if (!ok) {
+        std::cerr << "Failed to write into " << image_path << "." << std::endl;
+        return false;
+    }
+    if (skipped > 0) {
+        std::cout << "Skipped " << skipped << " entries that are not regular files or directories." << std::endl;
+    }
+    report_throughput("Imported", files.size(), directories, bytes, begin_time);
+    return true;
+}
+
+// 导出到主机目录
+bool MyFileSystem::export_tree(const std::string& image_path, const std::string& host_dir, unsigned int thread_count) {
+    namespace fs = std::filesystem;
+    TraceScope trace(trace_writer.get(), TRACE_EXPORT_TREE, -1, thread_count, 0, image_path, host_dir);
+    OperationScope operation(*this);
+    auto begin_time = std::chrono::steady_clock::now();
+    int inode_number = path_to_inode(image_path);
+    if (inode_number == -1) {
+        std::cerr << "Path does not exist." << std::endl;
+        return false;
+    }
+    std::deque<TreeNode> nodes;
+    walk_tree(inode_number, image_path, true, nodes, thread_count);
+
+    // 节点在 nodes 中总排在子节点之前，按顺序创建主机目录即可
+    std::vector<fs::path> host_paths(nodes.size());
+    std::vector<size_t> files;
+    uint64_t directories = 0;
+    std::error_code error;
+    for (size_t i = 0; i < nodes.size(); i++) {
+        std::string_view relative = std::string_view(nodes[i].path).substr(nodes[0].path.size());
+        while (!relative.empty() && relative.front() == '/') relative.remove_prefix(1);
+        host_paths[i] = relative.empty() ? fs::path(host_dir) : fs::path(host_dir) / relative;
+        if (nodes[i].inode.type == DIRECTORY) {
+            fs::create_directories(host_paths[i], error);
+            if (error) {
+                std::cerr << "Unable to create " << host_paths[i] << ": " << error.message() << std::endl;
+                return false;
+            }
+            directories++;
+        } else {
+            files.push_back(i);
+        }
+    }
+
+    // 每个文件一个任务，各工作线程用自己的文件句柄读镜像，物理上连续的块合并为一次读取
+    std::mutex error_mutex;
+    std::string failed;
+    std::vector<std::unique_ptr<ImageReader>> images;
+    ThreadPool pool(thread_count);
+    images.resize(pool.size());
+    const uint64_t chunk_blocks = std::max<uint64_t>(1, TRANSFER_CHUNK_SIZE / block_size);
+    for (size_t index : files) {
+        pool.submit([&, index] {
+            auto& image = images[ThreadPool::worker_index()];
+            if (!image) {
+                image = open_image_reader();
+            }
+            const TreeNode* node = &nodes[index];
+            std::ofstream output(host_paths[index], std::ios::binary | std::ios::trunc);
+            AlignedBuffer buffer(chunk_blocks * block_size);
+            AlignedBuffer cluster_buffer;
+            uint64_t decoded = UINT64_MAX;  // cluster_buffer 中是第几簇
+            uint64_t block_count = (node->inode.size + block_size - 1) / block_size;
+            for (uint64_t first = 0; first < block_count && output; first += chunk_blocks) {
+                uint64_t count = std::min(chunk_blocks, block_count - first);
+                for (uint64_t i = 0; i < count;) {
+                    uint64_t block_number = node->block_map.get(first + i);
+                    uint64_t run = 1;
+                    if (in_compressed_cluster(node->block_map, first + i)) {
+                        // 压缩簇在工作线程中解压，不经过簇缓存
+                        uint64_t cluster = (first + i) / COMPRESS_CLUSTER_BLOCKS;
+                        if (cluster != decoded) {
+                            cluster_buffer.resize((uint64_t)COMPRESS_CLUSTER_BLOCKS * block_size);
+                            if (!decompress_cluster(node->block_map, cluster, cluster_buffer.data(), image.get())) {
+                                output.setstate(std::ios::failbit);
+                            }
+                            decoded = cluster;
+                        }
+                        std::copy_n(cluster_buffer.data() + (first + i) % COMPRESS_CLUSTER_BLOCKS * block_size, block_size,
+                                    buffer.data() + i * block_size);
+                    } else if (block_number == 0) {
+                        // 空洞读出为 0
+                        std::fill_n(buffer.data() + i * block_size, block_size, 0);
+                    } else {
+                        while (i + run < count && node->block_map.get(first + i + run) == block_number + run) run++;
+                        if (!read_data_blocks(block_number, run, buffer.data() + i * block_size, *image)) {
+                            output.setstate(std::ios::failbit);
+                        }
+                    }
+                    i += run;
+                }
+                uint64_t length = std::min(count * block_size, node->inode.size - first * block_size);
+                output.write(buffer.data(), length);
+            }
+            if (!output || !image->good()) {
+                std::lock_guard<std::mutex> lock(error_mutex);
+                failed = host_paths[index].string();
+            }
+        });
+    }
+    pool.wait();
+    if (!failed.empty()) {
+        std::cerr << "Failed to export " << failed << "." << std::endl;
+        return false;
+    }
+    uint64_t bytes = 0;
+    for (size_t index : files) {
+        bytes += nodes[index].inode.size;
+    }
+    report_throughput("Exported", files.size(), directories, bytes, begin_time);
+    return true;
+}
@@ -0,0 +1,564 @@
+#include "myfs.h"
+#include "thread_pool.h"
+#include <algorithm>
+#include <chrono>
+#include <fnmatch.h>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <unordered_set>
+
+// 复制文件数据时每批处理的块数
+const unsigned int COPY_BATCH_BLOCKS = 64;
+
+// 统计 inode 占用的块数 (数据块和间接块)
+static uint64_t count_allocated_blocks(const Inode& inode, const BlockMap& block_map) {
+    uint64_t count = 0;
+    for (uint64_t block_number : block_map) {
+        if (maps_data_block(block_number)) count++;
+    }
+    for (uint64_t table : block_map.level1) {
+        if (table != 0) count++;
+    }
+    if (inode.indirect_block != 0) count++;
+    if (inode.double_indirect_block != 0) count++;
+    return count;
+}
+
+// 多线程遍历目录树
+void MyFileSystem::walk_tree(unsigned int root, const std::string& root_path, bool load_maps,
+                             std::deque<TreeNode>& nodes, unsigned int thread_count) {
+    nodes.clear();
+    // 工作线程通过各自的文件句柄读镜像，先把内存中的修改写下去
+    write_back_inodes();
+    flush_writeback();
+    const unsigned int entries_per_block = block_size / DIRECTORY_ENTRY_SIZE;
+    // deque 在尾部添加元素时已有元素的地址不变，任务之间可以直接传递节点指针
+    std::mutex nodes_mutex;
+    nodes.emplace_back();
+    TreeNode* start = &nodes.back();
+    start->inode_number = root;
+    start->path = root_path;
+    start->name = root_path.substr(root_path.find_last_of('/') + 1);
+
+    std::vector<std::unique_ptr<ImageReader>> images;
+    ThreadPool pool(thread_count);
+    images.resize(pool.size());
+    std::function<void(TreeNode*)> visit = [&](TreeNode* node) {
+        // 每个工作线程使用自己的文件句柄
+        auto& image = images[ThreadPool::worker_index()];
+        if (!image) {
+            image = open_image_reader();
+        }
+        node->inode = read_inode(node->inode_number, *image);
+        BlockMap block_map;
+        load_block_map(node->inode, block_map, image.get());
+        node->allocated_blocks = count_allocated_blocks(node->inode, block_map);
+        if (load_maps) {
+            node->block_map = std::move(block_map);
+        }
+        if (node->inode.type != DIRECTORY) return;
+
+        // 逐个目录项展开，子目录作为新任务提交
+        const BlockMap& directory_map = load_maps ? node->block_map : block_map;
+        PooledBuffer block_buffer(buffer_pool);
+        std::string prefix = node->path == "/" ? "/" : node->path + "/";
+        for (uint64_t i = 0; i < directory_map.size(); i++) {
+            if (directory_map.get(i) == 0) continue;
+            read_data_block(directory_map.get(i), block_buffer.data(), *image);
+            for (unsigned int j = 0; j < entries_per_block; j++) {
+                const DirectoryEntry* entry = reinterpret_cast<const DirectoryEntry*>(block_buffer.data() + j * DIRECTORY_ENTRY_SIZE);
+                if (entry->inode_number == 0 || entry->inode_number >= superblock.inode_count) continue;
+                TreeNode* child;
+                {
+                    std::lock_guard<std::mutex> lock(nodes_mutex);
+                    nodes.emplace_back();
+                    child = &nodes.back();
+                }
+                child->inode_number = entry->inode_number;
+                child->parent = node;
+                child->name = entry->filename;
+                child->path = prefix + child->name;
+                node->children.push_back(child);
+                pool.submit([&visit, child] { visit(child); });
+            }
+        }
+    };
+    pool.submit([&visit, start] { visit(start); });
+    pool.wait();
+}
+
+// 批量添加目录项
+bool MyFileSystem::add_entries(unsigned int parent, const std::string& parent_path,
+                               const std::vector<std::pair<std::string, FileType>>& entries,
+                               std::vector<unsigned int>& inode_numbers) {
+    inode_numbers.clear();
+    if (entries.empty()) {
+        return true;
+    }
+    Inode parent_inode = read_inode(parent);
+    if (parent_inode.type != DIRECTORY) {
+        std::cerr << "Not a directory." << std::endl;
+        return false;
+    }
+
+    // 一次读出父目录的所有目录块，记录已有的文件名和空闲位置
+    const unsigned int entries_per_block = block_size / DIRECTORY_ENTRY_SIZE;
+    BlockMap block_map;
+    load_block_map(parent_inode, block_map);
+    std::vector<std::vector<char>> blocks(block_map.size());
+    std::unordered_set<std::string> names;
+    std::vector<std::pair<uint64_t, unsigned int>> free_slots;
+    uint64_t used = 0;
+    for (uint64_t i = 0; i < block_map.size(); i++) {
+        if (block_map.get(i) == 0) continue;
+        blocks[i].resize(block_size);
+        read_data_block(block_map.get(i), blocks[i].data());
+        for (unsigned int j = 0; j < entries_per_block; j++) {
+            const DirectoryEntry* entry = reinterpret_cast<const DirectoryEntry*>(blocks[i].data() + j * DIRECTORY_ENTRY_SIZE);
+            if (entry->inode_number == 0) {
+                free_slots.push_back({i, j});
+            } else {
+                names.insert(entry->filename);
+                used++;
+            }
+        }
+    }
+
+    // 目录的映射表放不下整批时在修改任何东西之前拒绝
+    if (used + entries.size() > max_directory_entries()) {
+        std::cerr << "Directory " << parent_path << " can hold at most " << max_directory_entries() << " entries ("
+                  << used << " used), cannot add " << entries.size() << "." << std::endl;
+        return false;
+    }
+    for (auto& entry : entries) {
+        if (entry.first.empty() || entry.first.length() > MAX_FILE_NAME_LENGTH || entry.first.find('/') != std::string::npos) {
+            std::cerr << "Invalid file name: " << entry.first << std::endl;
+            return false;
+        }
+        if (!names.insert(entry.first).second) {
+            std::cerr << entry.first << " already exists." << std::endl;
+            return false;
+        }
+    }
+
+    // 空位不够时为父目录分配新的目录块，填在映射表中第一批未分配的位置上
+    // (上面已检查过总数，映射表一定放得下)，超出直接块的部分由 store_block_map 分配间接块
+    uint64_t needed_blocks = 0;
+    if (entries.size() > free_slots.size()) {
+        needed_blocks = (entries.size() - free_slots.size() + entries_per_block - 1) / entries_per_block;
+    }
+    if (!find_free_inodes(entries.size(), inode_numbers)) {
+        return false;
+    }
+    std::vector<uint64_t> new_blocks;
+    auto release_new_blocks = [&] {
+        for (uint64_t allocated : new_blocks) {
+            free_data_block(allocated);
+        }
+        inode_numbers.clear();
+    };
+    for (uint64_t i = 0; i < max_file_blocks() && new_blocks.size() < needed_blocks; i++) {
+        if (block_map.get(i) != 0) continue;
+        uint64_t block_number = allocate_data_block();
+        if (block_number == (uint64_t)-1) {
+            release_new_blocks();
+            return false;
+        }
+        new_blocks.push_back(block_number);
+        block_map[i] = block_number;
+        if (i >= blocks.size()) {
+            blocks.resize(i + 1);
+        }
+        // 新分配的块可能残留旧数据，目录块必须从全 0 开始
+        blocks[i].assign(block_size, 0);
+        for (unsigned int j = 0; j < entries_per_block; j++) {
+            free_slots.push_back({i, j});
+        }
+    }
+    if (!new_blocks.empty() && !store_block_map(parent_inode, block_map)) {
+        release_new_blocks();
+        return false;
+    }
+
+    // 填写目录项，每个目录块只写一次
+    std::vector<char> touched(blocks.size(), 0);
+    for (size_t k = 0; k < entries.size(); k++) {
+        auto [i, j] = free_slots[k];
+        DirectoryEntry* slot = reinterpret_cast<DirectoryEntry*>(blocks[i].data() + j * DIRECTORY_ENTRY_SIZE);
+        memset(slot->filename, 0, sizeof(slot->filename));
+        strcpy(slot->filename, entries[k].first.c_str());
+        slot->inode_number = inode_numbers[k];
+        touched[i] = 1;
+    }
+    for (uint64_t i = 0; i < blocks.size(); i++) {
+        if (touched[i]) {
+            write_data_block(block_map.get(i), blocks[i].data());
+        }
+    }
+
+    // 初始化新 inode，编号连续的一段合并为一次写入
+    time_t now = time(nullptr);
+    std::string prefix = parent_path == "/" ? "/" : parent_path + "/";
+    std::vector<Inode> new_inodes(entries.size());
+    for (size_t k = 0; k < entries.size(); k++) {
+        Inode& inode = new_inodes[k];
+        inode.type = entries[k].second;
+        inode.created_time = now;
+        inode.modified_time = now;
+        inode.accessed_time = now;
+        inode.used = true;
+        strncpy(inode.path, (prefix + entries[k].first).c_str(), sizeof(inode.path) - 1);
+    }
+    for (size_t k = 0; k < entries.size();) {
+        size_t end = k + 1;
+        while (end < entries.size() && inode_numbers[end] == inode_numbers[end - 1] + 1) end++;
+        write_inodes(inode_numbers[k], end - k, new_inodes.data() + k);
+        k = end;
+    }
+    superblock.free_inode_count -= entries.size();
+    inode_hint = inode_numbers.back() + 1;
+    write_superblock();
+
+    parent_inode.size += entries.size() * DIRECTORY_ENTRY_SIZE;
+    parent_inode.modified_time = now;
+    write_inode(parent, parent_inode);
+    return true;
+}
+
+// 批量删除目录项
+bool MyFileSystem::remove_entries(unsigned int parent, const std::vector<unsigned int>& inode_numbers) {
+    std::unordered_set<unsigned int> targets(inode_numbers.begin(), inode_numbers.end());
+    Inode parent_inode = read_inode(parent);
+    BlockMap block_map;
+    load_block_map(parent_inode, block_map);
+    PooledBuffer block_buffer(buffer_pool);
+    unsigned int removed = 0;
+    for (uint64_t i = 0; i < block_map.size() && removed < targets.size(); i++) {
+        if (block_map.get(i) == 0) continue;
+        read_data_block(block_map.get(i), block_buffer.data());
+        bool changed = false;
+        for (unsigned int j = 0; j < block_size / DIRECTORY_ENTRY_SIZE; j++) {
+            DirectoryEntry* entry = reinterpret_cast<DirectoryEntry*>(block_buffer.data() + j * DIRECTORY_ENTRY_SIZE);
+            if (entry->inode_number != 0 && targets.count(entry->inode_number)) {
+                entry->inode_number = 0;
+                memset(entry->filename, 0, sizeof(entry->filename));
+                changed = true;
+                removed++;
+            }
+        }
+        if (changed) {
+            write_data_block(block_map.get(i), block_buffer.data());
+        }
+    }
+    if (removed > 0) {
+        parent_inode.size -= removed * DIRECTORY_ENTRY_SIZE;
+        parent_inode.modified_time = time(nullptr);
+        write_inode(parent, parent_inode);
+    }
+    if (removed != targets.size()) {
+        std::cerr << "Failed to remove directory entry from parent." << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// 释放节点占用的块和 inode
+void MyFileSystem::release_nodes(const std::vector<const TreeNode*>& nodes) {
+    // 新格式的镜像交给后台线程回收
+    if (superblock.version >= 5) {
+        std::vector<unsigned int> inode_numbers;
+        for (const TreeNode* node : nodes) {
+            inode_numbers.push_back(node->inode_number);
+        }
+        reclaim_inodes(inode_numbers);
+        return;
+    }
+    std::vector<uint64_t> blocks;
+    std::vector<unsigned int> inode_numbers;
+    for (const TreeNode* node : nodes) {
+        for (uint64_t block_number : node->block_map) {
+            if (maps_data_block(block_number)) blocks.push_back(block_number);
+        }
+        for (uint64_t table : node->block_map.level1) {
+            if (table != 0) blocks.push_back(table);
+        }
+        if (node->inode.indirect_block != 0) blocks.push_back(node->inode.indirect_block);
+        if (node->inode.double_indirect_block != 0) blocks.push_back(node->inode.double_indirect_block);
+        inode_numbers.push_back(node->inode_number);
+    }
+
+    // 块号连续的一段一起释放 (共享块由 free_data_blocks 只减少引用计数)
+    std::sort(blocks.begin(), blocks.end());
+    for (size_t i = 0; i < blocks.size();) {
+        size_t end = i + 1;
+        while (end < blocks.size() && blocks[end] == blocks[end - 1] + 1) end++;
+        free_data_blocks(blocks[i], end - i);
+        i = end;
+    }
+
+    // inode 清空后按连续的编号成段写回
+    std::sort(inode_numbers.begin(), inode_numbers.end());
+    std::vector<Inode> empty_inodes;
+    for (size_t i = 0; i < inode_numbers.size();) {
+        size_t end = i + 1;
+        while (end < inode_numbers.size() && inode_numbers[end] == inode_numbers[end - 1] + 1) end++;
+        empty_inodes.resize(end - i);
+        write_inodes(inode_numbers[i], end - i, empty_inodes.data());
+        i = end;
+    }
+    if (!inode_numbers.empty()) {
+        superblock.free_inode_count += inode_numbers.size();
+        inode_hint = std::min(inode_hint, inode_numbers.front());
+        write_superblock();
+    }
+}
+
+// 复制文件数据到新分配的块中
+bool MyFileSystem::copy_file_blocks(const BlockMap& src, BlockMap& dst) {
+    // 压缩簇的标记先复制过来，分配时跳过；压缩数据块与普通块一样原样复制
+    for (uint64_t i = 0; i < src.size(); i += COMPRESS_CLUSTER_BLOCKS) {
+        if (src.get(i) == COMPRESSED_CLUSTER) dst[i] = COMPRESSED_CLUSTER;
+    }
+    // 按源文件中已分配的每一段逻辑块分配空间，空洞保持为空洞
+    bool changed = false;
+    for (uint64_t i = 0; i < src.size();) {
+        if (src.get(i) == 0) {
+            i++;
+            continue;
+        }
+        uint64_t last = i;
+        while (last + 1 < src.size() && src.get(last + 1) != 0) last++;
+        if (!reserve_blocks(dst, i, last, changed)) {
+            return false;
+        }
+        i = last + 1;
+    }
+
+    // 成批复制，物理上连续的块合并为一次读写
+    AlignedBuffer buffer((uint64_t)COPY_BATCH_BLOCKS * block_size);
+    std::vector<uint64_t> batch;
+    auto copy_batch = [&]() {
+        bool ok = true;
+        for (size_t k = 0; k < batch.size();) {
+            size_t end = k + 1;
+            while (end < batch.size() && src.get(batch[end]) == src.get(batch[end - 1]) + 1) end++;
+            ok = read_data_blocks(src.get(batch[k]), end - k, buffer.data() + k * block_size) && ok;
+            k = end;
+        }
+        // 源数据校验失败时不复制，以免给损坏的数据配上新的校验和
+        if (!ok) return false;
+        for (size_t k = 0; k < batch.size();) {
+            size_t end = k + 1;
+            while (end < batch.size() && dst.get(batch[end]) == dst.get(batch[end - 1]) + 1) end++;
+            write_data_blocks(dst.get(batch[k]), end - k, buffer.data() + k * block_size);
+            k = end;
+        }
+        batch.clear();
+        return true;
+    };
+    for (uint64_t i = 0; i < src.size(); i++) {
+        if (!maps_data_block(src.get(i))) continue;
+        batch.push_back(i);
+        if (batch.size() == COPY_BATCH_BLOCKS && !copy_batch()) return false;
+    }
+    return copy_batch();
+}
+
+// 统计目录树占用的空间
+bool MyFileSystem::du(const std::string& path, unsigned int thread_count) {
+    TraceScope trace(trace_writer.get(), TRACE_DU, -1, 0, 0, path);
+    OperationScope operation(*this);
+    auto begin_time = std::chrono::steady_clock::now();
+    int inode_number = path_to_inode(path);
+    if (inode_number == -1) {
+        std::cerr << "Path does not exist." << std::endl;
+        return false;
+    }
+    std::deque<TreeNode> nodes;
+    walk_tree(inode_number, path, false, nodes, thread_count);
+
+    // 子节点总是排在父节点之后，倒序把用量累加到父目录上，之后 allocated_blocks 表示整个子树的用量
+    uint64_t files = 0;
+    uint64_t directories = 0;
+    uint64_t bytes = 0;
+    for (auto it = nodes.rbegin(); it != nodes.rend(); ++it) {
+        if (it->inode.type == DIRECTORY) {
+            directories++;
+        } else {
+            files++;
+            bytes += it->inode.size;
+        }
+        if (it->parent != nullptr) {
+            it->parent->allocated_blocks += it->allocated_blocks;
+        }
+    }
+
+    std::vector<const TreeNode*> dirs;
+    for (auto& node : nodes) {
+        if (node.inode.type == DIRECTORY) dirs.push_back(&node);
+    }
+    std::sort(dirs.begin(), dirs.end(), [](const TreeNode* a, const TreeNode* b) { return a->path < b->path; });
+    for (const TreeNode* dir : dirs) {
+        std::cout << dir->allocated_blocks * block_size / 1024 << "K\t" << dir->path << std::endl;
+    }
+    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - begin_time);
+    std::cout << "Total: " << files << " files, " << directories << " directories, " << bytes << " bytes, "
+              << nodes.front().allocated_blocks << " blocks allocated (" << elapsed.count() << " ms)." << std::endl;
+    return true;
+}
+
+// 按文件名查找
+bool MyFileSystem::find(const std::string& path, const std::string& pattern, unsigned int thread_count) {
+    TraceScope trace(trace_writer.get(), TRACE_FIND, -1, 0, 0, path, pattern);
+    OperationScope operation(*this);
+    int inode_number = path_to_inode(path);
+    if (inode_number == -1) {
+        std::cerr << "Path does not exist." << std::endl;
+        return false;
+    }
+    std::deque<TreeNode> nodes;
+    walk_tree(inode_number, path, false, nodes, thread_count);
+
+    std::vector<std::string> matches;
+    for (auto& node : nodes) {
+        if (fnmatch(pattern.c_str(), node.name.c_str(), 0) == 0) {
+            matches.push_back(node.path);
+        }
+    }
+    std::sort(matches.begin(), matches.end());
+    for (auto& match : matches) {
+        std::cout << match << std::endl;
+    }
+    std::cout << matches.size() << " match(es)." << std::endl;
+    return true;
+}
+
+// 递归删除
+bool MyFileSystem::remove_tree(const std::string& path, unsigned int thread_count) {
+    TraceScope trace(trace_writer.get(), TRACE_REMOVE_TREE, -1, 0, 0, path);
+    OperationScope operation(*this);
+    int inode_number = path_to_inode(path);
+    if (inode_number == -1) {
+        std::cerr << "Path does not exist." << std::endl;
+        return false;
+    }
+    if (inode_number == 0) {
+        std::cerr << "Cannot remove the root directory." << std::endl;
+        return false;
+    }
+    int parent_inode_number = get_parent_inode(path);
+    if (parent_inode_number == -1) {
+        std::cerr << "Invalid path." << std::endl;
+        return false;
+    }
+    // 后台回收时由回收线程读取块映射表
+    std::deque<TreeNode> nodes;
+    walk_tree(inode_number, path, superblock.version < 5, nodes, thread_count);
+
+    // 先把整棵树从父目录中摘下，子树内部的目录项随目录块一起释放，不必逐个修改
+    if (!remove_entries(parent_inode_number, {(unsigned int)inode_number})) {
+        return false;
+    }
+    std::vector<const TreeNode*> all_nodes;
+    uint64_t directories = 0;
+    for (auto& node : nodes) {
+        all_nodes.push_back(&node);
+        if (node.inode.type == DIRECTORY) directories++;
+    }
+    release_nodes(all_nodes);
+    std::cout << "Removed " << path << ": " << nodes.size() - directories << " files, "
+              << directories << " directories." << std::endl;
+    return true;
+}
+
+// 递归复制
+bool MyFileSystem::copy_tree(const std::string& src_path, const std::string& dst_path, unsigned int thread_count) {
+    TraceScope trace(trace_writer.get(), TRACE_COPY_TREE, -1, 0, 0, src_path, dst_path);
+    OperationScope operation(*this);
+    auto begin_time = std::chrono::steady_clock::now();
+    int src_inode_number = path_to_inode(src_path);
+    if (src_inode_number == -1) {
+        std::cerr << "Source does not exist." << std::endl;
+        return false;
+    }
+    if (path_to_inode(dst_path) != -1) {
+        std::cerr << "Destination already exists." << std::endl;
+        return false;
+    }
+    int dst_parent = get_parent_inode(dst_path);
+    if (dst_parent == -1 || read_inode(dst_parent).type != DIRECTORY) {
+        std::cerr << "Invalid path." << std::endl;
+        return false;
+    }
+    // 不能把目录复制到它自己的子树中
+    if (src_path == "/" || dst_path.rfind(src_path + "/", 0) == 0) {
+        std::cerr << "Cannot copy a directory into itself." << std::endl;
+        return false;
+    }
+    std::deque<TreeNode> nodes;
+    walk_tree(src_inode_number, src_path, true, nodes, thread_count);
+
+    uint64_t files = 0;
+    uint64_t directories = 0;
+    uint64_t bytes = 0;
+    // 把节点的数据和属性复制到已经创建好的 inode 中
+    auto copy_contents = [&](const TreeNode* node, unsigned int inode_number) {
+        Inode inode = read_inode(inode_number);
+        if (node->inode.type == REGULAR_FILE) {
+            BlockMap block_map;
+            if (!copy_file_blocks(node->block_map, block_map) || !store_block_map(inode, block_map)) {
+                release_blocks(block_map, 0);
+                store_block_map(inode, block_map);
+                write_inode(inode_number, inode);
+                return false;
+            }
+            inode.size = node->inode.size;
+            files++;
+            bytes += inode.size;
+        } else {
+            directories++;
+        }
+        inode.permissions = node->inode.permissions;
+        write_inode(inode_number, inode);
+        return true;
+    };
+    // 每个目录的子项一次性创建
+    std::function<bool(const TreeNode*, unsigned int, const std::string&)> copy_children =
+        [&](const TreeNode* dir, unsigned int dir_inode_number, const std::string& dir_path) {
+        std::vector<std::pair<std::string, FileType>> entries;
+        for (const TreeNode* child : dir->children) {
+            entries.push_back({child->name, child->inode.type});
+        }
+        std::vector<unsigned int> inode_numbers;
+        if (!add_entries(dir_inode_number, dir_path, entries, inode_numbers)) {
+            return false;
+        }
+        for (size_t k = 0; k < dir->children.size(); k++) {
+            const TreeNode* child = dir->children[k];
+            if (!copy_contents(child, inode_numbers[k])) {
+                return false;
+            }
+            if (child->inode.type == DIRECTORY &&
+                !copy_children(child, inode_numbers[k], dir_path + "/" + child->name)) {
+                return false;
+            }
+        }
+        return true;
+    };
+
+    const TreeNode* root = &nodes.front();
+    size_t last_slash = dst_path.find_last_of('/');
+    std::string parent_path = last_slash == 0 ? "/" : dst_path.substr(0, last_slash);
+    std::vector<unsigned int> inode_numbers;
+    if (!add_entries(dst_parent, parent_path, {{dst_path.substr(last_slash + 1), root->inode.type}}, inode_numbers) ||
+        !copy_contents(root, inode_numbers[0]) ||
+        (root->inode.type == DIRECTORY && !copy_children(root, inode_numbers[0], dst_path))) {
+        std::cerr << "Failed to copy " << src_path << " to " << dst_path << "." << std::endl;
+        return false;
+    }
+    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - begin_time);
+    std::cout << "Copied " << src_path << " -> " << dst_path << ": " << files << " files, " << directories
+              << " directories, " << bytes << " bytes in " << elapsed.count() << " ms." << std::endl;
+    return true;
+}
@@ -0,0 +1,155 @@
+#include "myfs.h"
+#include <functional>
+
+// 旧格式 (版本 1) 的磁盘结构，所有大小和块号都是 32 位
+namespace {
+const int V1_BLOCK_SIZE = 4096;
+const int V1_INDIRECT_BLOCK_ENTRIES = V1_BLOCK_SIZE / sizeof(unsigned int);
+
+struct SuperblockV1 {
+    unsigned int magic_number;
+    unsigned int total_size;
+    unsigned int block_size;
+    unsigned int inode_count;
+    unsigned int data_block_count;
+    unsigned int free_inode_start;
+    unsigned int free_data_block_start;
+    unsigned int free_inode_count;
+    unsigned int free_data_block_count;
+};
+
+struct InodeV1 {
+    FileType type;
+    unsigned int size;
+    unsigned int permissions;
+    time_t created_time;
+    time_t modified_time;
+    time_t accessed_time;
+    unsigned int direct_blocks[DIRECT_BLOCK_COUNT];
+    unsigned int indirect_block;
+    char path[255];
+    bool used;
+};
+}
+
+// 读取镜像的格式版本
+unsigned int MyFileSystem::image_version(const std::string& disk_path) {
+    std::ifstream image(disk_path, std::ios::binary);
+    unsigned int header[2] = {0, 0};
+    if (!image.read(reinterpret_cast<char*>(header), sizeof(header)) || header[0] != MAGIC_NUMBER) {
+        return 0;
+    }
+    // 旧格式在版本号的位置存放的是镜像大小
+    return header[1] >= FS_MIN_VERSION && header[1] <= FS_VERSION ? header[1] : 1;
+}
+
+// 将旧格式的镜像升级到当前格式
+bool MyFileSystem::upgrade(const std::string& old_disk_path) {
+    std::ifstream old_disk(old_disk_path, std::ios::binary);
+    SuperblockV1 old_superblock;
+    if (!old_disk.read(reinterpret_cast<char*>(&old_superblock), sizeof(old_superblock)) ||
+        old_superblock.magic_number != MAGIC_NUMBER) {
+        std::cerr << "Invalid file system format." << std::endl;
+        return false;
+    }
+
+    auto read_old_inode = [&](unsigned int inode_number) {
+        InodeV1 inode;
+        old_disk.seekg(old_superblock.free_inode_start + (uint64_t)inode_number * sizeof(InodeV1), std::ios::beg);
+        old_disk.read(reinterpret_cast<char*>(&inode), sizeof(InodeV1));
+        return inode;
+    };
+    auto read_old_block = [&](unsigned int block_number, char* buffer) {
+        old_disk.seekg(old_superblock.free_data_block_start + (uint64_t)block_number * V1_BLOCK_SIZE, std::ios::beg);
+        old_disk.read(buffer, V1_BLOCK_SIZE);
+    };
+
+    // 新的 inode 更大，按原来的 inode 数量反推 inode 占比
+    uint64_t inode_bytes = (uint64_t)old_superblock.inode_count * INODE_SIZE * 100;
+    unsigned int inode_percentage = (inode_bytes + old_superblock.total_size - 1) / old_superblock.total_size;
+    if (inode_percentage == 0 || inode_percentage >= 100 || !format(old_superblock.total_size, inode_percentage)) {
+        std::cerr << "Unable to create upgraded file system." << std::endl;
+        return false;
+    }
+
+    // 复制 inode 的属性
+    auto copy_attributes = [&](unsigned int inode_number, const InodeV1& old_inode) {
+        Inode inode = read_inode(inode_number);
+        inode.permissions = old_inode.permissions;
+        inode.created_time = old_inode.created_time;
+        inode.modified_time = old_inode.modified_time;
+        inode.accessed_time = old_inode.accessed_time;
+        write_inode(inode_number, inode);
+    };
+
+    // 逐块复制文件内容，空洞保持为空洞
+    char block_buffer[V1_BLOCK_SIZE];
+    std::vector<unsigned int> indirect(V1_INDIRECT_BLOCK_ENTRIES);
+    auto copy_file = [&](const InodeV1& old_inode, int inode_number) {
+        std::fill(indirect.begin(), indirect.end(), 0);
+        if (old_inode.indirect_block != 0) {
+            read_old_block(old_inode.indirect_block, reinterpret_cast<char*>(indirect.data()));
+        }
+        uint64_t block_count = (old_inode.size + V1_BLOCK_SIZE - 1) / V1_BLOCK_SIZE;
+        for (uint64_t i = 0; i < block_count && i < DIRECT_BLOCK_COUNT + V1_INDIRECT_BLOCK_ENTRIES; i++) {
+            unsigned int block_number = i < DIRECT_BLOCK_COUNT ? old_inode.direct_blocks[i] : indirect[i - DIRECT_BLOCK_COUNT];
+            if (block_number == 0 || block_number >= old_superblock.data_block_count) continue;
+            read_old_block(block_number, block_buffer);
+            uint64_t offset = i * V1_BLOCK_SIZE;
+            unsigned int length = std::min<uint64_t>(V1_BLOCK_SIZE, old_inode.size - offset);
+            if (!write_file(inode_number, offset, length, block_buffer)) {
+                return false;
+            }
+        }
+        return truncate_file(inode_number, old_inode.size);
+    };
+
+    // 从根目录开始递归复制目录树
+    std::vector<char> visited(old_superblock.inode_count, 0);
+    unsigned int files = 0;
+    unsigned int directories = 0;
+    std::function<bool(unsigned int, const std::string&)> copy_directory =
+        [&](unsigned int old_inode_number, const std::string& path) {
+        visited[old_inode_number] = 1;
+        InodeV1 old_dir = read_old_inode(old_inode_number);
+        for (int i = 0; i < DIRECT_BLOCK_COUNT; i++) {
+            if (old_dir.direct_blocks[i] == 0) continue;
+            char dir_buffer[V1_BLOCK_SIZE];
+            read_old_block(old_dir.direct_blocks[i], dir_buffer);
+            for (int j = 0; j < V1_BLOCK_SIZE / DIRECTORY_ENTRY_SIZE; j++) {
+                const DirectoryEntry* entry = reinterpret_cast<const DirectoryEntry*>(dir_buffer + j * DIRECTORY_ENTRY_SIZE);
+                unsigned int child = entry->inode_number;
+                if (child == 0 || child >= old_superblock.inode_count || visited[child]) continue;
+                std::string child_path = path + entry->filename;
+                InodeV1 old_inode = read_old_inode(child);
+                if (old_inode.type == DIRECTORY) {
+                    if (!mkdir(child_path) || !copy_directory(child, child_path + "/")) {
+                        return false;
+                    }
+                    directories++;
+                } else {
+                    visited[child] = 1;
+                    if (!create(child_path)) {
+                        return false;
+                    }
+                    int inode_number = path_to_inode(child_path);
+                    if (!copy_file(old_inode, inode_number)) {
+                        return false;
+                    }
+                    files++;
+                }
+                copy_attributes(path_to_inode(child_path), old_inode);
+            }
+        }
+        return true;
+    };
+    if (!copy_directory(0, "/")) {
+        std::cerr << "Failed to copy files from " << old_disk_path << "." << std::endl;
+        return false;
+    }
+    copy_attributes(0, read_old_inode(0));
+
+    std::cout << "Upgraded " << old_disk_path << " to format version " << FS_VERSION << ": "
+              << directories << " directories, " << files << " files." << std::endl;
+    return true;
+}
@@ -1,16 +1,17 @@
 #include "util.h"
-std::vector<std::string> split(std::string str, std::string pattern){
-    std::string::size_type pos;
-    std::vector<std::string> result;
-    str+=pattern;
-    int size = str.size();
-    for(int i=0; i<size; i++){
-        pos = str.find(pattern, i);
-        if(pos<size){
-            std::string s = str.substr(i, pos-i);
-            result.push_back(s);
-            i = pos+pattern.size()-1;
+void split(std::string_view str, std::string_view pattern, std::vector<std::string_view>& result){
+    result.clear();
+    if (pattern.empty()) {
+        if (!str.empty()) result.push_back(str);
+        return;
+    }
+    size_t start = 0;
+    while (start <= str.size()) {
+        size_t pos = str.find(pattern, start);
+        if (pos == std::string_view::npos) pos = str.size();
+        if (pos > start) {
+            result.push_back(str.substr(start, pos - start));
         }
+        start = pos + pattern.size();
     }
-    return result;
-}
\ No newline at end of file
+}
@@ -1,5 +1,9 @@
 #ifndef UTIL_H
 #define UTIL_H
+#include <string>
+#include <string_view>
 #include <vector>
-std::vector<std::string> split(std::string str, std::string pattern);
-#endif // UTIL_H
\ No newline at end of file
+// 按 pattern 切分 str，结果指向 str 内部，不复制字符；result 可重复使用以免反复分配
+// 连续的分隔符之间不产生空字段
+void split(std::string_view str, std::string_view pattern, std::vector<std::string_view>& result);
+#endif // UTIL_H
@@ -0,0 +1,154 @@
+#include "myfs.h"
+#include <algorithm>
+#include <iomanip>
+
+// 读取数据块，队列中尚未写回的块以队列中的内容为准
+bool MyFileSystem::read_raw_blocks(uint64_t start, uint64_t count, char* buffer) {
+    if (writeback.blocks.empty()) {
+        return stripe_io(start, count, buffer, false);
+    }
+    auto first = writeback.blocks.lower_bound(start);
+    auto last = writeback.blocks.lower_bound(start + count);
+    bool ok = true;
+    // 全部在队列中时 (刚修改过的目录块、位图块) 不必读盘
+    if ((uint64_t)std::distance(first, last) != count) {
+        ok = stripe_io(start, count, buffer, false);
+    }
+    for (auto it = first; it != last; ++it) {
+        memcpy(buffer + (it->first - start) * block_size, it->second.data(), block_size);
+    }
+    return ok;
+}
+
+// 写入数据块：小的写入放入写回队列，大块写入直接写盘
+bool MyFileSystem::write_raw_blocks(uint64_t start, uint64_t count, const char* buffer) {
+    if (count * block_size >= WRITEBACK_BYPASS_SIZE) {
+        // 本身已是一次大的顺序写，队列中被覆盖的旧内容作废
+        writeback.blocks.erase(writeback.blocks.lower_bound(start), writeback.blocks.lower_bound(start + count));
+        writeback.unflushed = true;
+        writeback_stats.bypassed_blocks += count;
+        return stripe_io(start, count, const_cast<char*>(buffer), true);
+    }
+    auto hint = writeback.blocks.lower_bound(start);
+    for (uint64_t i = 0; i < count; i++) {
+        if (hint != writeback.blocks.end() && hint->first == start + i) {
+            writeback_stats.absorbed++;
+        } else {
+            hint = writeback.blocks.emplace_hint(hint, start + i, AlignedBuffer(block_size));
+        }
+        memcpy(hint->second.data(), buffer + i * block_size, block_size);
+        ++hint;
+    }
+    return true;
+}
+
+// 把 inode 放入写回队列
+void MyFileSystem::queue_inodes(unsigned int first, unsigned int count, const Inode* inodes) {
+    auto hint = writeback.inodes.lower_bound(first);
+    for (unsigned int i = 0; i < count; i++) {
+        if (hint != writeback.inodes.end() && hint->first == first + i) {
+            writeback_stats.absorbed++;
+            hint->second = inodes[i];
+        } else {
+            hint = writeback.inodes.emplace_hint(hint, first + i, inodes[i]);
+        }
+        ++hint;
+    }
+}
+
+// 排序合并后写回
+bool MyFileSystem::flush_writeback() {
+    if (!disk.is_open()) return true;
+    flush_checksums();
+    uint64_t items = writeback.blocks.size() + writeback.inodes.size() + (writeback.superblock ? 1 : 0);
+    if (items == 0 && !writeback.unflushed) return true;
+    bool ok = true;
+
+    // 按磁盘偏移从小到大写：超级块、inode 表、数据区
+    if (writeback.superblock) {
+        disk.seekp(0, std::ios::beg);
+        if (superblock.version >= 3) {
+            superblock.checksum = superblock_checksum();
+        }
+        disk.write(reinterpret_cast<const char*>(&superblock), superblock_disk_size(superblock.version));
+        writeback.superblock = false;
+        writeback_stats.superblocks++;
+    }
+
+    // 编号连续的 inode 在 inode 表中也连续，合并为一次写入
+    std::vector<Inode> run;
+    for (auto it = writeback.inodes.begin(); it != writeback.inodes.end();) {
+        unsigned int first = it->first;
+        run.clear();
+        for (; it != writeback.inodes.end() && it->first == first + run.size(); ++it) {
+            run.push_back(it->second);
+        }
+        disk.seekp(superblock.free_inode_start + (uint64_t)first * sizeof(Inode), std::ios::beg);
+        disk.write(reinterpret_cast<const char*>(run.data()), run.size() * sizeof(Inode));
+        writeback_stats.inode_writes++;
+    }
+    writeback_stats.inodes += writeback.inodes.size();
+    writeback.inodes.clear();
+
+    // 块号连续的数据块拼到一个池缓冲区中一次写入 (跨设备时由 stripe_io 拆开)，单独的块直接写
+    if (!writeback.blocks.empty()) {
+        PooledBuffer merged(buffer_pool);
+        const uint64_t max_run = PooledBuffer::size() / block_size;
+        for (auto it = writeback.blocks.begin(); it != writeback.blocks.end();) {
+            uint64_t start = it->first;
+            auto next = std::next(it);
+            if (next == writeback.blocks.end() || next->first != start + 1) {
+                ok = stripe_io(start, 1, it->second.data(), true) && ok;
+                it = next;
+            } else {
+                uint64_t count = 0;
+                for (; it != writeback.blocks.end() && it->first == start + count && count < max_run; ++it, ++count) {
+                    memcpy(merged.data() + count * block_size, it->second.data(), block_size);
+                }
+                ok = stripe_io(start, count, merged.data(), true) && ok;
+            }
+            writeback_stats.block_writes++;
+        }
+        writeback_stats.blocks += writeback.blocks.size();
+        writeback.blocks.clear();
+    }
+
+    // 整批写完后每个设备只 fdatasync 一次
+    ok = flush_devices() && ok;
+    writeback.unflushed = false;
+    if (items > 0) {
+        writeback_stats.batches++;
+        writeback_stats.largest_batch = std::max(writeback_stats.largest_batch, items);
+    }
+    if (!ok) {
+        writeback.failed = true;
+    }
+    return ok;
+}
+
+// 丢弃写回队列
+void MyFileSystem::discard_writeback() {
+    writeback.blocks.clear();
+    writeback.inodes.clear();
+    writeback.superblock = false;
+    writeback.unflushed = false;
+}
+
+// 输出写回统计
+void MyFileSystem::writeback_report() {
+    OperationScope operation(*this);
+    const WritebackStats& stats = writeback_stats;
+    // 合并比例：平均每次写入包含的项数
+    auto ratio = [](uint64_t items, uint64_t writes) { return writes == 0 ? 0.0 : (double)items / writes; };
+    std::cout << std::fixed << std::setprecision(2);
+    std::cout << "Writeback batches: " << stats.batches << ", average " << ratio(stats.blocks + stats.inodes + stats.superblocks, stats.batches)
+              << " items, largest " << stats.largest_batch << std::endl;
+    std::cout << "Data blocks: " << stats.blocks << " in " << stats.block_writes << " writes (merge ratio "
+              << ratio(stats.blocks, stats.block_writes) << "), " << stats.bypassed_blocks << " written directly" << std::endl;
+    std::cout << "Inodes: " << stats.inodes << " in " << stats.inode_writes << " writes (merge ratio "
+              << ratio(stats.inodes, stats.inode_writes) << ")" << std::endl;
+    std::cout << "Superblock writes: " << stats.superblocks << ", absorbed rewrites: " << stats.absorbed
+              << ", device syncs: " << stats.syncs << std::endl;
+    std::cout << "Pending: " << writeback.blocks.size() << " blocks, " << writeback.inodes.size() << " inodes" << std::endl;
+    std::cout.unsetf(std::ios::fixed);
+}
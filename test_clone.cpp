@@ -0,0 +1,95 @@
+#include "src/myfs.h"
+#include <filesystem>
+
+// 用法: test_clone
+// 回归测试：去重后同一个数据块可能在文件中出现上万次，克隆时它的引用计数要加上出现的次数，
+// 超过上限时必须拒绝克隆，而不是让引用计数回绕后提前释放仍在使用的块
+
+const std::string IMAGE = "test_clone.img";
+const unsigned int BLOCK = DEFAULT_BLOCK_SIZE;
+
+// 测试结果输出到这里，文件系统自己的提示信息丢弃
+std::ostream report(nullptr);
+int failures = 0;
+
+void check(bool condition, const std::string& what) {
+    if (!condition) {
+        report << "FAIL: " << what << std::endl;
+        failures++;
+    }
+}
+
+// 写一个由 blocks 个相同块组成的文件，去重后它们共用一个数据块
+bool write_repeated(MyFileSystem& fs, const std::string& path, uint64_t blocks, char fill) {
+    if (!fs.create(path)) {
+        return false;
+    }
+    int fd = fs.open(path);
+    std::vector<char> chunk(256 * BLOCK, fill);
+    bool ok = true;
+    for (uint64_t written = 0; ok && written < blocks; written += 256) {
+        uint64_t count = std::min<uint64_t>(256, blocks - written);
+        ok = fs.write(fd, written * BLOCK, count * BLOCK, chunk.data());
+    }
+    fs.close(fd);
+    return ok;
+}
+
+// 检查文件的每一块内容都是 fill
+bool expect_repeated(MyFileSystem& fs, const std::string& path, uint64_t blocks, char fill) {
+    int fd = fs.open(path);
+    if (fd == -1) {
+        return false;
+    }
+    std::vector<char> chunk(256 * BLOCK);
+    bool ok = true;
+    for (uint64_t done = 0; ok && done < blocks; done += 256) {
+        uint64_t count = std::min<uint64_t>(256, blocks - done);
+        ok = fs.read(fd, done * BLOCK, count * BLOCK, chunk.data()) &&
+             std::all_of(chunk.begin(), chunk.begin() + count * BLOCK, [&](char c) { return c == fill; });
+    }
+    fs.close(fd);
+    return ok;
+}
+
+int main() {
+    report.rdbuf(std::cout.rdbuf());
+    std::ofstream null_stream;
+    std::streambuf* cerr_buffer = std::cerr.rdbuf(null_stream.rdbuf());
+    std::cout.rdbuf(null_stream.rdbuf());
+
+    MountOptions options;
+    MyFileSystem fs(IMAGE);
+    if (!parse_mount_options("dedup", options) || !fs.format(64 * 1024 * 1024, 10, BLOCK) || !fs.mount(options)) {
+        check(false, "format/mount");
+    } else {
+        // 40000 次引用的块再克隆一次就超过 65535
+        const uint64_t heavy = 40000;
+        check(write_repeated(fs, "/heavy", heavy, 'h'), "write heavily deduplicated file");
+        check(!fs.clone("/heavy", "/heavy2"), "clone overflowing the reference count was accepted");
+        check(fs.open("/heavy2") == -1, "rejected clone left its target behind");
+        check(fs.fsck(false) == 0, "fsck after rejected clone");
+
+        // 30000 次引用的块克隆后是 60000 次，仍在上限之内
+        const uint64_t light = 30000;
+        check(write_repeated(fs, "/light", light, 'l'), "write deduplicated file");
+        check(fs.clone("/light", "/light2"), "clone within the reference count limit");
+        check(fs.fsck(false) == 0, "fsck after clone");
+
+        // 删除原文件后，克隆和未克隆的文件内容都不变
+        check(fs.remove("/light"), "remove clone source");
+        fs.wait_reclaim();
+        check(expect_repeated(fs, "/light2", light, 'l'), "clone contents after removing the source");
+        check(expect_repeated(fs, "/heavy", heavy, 'h'), "source contents after rejected clone");
+        check(fs.remove("/light2") && fs.remove("/heavy"), "remove remaining files");
+        fs.wait_reclaim();
+        check(fs.fsck(false) == 0, "fsck after removing everything");
+        fs.unmount();
+    }
+
+    std::cout.rdbuf(report.rdbuf());
+    std::cerr.rdbuf(cerr_buffer);
+    std::filesystem::remove(IMAGE);
+    report << (failures == 0 ? "All tests passed." : std::to_string(failures) + " test(s) failed.") << std::endl;
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,98 @@
+#include "src/myfs.h"
+#include <filesystem>
+
+// 用法: test_fallocate
+// 回归测试：fallocate 预留的块可能是刚释放的块，其中还有已删除文件的数据，
+// 读出、truncate 扩大文件和部分写入时都必须是 0
+
+const std::string IMAGE = "test_fallocate.img";
+const unsigned int BLOCK = DEFAULT_BLOCK_SIZE;
+
+// 测试结果输出到这里，文件系统自己的提示信息丢弃
+std::ostream report(nullptr);
+int failures = 0;
+
+void check(bool condition, const std::string& what) {
+    if (!condition) {
+        report << "FAIL: " << what << std::endl;
+        failures++;
+    }
+}
+
+// 检查 [offset, offset + length) 的内容全是 expected
+void expect_bytes(MyFileSystem& fs, int fd, uint64_t offset, unsigned int length, char expected, const std::string& what) {
+    std::vector<char> buffer(length, 'X');
+    if (!fs.read(fd, offset, length, buffer.data())) {
+        check(false, what + ": read failed");
+        return;
+    }
+    check(std::all_of(buffer.begin(), buffer.end(), [&](char c) { return c == expected; }), what);
+}
+
+// 写满一个文件再删除，等回收线程释放后，它的块里留下 'S'
+void leave_stale_blocks(MyFileSystem& fs) {
+    std::vector<char> stale(8 * BLOCK, 'S');
+    fs.create("/stale");
+    int fd = fs.open("/stale");
+    fs.write(fd, 0, stale.size(), stale.data());
+    fs.close(fd);
+    fs.remove("/stale");
+    fs.wait_reclaim();
+}
+
+void run(const std::string& mode) {
+    MountOptions options;
+    check(parse_mount_options(mode, options), mode + ": mount options");
+    MyFileSystem fs(IMAGE);
+    if (!fs.format(16 * 1024 * 1024, 10, BLOCK) || !fs.mount(options)) {
+        check(false, mode + ": format/mount");
+        return;
+    }
+
+    // 文件末尾之内的空洞
+    leave_stale_blocks(fs);
+    fs.create("/inside");
+    int fd = fs.open("/inside");
+    fs.write(fd, 3 * BLOCK, 1, "x");
+    fs.fallocate(fd, 0, 3 * BLOCK);
+    expect_bytes(fs, fd, 0, 3 * BLOCK, 0, mode + ": fallocate inside EOF");
+    fs.close(fd);
+
+    // 文件末尾之后预留，再用 truncate 扩大
+    leave_stale_blocks(fs);
+    fs.create("/beyond");
+    fd = fs.open("/beyond");
+    fs.fallocate(fd, 0, 4 * BLOCK);
+    fs.truncate(fd, 4 * BLOCK);
+    expect_bytes(fs, fd, 0, 4 * BLOCK, 0, mode + ": fallocate then truncate");
+    fs.close(fd);
+
+    // 部分写入预留过的块，块中其余部分仍是 0
+    leave_stale_blocks(fs);
+    fs.create("/partial");
+    fd = fs.open("/partial");
+    fs.write(fd, 4 * BLOCK, 1, "x");
+    fs.fallocate(fd, 0, 4 * BLOCK);
+    fs.write(fd, 100, 1, "y");
+    expect_bytes(fs, fd, 0, 100, 0, mode + ": partial write head");
+    expect_bytes(fs, fd, 101, 4 * BLOCK - 101, 0, mode + ": partial write tail");
+    fs.close(fd);
+
+    check(fs.fsck(false) == 0, mode + ": fsck");
+    fs.unmount();
+}
+
+int main() {
+    report.rdbuf(std::cout.rdbuf());
+    std::ofstream null_stream;
+    std::streambuf* cerr_buffer = std::cerr.rdbuf(null_stream.rdbuf());
+    std::cout.rdbuf(null_stream.rdbuf());
+    for (const char* mode : {"sync", "async", "compress", "dedup"}) {
+        run(mode);
+    }
+    std::cout.rdbuf(report.rdbuf());
+    std::cerr.rdbuf(cerr_buffer);
+    std::filesystem::remove(IMAGE);
+    report << (failures == 0 ? "All tests passed." : std::to_string(failures) + " test(s) failed.") << std::endl;
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,91 @@
+#include "src/myfs.h"
+#include <filesystem>
+
+// 用法: test_superblock
+// 回归测试：超级块损坏时挂载失败，fsck 要在挂载前直接检查超级块，-y 时修复或重建后镜像能正常挂载
+
+const std::string IMAGE = "test_superblock.img";
+
+// 测试结果输出到这里，文件系统自己的提示信息丢弃
+std::ostream report(nullptr);
+int failures = 0;
+
+void check(bool condition, const std::string& what) {
+    if (!condition) {
+        report << "FAIL: " << what << std::endl;
+        failures++;
+    }
+}
+
+// 格式化一个有克隆文件 (因而有引用计数表) 的镜像
+bool prepare() {
+    MyFileSystem fs(IMAGE);
+    bool ok = fs.format(32 * 1024 * 1024, 10, DEFAULT_BLOCK_SIZE) && fs.mount() && fs.create("/a");
+    int fd = fs.open("/a");
+    ok = ok && fd != -1 && fs.write(fd, 0, 5, "hello") && fs.close(fd) && fs.clone("/a", "/b");
+    return fs.unmount() && ok;
+}
+
+// 改写超级块中 offset 处的字段
+template <typename T>
+void corrupt(size_t offset, T value) {
+    std::fstream image(IMAGE, std::ios::in | std::ios::out | std::ios::binary);
+    image.seekp(offset, std::ios::beg);
+    image.write(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+// 损坏的字段应当被发现并修复，修复后挂载和完整检查都正常，文件内容不变
+template <typename T>
+void repairable(const std::string& what, size_t offset, T value) {
+    if (!prepare()) {
+        check(false, what + ": prepare");
+        return;
+    }
+    corrupt(offset, value);
+    MyFileSystem fs(IMAGE);
+    unsigned int errors = 0;
+    check(!fs.check_superblock(false, errors) && errors > 0, what + ": damage not reported");
+    errors = 0;
+    check(fs.check_superblock(true, errors) && errors > 0, what + ": not repaired");
+    errors = 0;
+    check(fs.check_superblock(false, errors) && errors == 0, what + ": still damaged after repair");
+    if (!fs.mount()) {
+        check(false, what + ": mount after repair");
+        return;
+    }
+    fs.fsck(true);
+    check(fs.fsck(false) == 0, what + ": fsck after repair");
+    char data[5] = {};
+    int fd = fs.open("/b");
+    check(fd != -1 && fs.read(fd, 0, 5, data) && std::string(data, 5) == "hello", what + ": contents after repair");
+    fs.close(fd);
+    fs.unmount();
+}
+
+int main() {
+    report.rdbuf(std::cout.rdbuf());
+    std::ofstream null_stream;
+    std::streambuf* cerr_buffer = std::cerr.rdbuf(null_stream.rdbuf());
+    std::cout.rdbuf(null_stream.rdbuf());
+
+    repairable("magic", offsetof(Superblock, magic_number), 0u);
+    repairable("checksum", offsetof(Superblock, checksum), 0x12345678u);
+    repairable("data block count", offsetof(Superblock, data_block_count), (uint64_t)1);
+    repairable("data area start", offsetof(Superblock, free_data_block_start), (uint64_t)12345);
+    repairable("refcount table", offsetof(Superblock, refcount_start), (uint64_t)1 << 40);
+
+    // 版本号无法从镜像的其他部分推断，只报告不修复
+    if (prepare()) {
+        corrupt(offsetof(Superblock, version), 99u);
+        MyFileSystem fs(IMAGE);
+        unsigned int errors = 0;
+        check(!fs.check_superblock(true, errors) && errors > 0, "version: unrecoverable damage not reported");
+        check(!fs.mount(), "version: mounted a bad version");
+    }
+
+    std::cout.rdbuf(report.rdbuf());
+    std::cerr.rdbuf(cerr_buffer);
+    std::filesystem::remove(IMAGE);
+    report << (failures == 0 ? "All tests passed." : std::to_string(failures) + " test(s) failed.") << std::endl;
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,114 @@
+#include "src/myfs.h"
+#include <cerrno>
+#include <dlfcn.h>
+#include <filesystem>
+#include <unistd.h>
+
+// 用法: test_sync
+// 回归测试：sync 挂载时每次调用返回前都要对每个设备 fdatasync，而不只是把文件流交给操作系统；
+// async 挂载时等到 sync 才落盘；落盘失败要报告给调用者
+// 测试程序自己定义 fdatasync，记录文件系统对哪些镜像调用了它，再转给 C 库中的实现
+
+const std::string IMAGE = "test_sync.img";
+const std::string MEMBER = "test_sync_member.img";
+
+// 每个镜像被 fdatasync 的次数 (按文件名统计)
+std::map<std::string, int> sync_counts;
+// 为 true 时 fdatasync 返回 EIO
+bool fail_syncs = false;
+
+extern "C" int fdatasync(int fd) {
+    static auto real = reinterpret_cast<int (*)(int)>(dlsym(RTLD_NEXT, "fdatasync"));
+    char target[4096];
+    ssize_t length = readlink(("/proc/self/fd/" + std::to_string(fd)).c_str(), target, sizeof(target) - 1);
+    if (length > 0) {
+        sync_counts[std::filesystem::path(std::string(target, length)).filename().string()]++;
+    }
+    if (fail_syncs) {
+        errno = EIO;
+        return -1;
+    }
+    return real(fd);
+}
+
+// 测试结果输出到这里，文件系统自己的提示信息丢弃
+std::ostream report(nullptr);
+int failures = 0;
+
+void check(bool condition, const std::string& what) {
+    if (!condition) {
+        report << "FAIL: " << what << std::endl;
+        failures++;
+    }
+}
+
+// 格式化一个带成员镜像的条带文件系统，并创建一个空文件
+bool prepare(MyFileSystem& fs, const std::string& mode) {
+    DeviceLayout layout;
+    layout.members.push_back(MEMBER);
+    MountOptions options;
+    return fs.format(32 * 1024 * 1024, 10, DEFAULT_BLOCK_SIZE, true, layout) && parse_mount_options(mode, options) &&
+           fs.mount(options) && fs.create("/f");
+}
+
+void test_sync_mount() {
+    MyFileSystem fs(IMAGE);
+    if (!prepare(fs, "sync")) {
+        check(false, "sync: format/mount");
+        return;
+    }
+    int fd = fs.open("/f");
+    // 写满几个条带，两个镜像上都有数据
+    std::vector<char> data(1024 * 1024, 'd');
+    for (int round = 0; round < 3; round++) {
+        sync_counts.clear();
+        check(fs.write(fd, (uint64_t)round * data.size(), data.size(), data.data()), "sync: write");
+        check(sync_counts[IMAGE] > 0, "sync: write returned before the image was synced");
+        check(sync_counts[MEMBER] > 0, "sync: write returned before the member image was synced");
+    }
+    // 只改元数据的调用也要落盘
+    sync_counts.clear();
+    check(fs.mkdir("/d"), "sync: mkdir");
+    check(sync_counts[IMAGE] > 0, "sync: mkdir returned before the image was synced");
+    fs.close(fd);
+    check(fs.unmount(), "sync: unmount");
+}
+
+void test_async_mount() {
+    MyFileSystem fs(IMAGE);
+    if (!prepare(fs, "async")) {
+        check(false, "async: format/mount");
+        return;
+    }
+    int fd = fs.open("/f");
+    sync_counts.clear();
+    check(fs.write(fd, 0, 100, std::string(100, 'a').data()), "async: write");
+    check(sync_counts[IMAGE] == 0, "async: small write synced the image");
+    check(fs.sync(), "async: sync");
+    check(sync_counts[IMAGE] > 0 && sync_counts[MEMBER] > 0, "async: sync did not sync every device");
+
+    // 落盘失败：后台写回时的失败在下一次 sync 时报告，之后恢复正常
+    fail_syncs = true;
+    check(fs.write(fd, 0, 100, std::string(100, 'b').data()), "async: write before failure");
+    check(!fs.sync(), "async: failed device sync was not reported");
+    fail_syncs = false;
+    check(fs.write(fd, 0, 100, std::string(100, 'c').data()), "async: write after failure");
+    check(fs.sync(), "async: sync after recovery");
+    fs.close(fd);
+    check(fs.unmount(), "async: unmount");
+}
+
+int main() {
+    report.rdbuf(std::cout.rdbuf());
+    std::ofstream null_stream;
+    std::streambuf* cerr_buffer = std::cerr.rdbuf(null_stream.rdbuf());
+    std::cout.rdbuf(null_stream.rdbuf());
+    test_sync_mount();
+    test_async_mount();
+    std::cout.rdbuf(report.rdbuf());
+    std::cerr.rdbuf(cerr_buffer);
+    std::filesystem::remove(IMAGE);
+    std::filesystem::remove(MEMBER);
+    report << (failures == 0 ? "All tests passed." : std::to_string(failures) + " test(s) failed.") << std::endl;
+    return failures == 0 ? 0 : 1;
+}